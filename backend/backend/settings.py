@@ -138,6 +138,13 @@ STATICFILES_DIRS = [
     BASE_DIR / 'static',
 ]
 
+# ESP32 firmware images staged by `manage.py push_firmware`, fetched by devices over HTTP
+FIRMWARE_DIR = BASE_DIR / 'firmware'
+
+# Close a classroom's open sessions when its device reports the room vacant
+# (only devices built with an OCCUPANCY_SENSOR send these)
+OCCUPANCY_AUTO_CLOSE = True
+
 # Default primary key field type
 # https://docs.djangoproject.com/en/6.0/ref/settings/#default-auto-field
 
@@ -185,6 +192,15 @@ CHANNEL_LAYERS = {
     },
 }
 
+# Shared by every worker: a retransmitted tap can land on a different process
+# than the original, and its dedupe entry (core.consumers) must be visible there
+CACHES = {
+    'default': {
+        'BACKEND': 'django.core.cache.backends.redis.RedisCache',
+        'LOCATION': 'redis://127.0.0.1:6379/1',
+    },
+}
+
 # CORS Configuration
 CORS_ALLOWED_ORIGINS = [
     "http://localhost:5173",
@@ -220,7 +236,9 @@ CELERY_ENABLE_UTC = False
 CELERY_BEAT_SCHEDULE = {
     'auto-timeout-attendance-sessions': {
         'task': 'core.tasks.auto_timeout_sessions',
-        'schedule': 30.0,  # Run every 30 seconds
+        # Safety net only: each session has its own ETA task (timeout_session) and
+        # occupancy-equipped rooms close on the device's vacant event
+        'schedule': 300.0,
     },
     # Optional: Daily cleanup task (runs at midnight)
     # 'cleanup-old-sessions': {
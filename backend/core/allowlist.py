@@ -0,0 +1,58 @@
+"""
+Allowlist sync for ESP32 devices.
+
+Devices keep a local copy of teacher RFID UIDs and display names so they can
+greet a teacher without waiting for the server. The copy is split into
+BUCKETS buckets by a hash of the UID, and each bucket has an order-independent
+checksum. A device sends its checksums and we resend only the buckets that
+differ. The hashing here must match esp32/src/uid_cache.cpp exactly.
+
+A bucket is sent as one or more frames of at most FRAME_ENTRIES entries, so
+a frame always fits the device's inbound JSON arena however many teachers
+hash to it. If a later part is lost the bucket's checksum won't match and the
+next sync sends the whole bucket again.
+"""
+
+BUCKETS = 16
+NAME_BYTES = 16  # One 16x2 LCD line
+FRAME_ENTRIES = 16  # ~1.3 KB of IN_ARENA_SIZE (2 KB) on the device
+
+FNV_OFFSET = 2166136261
+FNV_PRIME = 16777619
+
+
+def fnv1a32(data, h=FNV_OFFSET):
+    for byte in data:
+        h ^= byte
+        h = (h * FNV_PRIME) & 0xFFFFFFFF
+    return h
+
+
+def display_name(teacher):
+    """Full name cut to what fits on the LCD, without splitting a UTF-8 character."""
+    name = teacher.get_full_name() or teacher.username
+    return name.encode('utf-8')[:NAME_BYTES].decode('utf-8', 'ignore')
+
+
+def build_buckets(teachers):
+    """Group (uid, name) pairs by bucket and compute each bucket's checksum."""
+    entries = [[] for _ in range(BUCKETS)]
+    checksums = [0] * BUCKETS
+    
+    for teacher in teachers:
+        uid = teacher.rfid_uid.strip().upper()
+        name = display_name(teacher)
+        uid_hash = fnv1a32(uid.encode('ascii', 'ignore'))
+        bucket = uid_hash % BUCKETS
+        
+        entries[bucket].append([uid, name])
+        checksums[bucket] = (checksums[bucket] + fnv1a32(name.encode('utf-8'), uid_hash)) & 0xFFFFFFFF
+    
+    return entries, checksums
+
+
+def bucket_parts(bucket_entries):
+    """Split one bucket into frame-sized parts; an empty bucket is one empty part."""
+    if not bucket_entries:
+        return [[]]
+    return [bucket_entries[i:i + FRAME_ENTRIES] for i in range(0, len(bucket_entries), FRAME_ENTRIES)]
@@ -5,3 +5,7 @@ class CoreConfig(AppConfig):
     default_auto_field = 'django.db.models.BigAutoField'
     name = 'core'
     verbose_name = 'Core Application'
+    
+    def ready(self):
+        # Register signal handlers
+        from core import signals  # noqa: F401
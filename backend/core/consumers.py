@@ -1,33 +1,63 @@
 import json
+import msgpack
+from urllib.parse import urlencode
 from channels.generic.websocket import AsyncWebsocketConsumer
 from channels.db import database_sync_to_async
+from django.conf import settings
+from django.core.cache import cache
 from django.utils import timezone
 from datetime import datetime, timedelta
+from decimal import Decimal
+
+from core.allowlist import BUCKETS, bucket_parts, build_buckets
+
+# Every connected ESP32, for fleet-wide pushes such as allowlist changes
+IOT_DEVICES_GROUP = 'iot_devices'
+
+# Devices send their token in this header so it stays out of URLs and access logs;
+# older firmware still puts it in the query string
+DEVICE_TOKEN_HEADER = b'x-device-token'
+
+# A tap retransmitted with the same seq within this window gets the first verdict back
+TAP_DEDUPE_SECONDS = 600
 
 
 class IoTConsumer(AsyncWebsocketConsumer):
     """WebSocket consumer for ESP32 devices."""
     
+    # Encodings we can speak, in order of preference (negotiated by the device's hello)
+    SUPPORTED_ENCODINGS = ['msgpack', 'json']
+    
     async def connect(self):
+        # Every connection starts in JSON until the device's hello picks otherwise
+        self.encoding = 'json'
+        self.last_reconnect = None  # Last reconnect counters logged for this device
+        self.firmware = None  # Version from the device's hello
+        self.board = ''  # Hardware ID from the device's hello
+        self.device_id = ''  # Device ID, boot and counter at boot from the hello, for energy_wh
+        self.boot_id = None
+        self.boot_wh = None
+        
         # Convert classroom_id to int for consistent handling
         self.classroom_id = int(self.scope['url_route']['kwargs']['classroom_id'])
         self.room_group_name = f'iot_classroom_{self.classroom_id}'
         
         print(f"[IoT] Connection attempt for classroom {self.classroom_id}")
         
-        # Validate device token from query string
-        query_string = self.scope.get('query_string', b'').decode()
-        print(f"[IoT] Query string: {query_string}")
-        
-        params = {}
-        if query_string:
-            for param in query_string.split('&'):
-                if '=' in param:
-                    key, value = param.split('=', 1)
-                    params[key] = value
-        
-        device_token = params.get('token', '')
-        print(f"[IoT] Token received: {device_token}")
+        # Validate device token from its header, or the query string for older firmware
+        headers = dict(self.scope.get('headers', []))
+        device_token = headers.get(DEVICE_TOKEN_HEADER, b'').decode()
+        self.token_in_header = bool(device_token)
+        if not device_token:
+            query_string = self.scope.get('query_string', b'').decode()
+            params = {}
+            if query_string:
+                for param in query_string.split('&'):
+                    if '=' in param:
+                        key, value = param.split('=', 1)
+                        params[key] = value
+            device_token = params.get('token', '')
+        print(f"[IoT] Token received in {'header' if self.token_in_header else 'query string'}")
         
         # Verify classroom and device token
         is_valid, error_msg = await self.verify_device(device_token)
@@ -37,6 +67,7 @@ class IoTConsumer(AsyncWebsocketConsumer):
             print(f"[IoT] Rejecting connection: {error_msg}")
             await self.close(code=4003)
             return
+        self.device_token = device_token  # Also authorizes its firmware downloads
         
         # Accept connection first, then join group
         await self.accept()
@@ -48,6 +79,10 @@ class IoTConsumer(AsyncWebsocketConsumer):
                 self.room_group_name,
                 self.channel_name
             )
+            await self.channel_layer.group_add(
+                IOT_DEVICES_GROUP,
+                self.channel_name
+            )
         
         print(f"[IoT] ESP32 device connected for classroom {self.classroom_id}")
     
@@ -57,16 +92,117 @@ class IoTConsumer(AsyncWebsocketConsumer):
             self.room_group_name,
             self.channel_name
         )
+        await self.channel_layer.group_discard(
+            IOT_DEVICES_GROUP,
+            self.channel_name
+        )
         print(f"ESP32 device disconnected from classroom {self.classroom_id}")
     
-    async def receive(self, text_data):
-        """Handle incoming data from ESP32 devices."""
+    async def send_device(self, message):
+        """Send a message to the device in its negotiated encoding."""
+        if self.encoding == 'msgpack':
+            await self.send(bytes_data=msgpack.packb(message))
+        else:
+            await self.send(text_data=json.dumps(message))
+    
+    async def receive(self, text_data=None, bytes_data=None):
+        """Handle incoming data from ESP32 devices (JSON text or MessagePack binary)."""
         try:
-            data = json.loads(text_data)
+            if bytes_data is not None:
+                data = msgpack.unpackb(bytes_data, raw=False)
+            else:
+                data = json.loads(text_data)
+        except Exception:
+            # msgpack documents catching Exception for all unpack failures
+            await self.send_device({
+                'status': 'error',
+                'message': 'Invalid payload'
+            })
+            return
+        
+        # Coalesced low-priority messages (power, heartbeat, metrics, occupancy): handle each
+        # as if it had come alone, then ack the frame once so it still counts as a heartbeat
+        if isinstance(data, dict) and data.get('type') == 'bundle':
+            for message in data.get('msgs') or []:
+                if isinstance(message, dict):
+                    await self.handle_message(message, ack=False)
+            await self.send_device({
+                'status': 'ok',
+                'timestamp': timezone.now().isoformat()
+            })
+            return
+        
+        await self.handle_message(data)
+    
+    async def handle_message(self, data, ack=True):
+        """Handle one device message; ack=False inside a bundle, which is acked as a whole."""
+        try:
+            # Encoding negotiation: the device lists what it can decode, we pick one
+            if data.get('type') == 'hello':
+                offered = data.get('encodings') or []
+                self.encoding = next((e for e in self.SUPPORTED_ENCODINGS if e in offered), 'json')
+                self.firmware = data.get('fw')
+                self.board = data.get('board') or ''
+                self.device_id = data.get('device_id') or ''
+                self.boot_id = data.get('boot')
+                self.boot_wh = data.get('boot_wh')
+                print(f"[IoT] Classroom {self.classroom_id} using {self.encoding} "
+                      f"(proto {data.get('proto')}, firmware {self.firmware})")
+                # The reply itself still goes out as JSON; the device switches once it reads it
+                await self.send(text_data=json.dumps({
+                    'event': 'hello',
+                    'encoding': self.encoding
+                }))
+                return
+            
+            # Device sent its allowlist bucket checksums; resend whatever differs
+            if data.get('type') == 'allowlist_sync':
+                await self.sync_allowlist(data.get('buckets') or [])
+                return
+            
+            # Heartbeats carry the device's lifetime reconnect counters; log when they move
+            if data.get('type') == 'heartbeat':
+                reconnect = data.get('reconnect')
+                if reconnect and reconnect != self.last_reconnect:
+                    self.last_reconnect = reconnect
+                    print(f"[IoT] Reconnects for classroom {self.classroom_id}: "
+                          f"{reconnect.get('connects')} connects, {reconnect.get('failures')} failed attempts, "
+                          f"{reconnect.get('disconnects')} drops, last backoff {reconnect.get('last_delay')} ms")
+            
+            # Periodic timing report (microseconds) and heap figures
+            if data.get('type') == 'metrics':
+                self.log_metrics(data)
+                return
+            
+            # Firmware update progress: downloading, applied (reboots when idle) or failed
+            if data.get('type') == 'ota_status':
+                print(f"[IoT] Firmware {data.get('version')} on classroom {self.classroom_id}: "
+                      f"{data.get('state')} {data.get('progress')}%"
+                      + (f" ({data.get('error')})" if data.get('error') else ''))
+                return
+            
+            # Answer to a config_update: every setting now in use on the device
+            if data.get('type') == 'config_applied':
+                print(f"[IoT] Config for classroom {self.classroom_id} "
+                      f"({data.get('rejected')} rejected): {data.get('values')}")
+                return
+            
+            # Filtered presence transition, sent with the power reading at that moment
+            if data.get('type') == 'occupancy':
+                await self.handle_occupancy(data)
+                return
+            
             device_id = data.get('device_id')
             rfid_uid = data.get('rfid_uid')
             power = data.get('power')
             timestamp_str = data.get('timestamp')
+            queued = bool(data.get('queued'))
+            # Taps carry a per-device sequence number (echoed back) and the device's epoch ms at scan
+            seq = data.get('seq')
+            device_ms = data.get('device_ms')
+            # Student/employee number from the card's ID sector, when the device is set to read one
+            card_id = data.get('card_id')
+            duplicate = False
             
             # Parse timestamp from ESP32 or use server time
             # ESP32 sends ISO format with timezone offset (e.g., 2026-01-11T01:30:00+08:00)
@@ -90,24 +226,55 @@ class IoTConsumer(AsyncWebsocketConsumer):
                 # Use server time if no timestamp provided
                 timestamp = timezone.now()
             
-            # Process RFID if present (server time is used internally)
+            # Process RFID if present. Live taps use server time; taps the device
+            # queued while offline are processed at the time they were scanned.
             if rfid_uid:
-                result = await self.process_rfid(rfid_uid)
+                # The device retries taps it got no answer for; answer a retry from the cache.
+                # seq restarts on a replacement board, so the key includes the hardware ID too
+                dedupe_key = (f'iot_tap:{self.classroom_id}:{device_id}:{self.board}:{seq}'
+                              if seq is not None else None)
+                result = await cache.aget(dedupe_key) if dedupe_key else None
+                duplicate = result is not None
                 
-                # Broadcast attendance event to dashboard
-                print(f"[IoT] Broadcasting attendance event to dashboard_classroom_{self.classroom_id}")
-                await self.channel_layer.group_send(
-                    f'dashboard_classroom_{self.classroom_id}',
-                    {
-                        'type': 'attendance_event',
-                        'classroom_id': self.classroom_id,
+                if duplicate:
+                    print(f"[IoT] Tap seq {seq} for classroom {self.classroom_id} retransmitted, replaying verdict")
+                else:
+                    if device_ms:
+                        lag_ms = timezone.now().timestamp() * 1000 - device_ms
+                        print(f"[IoT] Tap seq {seq} reached the server {lag_ms:.0f} ms after the scan")
+                    scanned_at = timestamp if queued and timestamp_str else None
+                    result = await self.process_rfid(rfid_uid, scanned_at, door=data.get('door') or '')
+                    if dedupe_key:
+                        await cache.aset(dedupe_key, result, TAP_DEDUPE_SECONDS)
+                
+                # Tell the device the verdict; it only showed a provisional one from its cache.
+                # Replayed offline taps are skipped so old taps don't flash on the LCD.
+                if not queued:
+                    verdict = {
                         'event': result['event'],
                         'data': result['data']
                     }
-                )
+                    if seq is not None:
+                        verdict['seq'] = seq
+                    await self.send_device(verdict)
+                
+                # Broadcast attendance event to dashboard
+                if not duplicate:
+                    print(f"[IoT] Broadcasting attendance event to dashboard_classroom_{self.classroom_id}"
+                          + (f" (card ID {card_id})" if card_id else ''))
+                    await self.channel_layer.group_send(
+                        f'dashboard_classroom_{self.classroom_id}',
+                        {
+                            'type': 'attendance_event',
+                            'classroom_id': self.classroom_id,
+                            'event': result['event'],
+                            'data': result['data'],
+                            'card_id': card_id
+                        }
+                    )
             
-            # Process power reading if present
-            if power is not None:
+            # Process power reading if present (a retransmitted tap's reading was already saved)
+            if power is not None and not duplicate:
                 energy_log = await self.save_energy_log(power)
                 
                 # Broadcast power update to dashboard (use the auto-generated timestamp)
@@ -122,22 +289,191 @@ class IoTConsumer(AsyncWebsocketConsumer):
                     }
                 )
             
-            # Send acknowledgment
-            await self.send(text_data=json.dumps({
-                'status': 'ok',
-                'timestamp': timezone.now().isoformat()
-            }))
+            # Batched power frame: summary stats plus delta-encoded samples
+            if data.get('type') == 'power_batch':
+                samples = self.decode_power_samples(data)
+                if samples:
+                    # One log row per frame keeps the DB rate where it was; the mean
+                    # represents the whole window better than the last sample
+                    energy_log = await self.save_energy_log(
+                        round(data.get('mean', samples[-1]), 2),
+                        meter_wh=data.get('energy_wh')
+                    )
+                    
+                    await self.channel_layer.group_send(
+                        f'dashboard_classroom_{self.classroom_id}',
+                        {
+                            'type': 'power_update',
+                            'classroom_id': self.classroom_id,
+                            'watts': data.get('last', samples[-1]),
+                            'timestamp': energy_log.timestamp.isoformat() if energy_log else timezone.now().isoformat(),
+                            'samples': samples,
+                            'sample_interval_ms': data.get('interval'),
+                            'energy_wh': data.get('energy_wh')
+                        }
+                    )
+            
+            # Send acknowledgment; seq tells the device which request it answers
+            if ack:
+                reply = {
+                    'status': 'ok',
+                    'timestamp': timezone.now().isoformat()
+                }
+                if seq is not None:
+                    reply['seq'] = seq
+                await self.send_device(reply)
             
-        except json.JSONDecodeError:
-            await self.send(text_data=json.dumps({
-                'status': 'error',
-                'message': 'Invalid JSON'
-            }))
         except Exception as e:
-            await self.send(text_data=json.dumps({
+            error = {
                 'status': 'error',
                 'message': str(e)
-            }))
+            }
+            if isinstance(data, dict) and data.get('seq') is not None:
+                error['seq'] = data['seq']
+            await self.send_device(error)
+    
+    async def handle_occupancy(self, data):
+        """Log the transition and its power reading; a vacant room closes its open sessions."""
+        occupied = bool(data.get('occupied'))
+        since_ms = data.get('since_ms') or 0
+        power = data.get('power')
+        print(f"[IoT] Classroom {self.classroom_id} {'occupied' if occupied else 'vacant'} "
+              f"for {since_ms / 1000:.0f} s, {power} W")
+        
+        energy_log = None
+        if power is not None:
+            energy_log = await self.save_energy_log(power, meter_wh=data.get('energy_wh'))
+        
+        await self.channel_layer.group_send(
+            f'dashboard_classroom_{self.classroom_id}',
+            {
+                'type': 'occupancy_update',
+                'classroom_id': self.classroom_id,
+                'occupied': occupied,
+                'watts': power,
+                'timestamp': energy_log.timestamp.isoformat() if energy_log else timezone.now().isoformat()
+            }
+        )
+        
+        if occupied or not settings.OCCUPANCY_AUTO_CLOSE:
+            return
+        for closed in await self.close_vacant_sessions(since_ms):
+            await self.channel_layer.group_send(
+                f'dashboard_classroom_{self.classroom_id}',
+                {
+                    'type': 'auto_timeout_event',
+                    'data': closed
+                }
+            )
+    
+    async def sync_allowlist(self, device_checksums):
+        """Send the allowlist buckets whose checksum differs from the device's."""
+        entries, checksums = await self.get_allowlist_buckets()
+        
+        changed = 0
+        for bucket in range(BUCKETS):
+            device_checksum = device_checksums[bucket] if bucket < len(device_checksums) else None
+            if device_checksum != checksums[bucket]:
+                # Part 0 replaces the device's bucket, later parts add to it
+                for part, part_entries in enumerate(bucket_parts(entries[bucket])):
+                    await self.send_device({
+                        'event': 'allowlist_bucket',
+                        'bucket': bucket,
+                        'part': part,
+                        'entries': part_entries
+                    })
+                changed += 1
+        
+        print(f"[IoT] Allowlist sync for classroom {self.classroom_id}: {changed} bucket(s) sent")
+        await self.send_device({
+            'event': 'allowlist_done',
+            'changed': changed
+        })
+    
+    async def allowlist_changed(self, event):
+        """A teacher or card changed; ask the device to resync."""
+        await self.send_device({'event': 'allowlist_changed'})
+    
+    async def config_update(self, event):
+        """Push new intervals/deadbands to the device; it saves them and answers config_applied."""
+        message = {'event': 'config_update', 'values': event.get('values') or {}}
+        if event.get('reset'):
+            message['reset'] = True
+        await self.send_device(message)
+    
+    async def ota_update(self, event):
+        """Point the device at a staged firmware image; it downloads it over HTTP from this server."""
+        if event['version'] == self.firmware:
+            return
+        # A device that sent its token as a header sends it on the download too
+        params = {'classroom': self.classroom_id}
+        if not self.token_in_header:
+            params['token'] = self.device_token
+        query = urlencode(params)
+        await self.send_device({
+            'event': 'ota_update',
+            'version': event['version'],
+            'path': f"/api/firmware/{event['name']}/?{query}",
+            'md5': event['md5'],
+            'size': event['size'],
+            'image_size': event['image_size'],
+            'zlib': event['zlib'],
+        })
+    
+    @database_sync_to_async
+    def get_allowlist_buckets(self):
+        """Active teachers with a card, grouped into sync buckets."""
+        from core.models import User
+        teachers = User.objects.filter(
+            role='teacher',
+            is_active=True,
+            rfid_uid__isnull=False
+        ).exclude(rfid_uid='')
+        return build_buckets(teachers)
+    
+    def log_metrics(self, data):
+        """Print a device's stage timings so slow taps can be traced to a stage."""
+        stages = data.get('stages') or {}
+        summary = ', '.join(
+            f"{name} p50={s.get('p50')}us p99={s.get('p99')}us max={s.get('max')}us"
+            for name, s in stages.items()
+        )
+        heap = data.get('heap') or {}
+        taps = data.get('taps') or {}
+        clock = data.get('clock') or {}
+        health = data.get('health') or {}
+        uplink = data.get('uplink') or {}
+        connect = data.get('connect') or {}
+        # Only devices that read a card ID sector report failed sector authentications
+        auth = f" auth_failures={taps['auth_failures']}" if 'auth_failures' in taps else ''
+        print(f"[IoT] Metrics for classroom {self.classroom_id}: {summary or 'no samples'}; "
+              f"taps pending={taps.get('pending')} retries={taps.get('retries')} outbox={taps.get('outbox')}{auth}; "
+              f"clock syncs={clock.get('syncs')} drift={clock.get('drift_ppb')}ppb "
+              f"last_error={clock.get('last_error_us')}us since_sync={clock.get('since_sync')}s; "
+              f"heap free={heap.get('free')} largest={heap.get('largest')} min_free={heap.get('min_free')} "
+              f"frag={heap.get('frag')}%; "
+              f"health reset={health.get('reset_reason')} health_reboot={health.get('health_reboot')} "
+              f"rfid_resets={health.get('rfid_resets')} socket_resets={health.get('socket_resets')} "
+              f"heap_strikes={health.get('heap_strikes')}; "
+              f"uplink frames={uplink.get('frames')} msgs={uplink.get('msgs')}; "
+              f"connect tls={connect.get('tls')} last={connect.get('last_ms')}ms max={connect.get('max_ms')}ms "
+              f"heap_cost={connect.get('heap_cost')} handshakes={connect.get('handshakes')} "
+              f"deferred={connect.get('deferred')}")
+    
+    @staticmethod
+    def decode_power_samples(data):
+        """Expand a power_batch 'samples' array back into watts.
+        
+        The device sends scaled integers where the first value is absolute and
+        each following value is the difference from the previous sample.
+        """
+        scale = data.get('scale') or 1
+        samples = []
+        value = 0
+        for delta in data.get('samples') or []:
+            value += int(delta)
+            samples.append(value / scale)
+        return samples
     
     @database_sync_to_async
     def verify_device(self, token):
@@ -146,7 +482,6 @@ class IoTConsumer(AsyncWebsocketConsumer):
         try:
             classroom = Classroom.objects.get(id=self.classroom_id)
             print(f"[IoT] Found classroom: {classroom.name}, is_active={classroom.is_active}")
-            print(f"[IoT] Expected token: '{classroom.device_token}', Received: '{token}'")
             
             if not classroom.is_active:
                 return False, "Classroom is not active"
@@ -159,10 +494,13 @@ class IoTConsumer(AsyncWebsocketConsumer):
             return False, f"Classroom {self.classroom_id} does not exist"
     
     @database_sync_to_async
-    def process_rfid(self, rfid_uid):
+    def process_rfid(self, rfid_uid, scanned_at=None, door=''):
         """Process RFID scan and create attendance record.
         
         Uses server time for all timestamps - server is the single source of truth.
+        The exception is scanned_at, set for taps the device stored while offline,
+        which is used in place of the current time for schedule matching and time_in.
+        door names the reader the card was tapped on, for rooms with several.
         """
         from core.models import User, Classroom, Schedule, AttendanceSession
         from django.db.models import Q
@@ -172,8 +510,8 @@ class IoTConsumer(AsyncWebsocketConsumer):
             teacher = User.objects.get(rfid_uid=rfid_uid, role='teacher', is_active=True)
             classroom = Classroom.objects.get(id=self.classroom_id)
             
-            # Use server time - single source of truth
-            now = datetime.now()
+            # Use server time - single source of truth (unless replaying an offline tap)
+            now = scanned_at or datetime.now()
             today = now.date()
             current_time = now.time()
             day_of_week = now.weekday()
@@ -182,7 +520,7 @@ class IoTConsumer(AsyncWebsocketConsumer):
             print(f"\n{'='*60}")
             print(f"[RFID DEBUG] Processing RFID scan")
             print(f"[RFID DEBUG] Teacher: {teacher.get_full_name()} (ID: {teacher.id})")
-            print(f"[RFID DEBUG] Classroom: {classroom.name} (ID: {classroom.id})")
+            print(f"[RFID DEBUG] Classroom: {classroom.name} (ID: {classroom.id}) door: {door or '-'}")
             print(f"[RFID DEBUG] Server Time: {now.strftime('%Y-%m-%d %H:%M:%S')}")
             print(f"[RFID DEBUG] Day of Week: {day_of_week} (0=Mon, 1=Tue, 2=Wed, 3=Thu, 4=Fri, 5=Sat, 6=Sun)")
             print(f"[RFID DEBUG] Current Time: {current_time}")
@@ -290,9 +628,15 @@ class IoTConsumer(AsyncWebsocketConsumer):
                 # time_in uses auto_now_add=True - server sets it automatically
                 expected_out=expected_out,
                 status=status,
-                rfid_uid_used=rfid_uid
+                rfid_uid_used=rfid_uid,
+                door=door[:32]
             )
             
+            # auto_now_add ignores explicit values, so backdate offline taps afterwards
+            if scanned_at:
+                AttendanceSession.objects.filter(pk=session.pk).update(time_in=scanned_at)
+                session.time_in = scanned_at
+            
             # Schedule real-time timeout if valid session with expected_out
             if status == 'IN' and expected_out:
                 try:
@@ -314,7 +658,8 @@ class IoTConsumer(AsyncWebsocketConsumer):
                     'time': session.time_in.strftime('%H:%M'),  # Use session's auto-set time
                     'expected_out': expected_out.strftime('%H:%M') if expected_out else None,
                     'status': status,
-                    'schedule_subject': schedule.subject if schedule else None
+                    'schedule_subject': schedule.subject if schedule else None,
+                    'door': door
                 }
             }
             
@@ -335,14 +680,79 @@ class IoTConsumer(AsyncWebsocketConsumer):
             }
     
     @database_sync_to_async
-    def save_energy_log(self, watts):
-        """Save energy reading to database. Timestamp is auto-set by the model."""
+    def close_vacant_sessions(self, since_ms):
+        """Auto-close the classroom's open sessions at the moment the room went quiet.
+        
+        since_ms is how long ago, as of sending, the room started looking
+        empty, so that is when the teacher actually left; it stays right when
+        the device resends the state after a reconnect. Sessions opened after
+        that moment are left alone.
+        """
+        from core.models import AttendanceSession
+        
+        left_at = timezone.localtime(timezone.now()) - timedelta(milliseconds=since_ms)
+        sessions = AttendanceSession.objects.filter(
+            classroom_id=self.classroom_id,
+            status='IN',
+            time_in__lt=left_at
+        ).select_related('teacher', 'classroom')
+        
+        closed = []
+        for session in sessions:
+            session.status = 'AUTO_OUT'
+            session.time_out = left_at
+            session.save()
+            print(f"[IoT] Room vacant: closed session {session.id} for {session.teacher}")
+            closed.append({
+                'session_id': session.id,
+                'teacher': session.teacher.get_full_name(),
+                'teacher_id': session.teacher_id,
+                'classroom': session.classroom.name,
+                'classroom_id': session.classroom_id,
+                'time_out': timezone.localtime(session.time_out).strftime('%H:%M'),
+                'reason': 'vacant'
+            })
+        return closed
+    
+    @database_sync_to_async
+    def save_energy_log(self, watts, meter_wh=None):
+        """Save energy reading to database. Timestamp is auto-set by the model.
+        
+        meter_wh is the device's lifetime energy counter. The difference from the
+        previous metered row is stored as energy_wh, so summing energy_wh over a
+        period gives the exact energy no matter how sparsely the device reports.
+        
+        After a reboot the counter resumes from its last NVS save, below the
+        last reported value. The first row of a new boot is therefore counted
+        from the boot_wh the device restored (0 after a real reset).
+        """
         from core.models import Classroom, EnergyLog
         
         classroom = Classroom.objects.get(id=self.classroom_id)
+        
+        energy_wh = None
+        if meter_wh is not None:
+            meter_wh = Decimal(str(round(meter_wh, 3)))
+            previous = EnergyLog.objects.filter(
+                classroom=classroom,
+                device_id=self.device_id,
+                meter_wh__isnull=False
+            ).order_by('-timestamp').first()
+            
+            base = previous.meter_wh if previous is not None else None
+            if previous is not None and self.boot_id is not None and previous.boot_id != self.boot_id:
+                base = Decimal(str(round(self.boot_wh or 0, 3)))
+            # Still running backwards (a device that doesn't send boot): treat it as a reset
+            if base is not None and meter_wh >= base:
+                energy_wh = meter_wh - base
+        
         energy_log = EnergyLog.objects.create(
             classroom=classroom,
-            watts=watts
+            watts=watts,
+            meter_wh=meter_wh,
+            energy_wh=energy_wh,
+            device_id=self.device_id,
+            boot_id=self.boot_id
             # timestamp is auto_now_add - set automatically
         )
         return energy_log
@@ -426,7 +836,8 @@ class DashboardConsumer(AsyncWebsocketConsumer):
             'type': 'attendance',
             'classroom_id': event.get('classroom_id'),
             'event': event['event'],
-            'data': event['data']
+            'data': event['data'],
+            'card_id': event.get('card_id')
         }))
     
     async def power_update(self, event):
@@ -436,6 +847,19 @@ class DashboardConsumer(AsyncWebsocketConsumer):
             'type': 'power',
             'classroom_id': event.get('classroom_id'),
             'watts': event['watts'],
+            'timestamp': event['timestamp'],
+            'samples': event.get('samples'),
+            'sample_interval_ms': event.get('sample_interval_ms'),
+            'energy_wh': event.get('energy_wh')
+        }))
+    
+    async def occupancy_update(self, event):
+        """Handle occupancy transition broadcasts."""
+        await self.send(text_data=json.dumps({
+            'type': 'occupancy',
+            'classroom_id': event.get('classroom_id'),
+            'occupied': event['occupied'],
+            'watts': event.get('watts'),
             'timestamp': event['timestamp']
         }))
     
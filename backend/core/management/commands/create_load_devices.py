@@ -0,0 +1,48 @@
+"""
+Create (or remove) the classrooms the ESP32 load generator connects as.
+Run with: python manage.py create_load_devices --count 200 > devices.csv
+Prints one "classroom_id,token,device_id" line per classroom for esp32/loadgen.
+"""
+
+import secrets
+
+from django.core.management.base import BaseCommand
+
+from core.models import Classroom
+
+# Load-test classrooms are recognised by this device_id prefix
+DEVICE_PREFIX = 'LOAD-'
+
+
+class Command(BaseCommand):
+    help = 'Create classrooms with device tokens for the ESP32 load generator'
+    
+    def add_arguments(self, parser):
+        parser.add_argument('--count', type=int, default=10, help='Number of load-test classrooms')
+        parser.add_argument('--delete', action='store_true',
+                            help='Remove every load-test classroom instead')
+    
+    def handle(self, *args, **options):
+        existing = Classroom.objects.filter(device_id__startswith=DEVICE_PREFIX)
+        
+        if options['delete']:
+            deleted, _ = existing.delete()
+            self.stderr.write(f"Deleted {deleted} load-test rows")
+            return
+        
+        # Reuse what earlier runs created so tokens in old CSVs keep working; looked up
+        # one by one, since a partial delete can leave gaps in the numbering
+        classrooms = []
+        for index in range(options['count']):
+            classroom, _ = Classroom.objects.get_or_create(
+                device_id=f'{DEVICE_PREFIX}{index:04d}',
+                defaults={
+                    'name': f'Load Test {index:04d}',
+                    'device_token': secrets.token_hex(16),
+                },
+            )
+            classrooms.append(classroom)
+        
+        for classroom in classrooms:
+            self.stdout.write(f"{classroom.id},{classroom.device_token},{classroom.device_id}")
+        self.stderr.write(f"{len(classrooms)} load-test classrooms")
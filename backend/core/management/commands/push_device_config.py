@@ -0,0 +1,64 @@
+"""
+Retune ESP32 intervals and deadbands without reflashing.
+Run with: python manage.py push_device_config --classroom 1 --set heartbeat_ms=10000
+Devices save the values in NVS; only devices connected right now receive them.
+"""
+
+from django.core.management.base import BaseCommand, CommandError
+from channels.layers import get_channel_layer
+from asgiref.sync import async_to_sync
+
+from core.consumers import IOT_DEVICES_GROUP
+
+# Names the firmware accepts (esp32/src/tuning.cpp checks the ranges)
+SETTINGS = (
+    'power_sample_ms',
+    'power_flush_ms',
+    'power_max_interval_ms',
+    'power_deadband',
+    'heartbeat_ms',
+    'metrics_ms',
+    'lcd_update_ms',
+    'rfid_read_ms',
+    'uplink_window_ms',
+)
+
+
+class Command(BaseCommand):
+    help = 'Push a config_update to one classroom\'s device or to every connected device'
+    
+    def add_arguments(self, parser):
+        target = parser.add_mutually_exclusive_group(required=True)
+        target.add_argument('--classroom', type=int, help='Classroom ID of the device to retune')
+        target.add_argument('--all', action='store_true', help='Every connected device')
+        parser.add_argument('--set', action='append', default=[], metavar='NAME=VALUE',
+                            help=f"Setting to change, repeatable. One of: {', '.join(SETTINGS)}")
+        parser.add_argument('--reset', action='store_true',
+                            help='Go back to the compiled-in defaults (before applying any --set)')
+    
+    def handle(self, *args, **options):
+        values = {}
+        for item in options['set']:
+            name, sep, value = item.partition('=')
+            if not sep or name not in SETTINGS:
+                raise CommandError(f"Bad setting '{item}', expected NAME=VALUE with NAME one of: {', '.join(SETTINGS)}")
+            try:
+                values[name] = float(value) if name == 'power_deadband' else int(value)
+            except ValueError:
+                raise CommandError(f"Bad value for {name}: {value}")
+        
+        if not values and not options['reset']:
+            raise CommandError('Nothing to push: give --set and/or --reset')
+        
+        channel_layer = get_channel_layer()
+        if channel_layer is None:
+            raise CommandError('No channel layer configured')
+        
+        group = IOT_DEVICES_GROUP if options['all'] else f"iot_classroom_{options['classroom']}"
+        async_to_sync(channel_layer.group_send)(group, {
+            'type': 'config_update',
+            'values': values,
+            'reset': options['reset'],
+        })
+        
+        self.stdout.write(self.style.SUCCESS(f'Sent config_update to {group}: {values or "defaults"}'))
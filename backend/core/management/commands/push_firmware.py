@@ -0,0 +1,97 @@
+"""
+Roll a new ESP32 firmware image out over the air.
+Run with: python manage.py push_firmware --file .pio/build/esp32dev/firmware.bin --firmware-version 1.1.0 --percent 10
+Re-run with a higher --percent to widen the rollout; the devices already picked stay picked.
+Only devices connected right now are told; the image itself stays in FIRMWARE_DIR.
+"""
+
+import hashlib
+import shutil
+import zlib
+from pathlib import Path
+
+from django.conf import settings
+from django.core.management.base import BaseCommand, CommandError
+from channels.layers import get_channel_layer
+from asgiref.sync import async_to_sync
+
+from core.models import Classroom
+
+# Must fit the firmware's OTA_VERSION_LEN buffer
+MAX_VERSION_LEN = 23
+
+
+def in_rollout(version, classroom_id, percent):
+    """Stable per-version pick, so 10% then 50% keeps the first 10% and a new version reshuffles."""
+    digest = hashlib.sha256(f'{version}:{classroom_id}'.encode()).digest()
+    return int.from_bytes(digest[:4], 'big') % 100 < percent
+
+
+class Command(BaseCommand):
+    help = 'Stage a firmware image and send ota_update to one classroom or a percentage of the fleet'
+
+    def add_arguments(self, parser):
+        parser.add_argument('--file', required=True, help='firmware.bin built by PlatformIO')
+        # Not --version: every manage.py command already has that for Django's own version
+        parser.add_argument('--firmware-version', required=True, help='FIRMWARE_VERSION compiled into the image')
+        parser.add_argument('--compress', action='store_true',
+                            help='Send it zlib-compressed; the device inflates while writing flash')
+        target = parser.add_mutually_exclusive_group(required=True)
+        target.add_argument('--classroom', type=int, help='Classroom ID of a single device (e.g. a canary)')
+        target.add_argument('--percent', type=int, help='Share of active classrooms, 1-100')
+
+    def handle(self, *args, **options):
+        version = options['firmware_version']
+        if not version or len(version) > MAX_VERSION_LEN:
+            raise CommandError(f'Version must be 1-{MAX_VERSION_LEN} characters')
+        percent = options['percent']
+        if percent is not None and not 1 <= percent <= 100:
+            raise CommandError('--percent must be between 1 and 100')
+
+        source = Path(options['file'])
+        try:
+            image = source.read_bytes()
+        except OSError as e:
+            raise CommandError(f'Cannot read {source}: {e}')
+        # ESP-IDF app images start with this magic byte; catches passing the wrong .bin
+        if not image or image[0] != 0xE9:
+            raise CommandError(f'{source} is not an ESP32 app image')
+
+        # The device checks the MD5 of what it writes, i.e. the uncompressed image
+        md5 = hashlib.md5(image).hexdigest()
+        firmware_dir = Path(settings.FIRMWARE_DIR)
+        firmware_dir.mkdir(parents=True, exist_ok=True)
+        if options['compress']:
+            name = f'firmware-{version}.bin.zlib'
+            body = zlib.compress(image, 9)
+            (firmware_dir / name).write_bytes(body)
+            size = len(body)
+        else:
+            name = f'firmware-{version}.bin'
+            shutil.copyfile(source, firmware_dir / name)
+            size = len(image)
+
+        if options['classroom'] is not None:
+            targets = [options['classroom']]
+        else:
+            ids = Classroom.objects.filter(is_active=True).values_list('id', flat=True)
+            targets = [cid for cid in ids if in_rollout(version, cid, percent)]
+
+        channel_layer = get_channel_layer()
+        if channel_layer is None:
+            raise CommandError('No channel layer configured')
+
+        for classroom_id in targets:
+            async_to_sync(channel_layer.group_send)(f'iot_classroom_{classroom_id}', {
+                'type': 'ota_update',
+                'version': version,
+                'name': name,
+                'md5': md5,
+                'size': size,
+                'image_size': len(image),
+                'zlib': options['compress'],
+            })
+
+        self.stdout.write(self.style.SUCCESS(
+            f'Staged {name} ({size} bytes, image {len(image)}, md5 {md5}); '
+            f'sent ota_update to {len(targets)} classroom(s): {", ".join(map(str, targets)) or "none"}'))
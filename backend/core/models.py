@@ -82,6 +82,7 @@ class AttendanceSession(models.Model):
     expected_out = models.DateTimeField(null=True, blank=True)
     status = models.CharField(max_length=10, choices=STATUS_CHOICES, default='IN')
     rfid_uid_used = models.CharField(max_length=50)
+    door = models.CharField(max_length=32, blank=True, default='')  # Which reader the tap came from
     created_at = models.DateTimeField(auto_now_add=True)
     
     class Meta:
@@ -96,6 +97,13 @@ class EnergyLog(models.Model):
     """Records power consumption readings from ESP32 devices."""
     classroom = models.ForeignKey(Classroom, on_delete=models.CASCADE, related_name='energy_logs')
     watts = models.DecimalField(max_digits=10, decimal_places=2)
+    # Device's lifetime watt-hour counter at this reading (null for devices that don't send one)
+    meter_wh = models.DecimalField(max_digits=14, decimal_places=3, null=True, blank=True)
+    # Energy used since the previous metered reading, from the counter difference
+    energy_wh = models.DecimalField(max_digits=12, decimal_places=3, null=True, blank=True)
+    # Which device and which of its boots sent meter_wh; a counter only continues within one boot
+    device_id = models.CharField(max_length=50, blank=True, default='')
+    boot_id = models.BigIntegerField(null=True, blank=True)
     timestamp = models.DateTimeField(auto_now_add=True)  # Auto-set to server time when created
     # Remove created_at since timestamp now serves the same purpose
     
@@ -0,0 +1,74 @@
+"""
+Signal handlers that push changes out to connected ESP32 devices.
+"""
+
+from asgiref.sync import async_to_sync
+from channels.layers import get_channel_layer
+from django.db.models.signals import post_delete, post_save, pre_save
+from django.dispatch import receiver
+
+from core.models import User
+
+# What a device's allowlist entry is built from (core.allowlist); other saves,
+# such as the last_login update on every sign-in, leave it unchanged
+ALLOWLIST_FIELDS = ('rfid_uid', 'role', 'is_active', 'first_name', 'last_name', 'username')
+UNCHANGED = object()  # pre_save already knows the save can't touch the allowlist
+
+
+def allowlisted(values):
+    return values['role'] == 'teacher' and values['is_active'] and bool(values['rfid_uid'])
+
+
+@receiver(pre_save, sender=User)
+def remember_allowlist_fields(sender, instance, **kwargs):
+    """Keep the stored row's allowlist fields so post_save can tell what changed."""
+    instance._allowlist_before = None
+    if instance.pk is None:
+        return
+    
+    update_fields = kwargs.get('update_fields')
+    if update_fields is not None and not set(update_fields) & set(ALLOWLIST_FIELDS):
+        instance._allowlist_before = UNCHANGED
+        return
+    
+    instance._allowlist_before = (
+        User.objects.filter(pk=instance.pk).values(*ALLOWLIST_FIELDS).first()
+    )
+
+
+@receiver(post_save, sender=User)
+def notify_allowlist_saved(sender, instance, created, **kwargs):
+    """Resync devices when a save adds, drops or edits an allowlisted teacher."""
+    before = getattr(instance, '_allowlist_before', None)
+    if before is UNCHANGED:
+        return
+    
+    after = {field: getattr(instance, field) for field in ALLOWLIST_FIELDS}
+    if before is None:
+        # New user (or the old row vanished): only matters if it is on the list now
+        if allowlisted(after):
+            notify_allowlist_changed()
+        return
+    
+    # A demotion or deactivation takes the teacher off the list, so the old row counts too
+    if (allowlisted(before) or allowlisted(after)) and before != after:
+        notify_allowlist_changed()
+
+
+@receiver(post_delete, sender=User)
+def notify_allowlist_deleted(sender, instance, **kwargs):
+    if instance.role == 'teacher':
+        notify_allowlist_changed()
+
+
+def notify_allowlist_changed():
+    """Devices cache teacher UIDs and names; tell them to resync after an edit."""
+    channel_layer = get_channel_layer()
+    if channel_layer is None:
+        return
+    
+    from core.consumers import IOT_DEVICES_GROUP
+    try:
+        async_to_sync(channel_layer.group_send)(IOT_DEVICES_GROUP, {'type': 'allowlist_changed'})
+    except Exception as e:
+        print(f"[IoT] Could not notify devices of allowlist change: {e}")
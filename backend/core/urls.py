@@ -3,7 +3,7 @@ from rest_framework.routers import DefaultRouter
 from .views import (
     LoginView, LogoutView, UserViewSet, ClassroomViewSet,
     ScheduleViewSet, AttendanceSessionViewSet, EnergyLogViewSet,
-    EnergyReportView, DashboardView
+    EnergyReportView, DashboardView, FirmwareDownloadView
 )
 
 router = DefaultRouter()
@@ -19,4 +19,5 @@ urlpatterns = [
     path('auth/logout/', LogoutView.as_view(), name='logout'),
     path('energy/report/', EnergyReportView.as_view(), name='energy-report'),
     path('dashboard/', DashboardView.as_view(), name='dashboard'),
+    path('firmware/<str:name>/', FirmwareDownloadView.as_view(), name='firmware-download'),
 ]
@@ -3,11 +3,14 @@ from rest_framework.decorators import action
 from rest_framework.response import Response
 from rest_framework.views import APIView
 from rest_framework_simplejwt.tokens import RefreshToken
+from django.conf import settings
 from django.contrib.auth import authenticate, get_user_model
+from django.http import FileResponse, Http404
 from django.utils import timezone
-from django.db.models import Sum, Avg, Max, Min, Count
+from django.db.models import Sum, Avg, Max, Min, Count, Q
 from django.db.models.functions import TruncDate, TruncHour, TruncDay, TruncMonth
 from datetime import datetime, timedelta
+from pathlib import Path
 from .models import Classroom, Schedule, AttendanceSession, EnergyLog, EnergyAggregation
 from .serializers import (
     UserSerializer, UserCreateSerializer, ClassroomSerializer, ClassroomCreateSerializer,
@@ -318,21 +321,27 @@ class EnergyReportView(APIView):
         else:
             trunc_func = TruncDay
         
+        unmetered = Q(energy_wh__isnull=True)
         data = queryset.annotate(
             period=trunc_func('timestamp')
         ).values('period').annotate(
             avg_watts=Avg('watts'),
             max_watts=Max('watts'),
             min_watts=Min('watts'),
-            reading_count=Count('id')
+            reading_count=Count('id'),
+            metered_wh=Sum('energy_wh'),
+            unmetered_avg_watts=Avg('watts', filter=unmetered),
+            unmetered_count=Count('id', filter=unmetered)
         ).order_by('period')
         
-        # Calculate kWh (assuming readings are every minute)
         result = []
         for item in data:
-            # Estimate kWh based on average watts and reading frequency
-            hours = item['reading_count'] / 60  # Assuming readings per minute
-            kwh = (float(item['avg_watts']) * hours) / 1000
+            # Devices that integrate energy themselves: exact
+            kwh = float(item['metered_wh'] or 0) / 1000
+            if item['unmetered_count']:
+                # Older firmware: estimate from average watts and reading frequency
+                hours = item['unmetered_count'] / 60  # Assuming readings per minute
+                kwh += (float(item['unmetered_avg_watts']) * hours) / 1000
             result.append({
                 'period': item['period'].isoformat() if item['period'] else None,
                 'total_kwh': round(kwh, 4),
@@ -399,5 +408,29 @@ class DashboardView(APIView):
         })
 
 
+class FirmwareDownloadView(APIView):
+    """Serve a staged firmware image to an ESP32 that presents its classroom's device token."""
+    authentication_classes = []
+    permission_classes = [permissions.AllowAny]
+    
+    def get(self, request, name):
+        try:
+            classroom = Classroom.objects.get(id=int(request.query_params.get('classroom', '')))
+        except (ValueError, Classroom.DoesNotExist):
+            raise Http404
+        token = request.headers.get('X-Device-Token') or request.query_params.get('token')
+        if not classroom.is_active or classroom.device_token != token:
+            return Response({'error': 'Invalid device token'}, status=status.HTTP_403_FORBIDDEN)
+        
+        # Only plain file names from FIRMWARE_DIR, never a path
+        if Path(name).name != name:
+            raise Http404
+        image = Path(settings.FIRMWARE_DIR) / name
+        if not image.is_file():
+            raise Http404
+        # The device checks Content-Length against the size it was told, so no compression here
+        return FileResponse(open(image, 'rb'), content_type='application/octet-stream')
+
+
 # Import models for Q object usage
 from django.db import models
@@ -0,0 +1,676 @@
+/**
+ * Host benchmark and trace replay for the firmware's hardware-free logic.
+ *
+ * Builds as the native PlatformIO env from the same sources as the
+ * firmware (see build_src_filter in platformio.ini); nothing here talks
+ * to an ESP32. Run from the esp32/ directory:
+ *
+ *   pio run -e native -t exec
+ *   .pio/build/native/program bench/traces   # synthetic traces, or another directory
+ *
+ * Timings are host nanoseconds: compare them between commits on the same
+ * machine, not with microseconds measured on the device.
+ */
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#include <ArduinoJson.h>
+
+#include "civil_time.h"
+#include "config.h"
+#include "deadband.h"
+#include "device_clock.h"
+#include "energy_meter.h"
+#include "inbound.h"
+#include "json_arena.h"
+#include "latency_histogram.h"
+#include "lcd_frame.h"
+#include "messages.h"
+#include "outbox.h"
+#include "power_batch.h"
+#include "rfid_debounce.h"
+#include "uid_cache.h"
+#include "uplink.h"
+#include "wire_protocol.h"
+
+#define BENCH_DEVICE_ID "ESP32-ROOM-01"
+#define BENCH_ITERATIONS 20000
+#define BENCH_WS_RECONNECT WS_RECONNECT_FAST // Simulated delay from Wi-Fi up to WebSocket up
+
+// ============== ALLOCATION COUNTING ==============
+// Anything that reaches the heap through new or a counted JSON allocator bumps this
+static size_t heapAllocs = 0;
+
+void *operator new(size_t size)
+{
+    heapAllocs++;
+    void *p = malloc(size ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    free(p);
+}
+
+// ArduinoJson's default allocator, but counted: what a document would cost without a JsonArena
+class CountingAllocator : public ArduinoJson::Allocator
+{
+public:
+    void *allocate(size_t size) override
+    {
+        heapAllocs++;
+        return malloc(size);
+    }
+
+    void deallocate(void *ptr) override { free(ptr); }
+
+    void *reallocate(void *ptr, size_t newSize) override
+    {
+        heapAllocs++;
+        return realloc(ptr, newSize);
+    }
+};
+
+static CountingAllocator heapJson;
+JSON_ARENA(benchArena, 4096);
+
+// ============== TRACES ==============
+enum TraceKind
+{
+    TRACE_TAP,
+    TRACE_LINK_DOWN,
+    TRACE_LINK_UP
+};
+
+struct TraceEvent
+{
+    uint32_t at;
+    TraceKind kind;
+    char uid[RFID_UID_MAX_LEN];
+    uint8_t reader;
+};
+
+struct PowerSample
+{
+    uint32_t at;
+    float watts;
+};
+
+// taps.csv: "ms,tap,<uid>,<reader>" or "ms,link_down" / "ms,link_up"; '#' starts a comment
+static bool loadTaps(const char *path, std::vector<TraceEvent> &out)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        return false;
+    }
+
+    char line[128];
+    while (fgets(line, sizeof(line), f))
+    {
+        if (line[0] == '#' || line[0] == '\n')
+        {
+            continue;
+        }
+
+        TraceEvent event = {};
+        char kind[16] = "";
+        unsigned reader = 0;
+        int fields = sscanf(line, "%u,%15[^,\n],%20[^,\n],%u", &event.at, kind, event.uid, &reader);
+        if (fields >= 3 && strcmp(kind, "tap") == 0)
+        {
+            event.kind = TRACE_TAP;
+            event.reader = (uint8_t)reader;
+        }
+        else if (fields >= 2 && strcmp(kind, "link_down") == 0)
+        {
+            event.kind = TRACE_LINK_DOWN;
+        }
+        else if (fields >= 2 && strcmp(kind, "link_up") == 0)
+        {
+            event.kind = TRACE_LINK_UP;
+        }
+        else
+        {
+            continue;
+        }
+        out.push_back(event);
+    }
+    fclose(f);
+    return true;
+}
+
+// power.csv: "ms,watts"
+static bool loadPower(const char *path, std::vector<PowerSample> &out)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        return false;
+    }
+
+    char line[64];
+    while (fgets(line, sizeof(line), f))
+    {
+        PowerSample sample;
+        if (line[0] != '#' && sscanf(line, "%u,%f", &sample.at, &sample.watts) == 2)
+        {
+            out.push_back(sample);
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+// ============== MEASUREMENT ==============
+struct Measured
+{
+    double nsPerOp;
+    double allocsPerOp;
+    size_t bytes;
+};
+
+template <typename Op>
+static Measured measure(Op op)
+{
+    op(); // Warm up caches and the arena's high-water mark
+    size_t allocsBefore = heapAllocs;
+    size_t bytes = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        bytes = op();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    Measured m;
+    m.nsPerOp = std::chrono::duration<double, std::nano>(elapsed).count() / BENCH_ITERATIONS;
+    m.allocsPerOp = (double)(heapAllocs - allocsBefore) / BENCH_ITERATIONS;
+    m.bytes = bytes;
+    return m;
+}
+
+static void report(const char *name, const Measured &m)
+{
+    printf("  %-28s %9.0f ns/op %6u B/msg %6.2f allocs/op\n", name, m.nsPerOp, (unsigned)m.bytes, m.allocsPerOp);
+}
+
+// ============== SERIALIZATION ==============
+static void benchSerialization(const std::vector<PowerSample> &power)
+{
+    static uint8_t buffer[1024];
+
+    OutboxEntry tap = {};
+    strcpy(tap.rfidUid, "04A1B2C3D4E5F6");
+    strcpy(tap.timestamp, "2026-01-11T07:58:12+08:00");
+    tap.power = 412.5f;
+
+    PowerBatch batch;
+    for (size_t i = 0; i < power.size() && batch.size() < POWER_FLUSH_INTERVAL / POWER_SAMPLE_INTERVAL; i++)
+    {
+        batch.add(power[i].watts);
+    }
+
+    printf("Serialization (%d iterations)\n", BENCH_ITERATIONS);
+    const WireEncoding encodings[] = {WIRE_JSON, WIRE_MSGPACK};
+    for (WireEncoding encoding : encodings)
+    {
+        char name[40];
+        for (int pass = 0; pass < 2; pass++)
+        {
+            ArduinoJson::Allocator *allocator = pass == 0 ? (ArduinoJson::Allocator *)&benchArena : &heapJson;
+            const char *where = pass == 0 ? "arena" : "heap";
+
+            snprintf(name, sizeof(name), "tap live %s/%s", wireEncodingName(encoding), where);
+            report(name, measure([&]() {
+                       JsonDocument doc(allocator);
+                       buildTapMessage(doc, BENCH_DEVICE_ID, tap, "main", false);
+                       return encodeMessage(doc, encoding, buffer, sizeof(buffer));
+                   }));
+
+            snprintf(name, sizeof(name), "tap queued %s/%s", wireEncodingName(encoding), where);
+            report(name, measure([&]() {
+                       JsonDocument doc(allocator);
+                       buildTapMessage(doc, BENCH_DEVICE_ID, tap, "main", true);
+                       return encodeMessage(doc, encoding, buffer, sizeof(buffer));
+                   }));
+
+            if (!batch.empty())
+            {
+                snprintf(name, sizeof(name), "power_batch[%u] %s/%s", (unsigned)batch.size(),
+                         wireEncodingName(encoding), where);
+                report(name, measure([&]() {
+                           JsonDocument doc(allocator);
+                           buildPowerBatchMessage(doc, BENCH_DEVICE_ID, batch, POWER_SAMPLE_INTERVAL, 1234.5);
+                           return encodeMessage(doc, encoding, buffer, sizeof(buffer));
+                       }));
+            }
+        }
+    }
+}
+
+// ============== INBOUND DISPATCH ==============
+static size_t verdicts = 0;
+
+static void onVerdict(JsonDocument &doc)
+{
+    const char *teacher = doc["data"]["teacher"];
+    verdicts += teacher != nullptr;
+}
+
+static void benchDispatch()
+{
+    static const InboundRoute routes[] = {
+        INBOUND_ROUTE("attendance_in", "{\"data\":{\"teacher\":true}}", onVerdict),
+        INBOUND_ROUTE("allowlist_done", "{}", onVerdict),
+    };
+    InboundDispatcher dispatcher(routes, 2, &benchArena);
+    dispatcher.begin();
+
+    // A verdict as the consumer sends it, with fields the handler never reads
+    static const char frame[] =
+        "{\"event\":\"attendance_in\",\"data\":{\"session_id\":4182,\"teacher\":\"Maria Santos\","
+        "\"teacher_id\":17,\"classroom\":\"Room 101\",\"time_in\":\"07:58\",\"door\":\"main\","
+        "\"expected_out\":\"09:00\",\"subject\":\"Physics\"}}";
+
+    printf("Inbound dispatch\n");
+    report("attendance_in json", measure([&]() {
+               dispatcher.dispatch(WIRE_JSON, (const uint8_t *)frame, sizeof(frame) - 1);
+               return sizeof(frame) - 1;
+           }));
+    printf("  inbound arena high water: %u bytes\n", (unsigned)benchArena.highWater());
+}
+
+// ============== TIMESTAMPS ==============
+static void benchTimestamps()
+{
+    static char buf[64]; // Roomy enough that snprintf can't truncate
+    const int32_t offset = 8 * 3600;
+    int64_t epochMs = 1768089492000LL;
+
+    DeviceClock clock;
+    clock.sync(epochMs * 1000, 0);
+
+    // What the firmware did per tap before DeviceClock: local time split, then snprintf
+    printf("Timestamps\n");
+    report("gmtime_r + snprintf", measure([&]() {
+               time_t t = (time_t)(epochMs / 1000 + offset);
+               struct tm tm;
+               gmtime_r(&t, &tm);
+               epochMs += 1000;
+               return (size_t)snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02d+08:00", tm.tm_year + 1900,
+                                       tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+           }));
+    int64_t mono = 0;
+    report("DeviceClock + formatIso", measure([&]() {
+               mono += 1000000;
+               formatIsoTimestamp(buf, sizeof(buf), clock.epochMs(mono) / 1000, offset);
+               return (size_t)(ISO_TIMESTAMP_LEN - 1);
+           }));
+}
+
+// ============== LCD RENDER ==============
+class CountingSink : public LcdSink
+{
+public:
+    size_t moves = 0;
+    size_t chars = 0;
+
+    void setCursor(uint8_t, uint8_t) override { moves++; }
+    void write(const char *, size_t length) override { chars += length; }
+};
+
+static void benchLcd()
+{
+    LcdFrame frame;
+    CountingSink sink;
+    char clock[LcdFrame::COLUMNS + 1];
+
+    // One status screen per second for an hour, as lcdTask draws it
+    const int frames = 3600;
+    for (int t = 0; t < frames; t++)
+    {
+        snprintf(clock, sizeof(clock), "%02d:%02d:%02d %4dW", 8 + t / 3600, (t / 60) % 60, t % 60, 400 + (t / 10) % 7);
+        frame.clear();
+        frame.printCentered(0, "Room 101");
+        frame.print(0, 1, clock);
+        frame.flush(sink);
+    }
+
+    printf("LCD render (%d status frames)\n", frames);
+    printf("  %.2f chars + %.2f cursor moves per flush (full redraw: %d chars)\n",
+           (double)sink.chars / frames, (double)sink.moves / frames, LcdFrame::COLUMNS * LcdFrame::ROWS);
+}
+
+// ============== TAP REPLAY ==============
+// In-memory stand-in for the LittleFS outbox file
+class MemoryOutboxStore : public OutboxStore
+{
+public:
+    bool available() const override { return true; }
+
+    bool append(const OutboxEntry &entry) override
+    {
+        if (entries.size() >= OUTBOX_FLASH_SLOTS)
+        {
+            return false;
+        }
+        entries.push_back(entry);
+        return true;
+    }
+
+    size_t read(size_t offset, OutboxEntry *out, size_t max) override
+    {
+        size_t n = offset < entries.size() ? entries.size() - offset : 0;
+        n = n < max ? n : max;
+        for (size_t i = 0; i < n; i++)
+        {
+            out[i] = entries[offset + i];
+        }
+        return n;
+    }
+
+    void drop(size_t n) override
+    {
+        entries.erase(entries.begin(), entries.begin() + (n < entries.size() ? n : entries.size()));
+    }
+
+    size_t count() const override { return entries.size(); }
+
+private:
+    std::vector<OutboxEntry> entries;
+};
+
+// Replays taps through the debouncer and outbox with the firmware's timing:
+// a live tap goes out as soon as netTask dequeues it, an offline tap waits for
+// the link, the WebSocket reconnect and the paced outbox drain.
+static void replayTaps(const std::vector<TraceEvent> &trace)
+{
+    UidDebouncer debouncer(RFID_DEBOUNCE_TIME);
+    MemoryOutboxStore store;
+    Outbox outbox(&store);
+    std::vector<uint32_t> tappedAt; // Parallel to the outbox's FIFO order
+    LatencyHistogram latency;       // Milliseconds here, not microseconds
+
+    size_t taps = 0, suppressed = 0, live = 0, offline = 0;
+    bool up = true;
+    uint32_t wsUpAt = 0;
+    uint32_t nextDrain = 0;
+
+    auto drainUntil = [&](uint32_t now) {
+        // Drain passes between the previous event and this one
+        while (up && !outbox.empty() && nextDrain <= now)
+        {
+            // next() reads stored taps back into RAM; the ack is taken as immediate here
+            const OutboxEntry *entry;
+            for (int sent = 0; sent < OUTBOX_DRAIN_BATCH && (entry = outbox.next()); sent++)
+            {
+                latency.record(nextDrain - tappedAt.front());
+                tappedAt.erase(tappedAt.begin());
+                outbox.settle(entry->seq);
+            }
+            nextDrain += OUTBOX_DRAIN_INTERVAL;
+        }
+    };
+
+    for (const TraceEvent &event : trace)
+    {
+        drainUntil(event.at);
+
+        if (event.kind == TRACE_LINK_DOWN)
+        {
+            up = false;
+        }
+        else if (event.kind == TRACE_LINK_UP)
+        {
+            up = true;
+            wsUpAt = event.at + BENCH_WS_RECONNECT;
+            nextDrain = wsUpAt;
+        }
+        else if (!debouncer.accept(event.uid, event.at))
+        {
+            suppressed++;
+        }
+        else
+        {
+            taps++;
+            // netTask sends a live tap straight away even while older taps drain
+            if (up && event.at >= wsUpAt)
+            {
+                latency.record(0);
+                live++;
+                continue;
+            }
+
+            OutboxEntry entry = {};
+            strncpy(entry.rfidUid, event.uid, RFID_UID_MAX_LEN - 1);
+            entry.seq = (uint32_t)taps;
+            if (outbox.push(entry))
+            {
+                tappedAt.push_back(event.at);
+                offline++;
+            }
+        }
+    }
+    drainUntil(UINT32_MAX);
+
+    printf("Tap replay (%u trace events)\n", (unsigned)trace.size());
+    printf("  %u taps accepted, %u debounced repeats, %u live, %u via outbox, %u dropped\n",
+           (unsigned)taps, (unsigned)suppressed, (unsigned)live, (unsigned)offline, (unsigned)outbox.dropped());
+    printf("  simulated tap-to-send: p50 %u ms, p99 %u ms, max %u ms\n",
+           (unsigned)latency.percentile(50), (unsigned)latency.percentile(99), (unsigned)latency.maximum());
+}
+
+// ============== POWER REPLAY ==============
+// Batching, deadband and energy integration over a power trace
+static void replayPower(const std::vector<PowerSample> &trace)
+{
+    static uint8_t buffer[1024];
+
+    PowerBatch batch;
+    EnergyMeter meter(ENERGY_MAX_GAP);
+    DeadbandReporter reporter(POWER_REPORT_DEADBAND, POWER_REPORT_MAX_INTERVAL);
+
+    size_t windows = 0, frames = 0, jsonBytes = 0, msgpackBytes = 0;
+    uint32_t windowStart = trace.empty() ? 0 : trace.front().at;
+
+    for (const PowerSample &sample : trace)
+    {
+        batch.add(sample.watts);
+        meter.add(sample.watts, sample.at);
+
+        if (sample.at - windowStart < POWER_FLUSH_INTERVAL)
+        {
+            continue;
+        }
+        windowStart = sample.at;
+        windows++;
+
+        float mean = batch.stats().mean;
+        if (reporter.due(mean, sample.at))
+        {
+            JsonDocument doc(&benchArena);
+            buildPowerBatchMessage(doc, BENCH_DEVICE_ID, batch, POWER_SAMPLE_INTERVAL, meter.wattHours());
+            jsonBytes += encodeMessage(doc, WIRE_JSON, buffer, sizeof(buffer));
+            msgpackBytes += encodeMessage(doc, WIRE_MSGPACK, buffer, sizeof(buffer));
+            reporter.reported(mean, sample.at);
+            frames++;
+        }
+        batch.clear();
+    }
+
+    printf("Power replay (%u samples)\n", (unsigned)trace.size());
+    printf("  %u of %u flush windows sent, %u B json / %u B msgpack total, %.3f Wh\n",
+           (unsigned)frames, (unsigned)windows, (unsigned)jsonBytes, (unsigned)msgpackBytes, meter.wattHours());
+}
+
+// ============== UPLINK REPLAY ==============
+// Frames per hour for the power trace plus heartbeats and metrics, one frame per message
+// versus coalesced as netTask does it (a heartbeat is skipped when another answered frame
+// went out within the interval)
+static void replayUplink(const std::vector<PowerSample> &trace)
+{
+    static uint8_t buffer[1024];
+    static uint8_t bundleBuffer[3072];
+
+    if (trace.size() < 2)
+    {
+        return;
+    }
+
+    UplinkBundle bundle(bundleBuffer, sizeof(bundleBuffer));
+    bool bundleAnswered = false;
+    PowerBatch batch;
+    DeadbandReporter reporter(POWER_REPORT_DEADBAND, POWER_REPORT_MAX_INTERVAL);
+    ReconnectCounters counters = {1, 0, 1, 0, 0};
+
+    size_t messages = 0, directBytes = 0, frames = 0, bundledBytes = 0;
+    uint32_t start = trace.front().at;
+    uint32_t windowStart = start, lastMetrics = start, lastHeartbeat = start, lastAnswered = start;
+
+    // Encodes one message; counts it as its own frame and queues it for the bundle
+    auto queue = [&](const JsonDocument &doc, uint32_t at, bool answered) {
+        size_t length = encodeMessage(doc, WIRE_MSGPACK, buffer, sizeof(buffer));
+        messages++;
+        directBytes += length;
+        if (!bundle.add(buffer, length, WIRE_MSGPACK, at))
+        {
+            size_t n;
+            bundle.finish(n);
+            bundledBytes += n;
+            frames++;
+            bundle.clear();
+            bundle.add(buffer, length, WIRE_MSGPACK, at);
+        }
+        bundleAnswered = bundleAnswered || answered;
+    };
+
+    for (const PowerSample &sample : trace)
+    {
+        uint32_t at = sample.at;
+        batch.add(sample.watts);
+
+        if (at - windowStart >= POWER_FLUSH_INTERVAL)
+        {
+            windowStart = at;
+            float mean = batch.stats().mean;
+            if (reporter.due(mean, at))
+            {
+                JsonDocument doc(&benchArena);
+                buildPowerBatchMessage(doc, BENCH_DEVICE_ID, batch, POWER_SAMPLE_INTERVAL, 0);
+                queue(doc, at, true);
+                reporter.reported(mean, at);
+            }
+            batch.clear();
+        }
+
+        // Uncoalesced firmware sent one every interval regardless; count those separately
+        if (at - lastHeartbeat >= HEARTBEAT_INTERVAL)
+        {
+            lastHeartbeat = at;
+            JsonDocument doc(&benchArena);
+            buildHeartbeatMessage(doc, BENCH_DEVICE_ID, counters);
+            size_t length = encodeMessage(doc, WIRE_MSGPACK, buffer, sizeof(buffer));
+            if (bundleAnswered || at - lastAnswered < HEARTBEAT_INTERVAL)
+            {
+                messages++; // Skipped: another answered frame stands in for it
+                directBytes += length;
+            }
+            else
+            {
+                queue(doc, at, true);
+            }
+        }
+
+        if (at - lastMetrics >= METRICS_INTERVAL)
+        {
+            lastMetrics = at;
+            JsonDocument doc(&benchArena); // Header only; a real report carries the stage table too
+            doc["device_id"] = BENCH_DEVICE_ID;
+            doc["type"] = "metrics";
+            doc["window"] = METRICS_INTERVAL;
+            queue(doc, at, false);
+        }
+
+        if (bundle.due(at, UPLINK_COALESCE_WINDOW))
+        {
+            size_t n;
+            bundle.finish(n);
+            bundledBytes += n;
+            frames++;
+            if (bundle.count() > 1 || bundleAnswered)
+            {
+                lastAnswered = at;
+            }
+            bundle.clear();
+            bundleAnswered = false;
+        }
+    }
+
+    double hours = (trace.back().at - start) / 3600000.0;
+    printf("Uplink replay (%.1f min, %u ms window)\n", hours * 60, (unsigned)UPLINK_COALESCE_WINDOW);
+    printf("  uncoalesced: %.0f frames/h, %.0f B/h msgpack\n", messages / hours, directBytes / hours);
+    printf("  coalesced:   %.0f frames/h, %.0f B/h msgpack\n", frames / hours, bundledBytes / hours);
+}
+
+int main(int argc, char **argv)
+{
+    const char *dir = argc > 1 ? argv[1] : "bench/traces";
+    char path[256];
+
+    std::vector<TraceEvent> taps;
+    snprintf(path, sizeof(path), "%s/taps.csv", dir);
+    if (!loadTaps(path, taps))
+    {
+        fprintf(stderr, "Can't read %s\n", path);
+        return 1;
+    }
+
+    std::vector<PowerSample> power;
+    snprintf(path, sizeof(path), "%s/power.csv", dir);
+    if (!loadPower(path, power))
+    {
+        fprintf(stderr, "Can't read %s\n", path);
+        return 1;
+    }
+
+    benchSerialization(power);
+    benchDispatch();
+    benchTimestamps();
+    benchLcd();
+    replayTaps(taps);
+    replayPower(power);
+    replayUplink(power);
+    return 0;
+}
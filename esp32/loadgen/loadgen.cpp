@@ -0,0 +1,713 @@
+/**
+ * Fleet load generator: N virtual ESP32 devices against the IoT consumer.
+ *
+ * Each virtual device opens the same /ws/iot/classroom/<id>/?token=
+ * connection as the firmware, negotiates its encoding with a hello, and
+ * then sends taps, power batches and heartbeats built by the firmware's
+ * own message builders (src/messages.cpp). Reconnects use the firmware's
+ * Backoff with the same delays, so a reconnect storm here looks like a
+ * building's worth of devices coming back after an AP or server restart.
+ *
+ * The consumer answers every tap, power frame and heartbeat with a
+ * {"status": ...} ack in arrival order, and live taps additionally with
+ * an attendance_* verdict, so each connection keeps a FIFO of send times
+ * per reply kind and the difference is the server's round trip.
+ *
+ * Builds as the loadgen PlatformIO env. Run from the esp32/ directory:
+ *
+ *   pio run -e loadgen
+ *   .pio/build/loadgen/program --host 127.0.0.1 --tokens devices.csv --devices 200
+ *
+ * devices.csv holds "classroom_id,token[,device_id]" lines, as printed by
+ * `python manage.py create_load_devices`. Devices beyond the number of
+ * lines reuse them in turn, several connections per classroom.
+ */
+#include <deque>
+#include <math.h>
+#include <memory>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <time.h>
+#include <vector>
+
+#include <ArduinoJson.h>
+
+#include "backoff.h"
+#include "config.h"
+#include "latency_histogram.h"
+#include "messages.h"
+#include "power_batch.h"
+#include "reconnect.h"
+#include "wire_protocol.h"
+#include "ws_client.h"
+
+#define LOADGEN_POLL_MS 10      // Longest the loop sleeps when nothing is due
+#define LOADGEN_SEND_BUFFER 2048 // Largest encoded message (a full power batch is well under)
+#define LOADGEN_CONNECT_TIMEOUT 10000 // Default --connect-timeout-ms
+
+// ============== OPTIONS ==============
+struct Options
+{
+    const char *host = "127.0.0.1";
+    unsigned port = CFG_WS_PORT;
+    const char *tokensPath = NULL;
+    const char *uidsPath = NULL;
+    unsigned devices = 10;
+    unsigned durationSec = 60;
+    double tapsPerMinute = 1.0;          // Per device, Poisson arrivals
+    unsigned powerMs = POWER_FLUSH_INTERVAL;
+    unsigned heartbeatMs = HEARTBEAT_INTERVAL;
+    unsigned stormEverySec = 0;          // 0 = no forced disconnects
+    unsigned reportSec = 5;
+    unsigned rampMs = 0;                 // Spread the initial connects over this long
+    unsigned connectTimeoutMs = LOADGEN_CONNECT_TIMEOUT; // TCP connect plus upgrade, 0 = wait forever
+    bool msgpack = true;                 // Offer MessagePack in hello, like the firmware
+    bool jitter = true;                  // Backoff::nextJittered, as on the device
+};
+
+static void usage()
+{
+    fprintf(stderr,
+            "usage: loadgen --tokens FILE [options]\n"
+            "  --host HOST          server address (127.0.0.1)\n"
+            "  --port N             server port (%u)\n"
+            "  --tokens FILE        \"classroom_id,token[,device_id]\" per line\n"
+            "  --devices N          virtual devices (10)\n"
+            "  --duration SEC       run time (60)\n"
+            "  --tap-rate N         taps per device per minute (1)\n"
+            "  --uids FILE          card UIDs to tap, one per line (synthetic if omitted)\n"
+            "  --power-ms N         power batch interval, 0 = off (%u)\n"
+            "  --heartbeat-ms N     heartbeat interval, 0 = off (%u)\n"
+            "  --storm-every SEC    drop every connection at once this often (off)\n"
+            "  --ramp-ms N          spread the first connects over N ms (0)\n"
+            "  --connect-timeout-ms N  abandon a connect + upgrade after N ms, 0 = never (%u)\n"
+            "  --report SEC         progress line interval (5)\n"
+            "  --json | --msgpack   encoding to offer in hello\n"
+            "  --no-jitter          reconnect in lockstep (worst-case storm)\n",
+            CFG_WS_PORT, POWER_FLUSH_INTERVAL, HEARTBEAT_INTERVAL, LOADGEN_CONNECT_TIMEOUT);
+}
+
+static bool parseOptions(int argc, char **argv, Options &opt)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--json") == 0)
+        {
+            opt.msgpack = false;
+            continue;
+        }
+        if (strcmp(arg, "--msgpack") == 0)
+        {
+            opt.msgpack = true;
+            continue;
+        }
+        if (strcmp(arg, "--no-jitter") == 0)
+        {
+            opt.jitter = false;
+            continue;
+        }
+        if (!value)
+        {
+            return false;
+        }
+        i++;
+
+        if (strcmp(arg, "--host") == 0)
+            opt.host = value;
+        else if (strcmp(arg, "--port") == 0)
+            opt.port = (unsigned)atoi(value);
+        else if (strcmp(arg, "--tokens") == 0)
+            opt.tokensPath = value;
+        else if (strcmp(arg, "--uids") == 0)
+            opt.uidsPath = value;
+        else if (strcmp(arg, "--devices") == 0)
+            opt.devices = (unsigned)atoi(value);
+        else if (strcmp(arg, "--duration") == 0)
+            opt.durationSec = (unsigned)atoi(value);
+        else if (strcmp(arg, "--tap-rate") == 0)
+            opt.tapsPerMinute = atof(value);
+        else if (strcmp(arg, "--power-ms") == 0)
+            opt.powerMs = (unsigned)atoi(value);
+        else if (strcmp(arg, "--heartbeat-ms") == 0)
+            opt.heartbeatMs = (unsigned)atoi(value);
+        else if (strcmp(arg, "--storm-every") == 0)
+            opt.stormEverySec = (unsigned)atoi(value);
+        else if (strcmp(arg, "--ramp-ms") == 0)
+            opt.rampMs = (unsigned)atoi(value);
+        else if (strcmp(arg, "--connect-timeout-ms") == 0)
+            opt.connectTimeoutMs = (unsigned)atoi(value);
+        else if (strcmp(arg, "--report") == 0)
+            opt.reportSec = (unsigned)atoi(value);
+        else
+            return false;
+    }
+    return opt.tokensPath != NULL && opt.devices > 0;
+}
+
+// ============== INPUT FILES ==============
+struct Credentials
+{
+    long classroomId;
+    std::string token;
+    std::string deviceId; // Empty: generated from the device index
+};
+
+static bool loadCredentials(const char *path, std::vector<Credentials> &out)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        return false;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), f))
+    {
+        Credentials c;
+        char token[128] = "";
+        char deviceId[64] = "";
+        if (line[0] != '#' && sscanf(line, "%ld,%127[^,\r\n],%63[^,\r\n]", &c.classroomId, token, deviceId) >= 2)
+        {
+            c.token = token;
+            c.deviceId = deviceId;
+            out.push_back(c);
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+static bool loadUids(const char *path, std::vector<std::string> &out)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        return false;
+    }
+
+    char line[64];
+    while (fgets(line, sizeof(line), f))
+    {
+        char uid[RFID_UID_MAX_LEN] = "";
+        if (line[0] != '#' && sscanf(line, "%20s", uid) == 1)
+        {
+            out.push_back(uid);
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+// ============== CLOCK ==============
+static uint64_t nowMicros()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + ts.tv_nsec / 1000;
+}
+
+static uint32_t elapsedMicros(uint64_t since, uint64_t now)
+{
+    uint64_t d = now - since;
+    return d > UINT32_MAX ? UINT32_MAX : (uint32_t)d;
+}
+
+// Exponential gap for Poisson arrivals at perMinute, in microseconds
+static uint64_t poissonGap(double perMinute)
+{
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return (uint64_t)(-log(u) * 60e6 / perMinute);
+}
+
+// ============== STATS ==============
+struct Stats
+{
+    LatencyHistogram ack;     // Message sent -> {"status": ...}
+    LatencyHistogram verdict; // Live tap sent -> attendance_*
+    LatencyHistogram upgrade; // TCP connect started -> 101 Switching Protocols
+    uint32_t sent = 0;
+    uint32_t taps = 0;
+    uint32_t acks = 0;
+    uint32_t errors = 0;      // {"status": "error"}
+    uint32_t verdicts = 0;
+    uint32_t lost = 0;        // Still waiting for a reply when the connection dropped
+    uint32_t connects = 0;
+    uint32_t failures = 0;    // Attempts that never reached WS_OPEN
+    uint32_t timeouts = 0;    // Of those, abandoned after --connect-timeout-ms
+    uint32_t drops = 0;       // Open connections that closed
+};
+
+static Stats total;  // Whole run
+static Stats window; // Since the last progress line
+
+// ============== VIRTUAL DEVICES ==============
+struct VirtualDevice
+{
+    VirtualDevice() : backoff(WS_BACKOFF_MIN, WS_BACKOFF_MAX, WS_RECONNECT_FAST) {}
+
+    char deviceId[32];
+    char path[160];
+
+    WsClient ws;
+    WireEncoding encoding = WIRE_JSON;
+    Backoff backoff;
+    ReconnectCounters counters = {};
+
+    uint64_t connectAt = 0; // Next attempt, while closed
+    uint64_t attemptStartedAt = 0;
+    uint64_t nextTap = 0;
+    uint64_t nextPower = 0;
+    uint64_t nextHeartbeat = 0;
+    float watts = 0;
+    double energyWh = 0;
+
+    std::deque<uint64_t> awaitingAck;     // Send times, oldest first
+    std::deque<uint64_t> awaitingVerdict;
+};
+
+static Options opt;
+static std::vector<std::string> uids;
+static sockaddr_in server;
+static JsonDocument replyFilter;
+
+static void record(LatencyHistogram Stats::*which, uint32_t micros)
+{
+    (total.*which).record(micros);
+    (window.*which).record(micros);
+}
+
+static void count(uint32_t Stats::*which)
+{
+    total.*which += 1;
+    window.*which += 1;
+}
+
+static bool sendDocument(VirtualDevice &dev, const JsonDocument &doc, WireEncoding encoding)
+{
+    uint8_t buf[LOADGEN_SEND_BUFFER];
+    size_t n = encodeMessage(doc, encoding, buf, sizeof(buf));
+    if (n == 0)
+    {
+        return false;
+    }
+    return encoding == WIRE_MSGPACK ? dev.ws.sendBinary(buf, n) : dev.ws.sendText((const char *)buf, n);
+}
+
+// Sends a message the consumer acks with {"status": ...}
+static bool sendAcked(VirtualDevice &dev, const JsonDocument &doc, uint64_t now)
+{
+    if (!sendDocument(dev, doc, dev.encoding))
+    {
+        return false;
+    }
+    dev.awaitingAck.push_back(now);
+    count(&Stats::sent);
+    return true;
+}
+
+static void sendTap(VirtualDevice &dev, uint64_t now)
+{
+    OutboxEntry tap = {};
+    if (!uids.empty())
+    {
+        snprintf(tap.rfidUid, sizeof(tap.rfidUid), "%s", uids[rand() % uids.size()].c_str());
+    }
+    else
+    {
+        snprintf(tap.rfidUid, sizeof(tap.rfidUid), "LOAD%04X", (unsigned)(rand() & 0xFFFF));
+    }
+    tap.power = dev.watts;
+
+    JsonDocument doc;
+    buildTapMessage(doc, dev.deviceId, tap, "", false);
+    if (sendAcked(dev, doc, now))
+    {
+        dev.awaitingVerdict.push_back(now);
+        count(&Stats::taps);
+    }
+}
+
+static void sendPower(VirtualDevice &dev, uint64_t now)
+{
+    // A flush interval's worth of samples wandering around the last value
+    PowerBatch batch;
+    size_t samples = opt.powerMs / POWER_SAMPLE_INTERVAL;
+    if (samples < 1)
+        samples = 1;
+    if (samples > POWER_BATCH_SLOTS)
+        samples = POWER_BATCH_SLOTS;
+    for (size_t i = 0; i < samples; i++)
+    {
+        dev.watts += (float)(rand() % 21 - 10) * 0.5f;
+        if (dev.watts < 0)
+            dev.watts = 0;
+        batch.add(dev.watts);
+    }
+    dev.energyWh += batch.stats().mean * opt.powerMs / 3600000.0;
+
+    JsonDocument doc;
+    buildPowerBatchMessage(doc, dev.deviceId, batch, opt.powerMs / samples, dev.energyWh);
+    sendAcked(dev, doc, now);
+}
+
+static void sendHeartbeat(VirtualDevice &dev, uint64_t now)
+{
+    JsonDocument doc;
+    buildHeartbeatMessage(doc, dev.deviceId, dev.counters);
+    sendAcked(dev, doc, now);
+}
+
+static void scheduleReconnect(VirtualDevice &dev, uint64_t now)
+{
+    uint32_t delay = opt.jitter ? dev.backoff.nextJittered((uint32_t)rand()) : dev.backoff.next();
+    dev.counters.lastDelay = delay;
+    dev.connectAt = now + (uint64_t)delay * 1000;
+}
+
+// Socket gone: count what was lost and wait out the backoff
+static void onClosed(VirtualDevice &dev, uint64_t now, bool wasOpen)
+{
+    dev.ws.close();
+    if (wasOpen)
+    {
+        count(&Stats::drops);
+        dev.counters.disconnects++;
+    }
+    else
+    {
+        count(&Stats::failures);
+        dev.counters.failures++;
+    }
+
+    total.lost += dev.awaitingAck.size() + dev.awaitingVerdict.size();
+    window.lost += dev.awaitingAck.size() + dev.awaitingVerdict.size();
+    dev.awaitingAck.clear();
+    dev.awaitingVerdict.clear();
+    scheduleReconnect(dev, now);
+}
+
+static void onOpen(VirtualDevice &dev, uint64_t now)
+{
+    record(&Stats::upgrade, elapsedMicros(dev.attemptStartedAt, now));
+    count(&Stats::connects);
+    dev.counters.connects++;
+    dev.backoff.reset();
+
+    // Like the firmware: JSON until the server's hello reply says otherwise
+    dev.encoding = WIRE_JSON;
+    JsonDocument doc;
+    buildHelloMessage(doc, dev.deviceId, "loadgen", dev.deviceId, opt.msgpack);
+    sendDocument(dev, doc, WIRE_JSON);
+
+    dev.nextTap = opt.tapsPerMinute > 0 ? now + poissonGap(opt.tapsPerMinute) : UINT64_MAX;
+    dev.nextPower = opt.powerMs ? now + (uint64_t)(rand() % opt.powerMs) * 1000 : UINT64_MAX;
+    dev.nextHeartbeat = opt.heartbeatMs ? now + (uint64_t)opt.heartbeatMs * 1000 : UINT64_MAX;
+}
+
+static void onFrame(void *context, int opcode, const uint8_t *data, size_t length)
+{
+    VirtualDevice &dev = *(VirtualDevice *)context;
+    uint64_t now = nowMicros();
+
+    JsonDocument doc;
+    WireEncoding encoding = opcode == 2 ? WIRE_MSGPACK : WIRE_JSON;
+    if (decodeMessage(doc, encoding, data, length, replyFilter))
+    {
+        return;
+    }
+
+    const char *event = doc["event"];
+    if (event)
+    {
+        if (strcmp(event, "hello") == 0)
+        {
+            WireEncoding selected;
+            if (wireEncodingFromName(doc["encoding"] | "json", selected))
+            {
+                dev.encoding = selected;
+            }
+        }
+        else if (strncmp(event, "attendance_", 11) == 0 && !dev.awaitingVerdict.empty())
+        {
+            record(&Stats::verdict, elapsedMicros(dev.awaitingVerdict.front(), now));
+            dev.awaitingVerdict.pop_front();
+            count(&Stats::verdicts);
+        }
+        return; // Allowlist pushes and config updates aren't simulated
+    }
+
+    const char *status = doc["status"];
+    if (status && !dev.awaitingAck.empty())
+    {
+        record(&Stats::ack, elapsedMicros(dev.awaitingAck.front(), now));
+        dev.awaitingAck.pop_front();
+        count(&Stats::acks);
+        if (strcmp(status, "ok") != 0)
+        {
+            count(&Stats::errors);
+        }
+    }
+}
+
+static void startAttempt(VirtualDevice &dev, uint64_t now)
+{
+    dev.counters.attempts++;
+    dev.attemptStartedAt = now;
+    if (!dev.ws.connect(server, opt.host, dev.path))
+    {
+        onClosed(dev, now, false);
+    }
+}
+
+// Due timers for one device; the socket events are handled by the caller
+static void tick(VirtualDevice &dev, uint64_t now)
+{
+    if (dev.ws.state() == WsClient::WS_CLOSED)
+    {
+        if (now >= dev.connectAt)
+        {
+            startAttempt(dev, now);
+        }
+        return;
+    }
+    if (dev.ws.state() != WsClient::WS_OPEN)
+    {
+        // A SYN or upgrade the server never answers would otherwise park the device for good
+        if (opt.connectTimeoutMs && now - dev.attemptStartedAt >= (uint64_t)opt.connectTimeoutMs * 1000)
+        {
+            count(&Stats::timeouts);
+            onClosed(dev, now, false);
+        }
+        return;
+    }
+
+    if (now >= dev.nextTap)
+    {
+        sendTap(dev, now);
+        dev.nextTap = now + poissonGap(opt.tapsPerMinute);
+    }
+    if (now >= dev.nextPower)
+    {
+        sendPower(dev, now);
+        dev.nextPower += (uint64_t)opt.powerMs * 1000;
+    }
+    if (now >= dev.nextHeartbeat)
+    {
+        sendHeartbeat(dev, now);
+        dev.nextHeartbeat += (uint64_t)opt.heartbeatMs * 1000;
+    }
+}
+
+// ============== REPORTING ==============
+static void printLatency(const char *name, const LatencyHistogram &h)
+{
+    printf("  %-8s n=%-7u p50=%8.1f  p90=%8.1f  p99=%8.1f  max=%8.1f ms\n", name, h.count(),
+           h.percentile(50) / 1000.0, h.percentile(90) / 1000.0, h.percentile(99) / 1000.0,
+           h.maximum() / 1000.0);
+}
+
+static void printProgress(double seconds, const std::vector<std::unique_ptr<VirtualDevice>> &fleet)
+{
+    size_t open = 0;
+    size_t pending = 0;
+    for (size_t i = 0; i < fleet.size(); i++)
+    {
+        if (fleet[i]->ws.state() == WsClient::WS_OPEN)
+            open++;
+        pending += fleet[i]->awaitingAck.size();
+    }
+
+    printf("[%6.1f s] open %zu/%zu  sent %u  acks %u  pending %zu  ack p50 %.1f p99 %.1f ms"
+           "  verdict p99 %.1f ms  connects %u  drops %u\n",
+           seconds, open, fleet.size(), window.sent, window.acks, pending,
+           window.ack.percentile(50) / 1000.0, window.ack.percentile(99) / 1000.0,
+           window.verdict.percentile(99) / 1000.0, window.connects, window.drops);
+    fflush(stdout);
+    window = Stats();
+}
+
+static void printSummary(double seconds)
+{
+    printf("\n%u devices, %.0f s, %.0f msg/s offered\n", opt.devices, seconds, total.sent / seconds);
+    printf("  sent %u (taps %u), acks %u (errors %u), verdicts %u, lost %u\n", total.sent, total.taps,
+           total.acks, total.errors, total.verdicts, total.lost);
+    printf("  connects %u, failed attempts %u (timed out %u), drops %u\n", total.connects, total.failures,
+           total.timeouts, total.drops);
+    printLatency("ack", total.ack);
+    printLatency("verdict", total.verdict);
+    printLatency("upgrade", total.upgrade);
+}
+
+// ============== MAIN ==============
+static bool resolve(const char *host, unsigned port, sockaddr_in &out)
+{
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *result = NULL;
+    if (getaddrinfo(host, NULL, &hints, &result) != 0 || !result)
+    {
+        return false;
+    }
+    out = *(sockaddr_in *)result->ai_addr;
+    out.sin_port = htons((uint16_t)port);
+    freeaddrinfo(result);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (!parseOptions(argc, argv, opt))
+    {
+        usage();
+        return 2;
+    }
+
+    std::vector<Credentials> credentials;
+    if (!loadCredentials(opt.tokensPath, credentials) || credentials.empty())
+    {
+        fprintf(stderr, "no credentials in %s\n", opt.tokensPath);
+        return 1;
+    }
+    if (opt.uidsPath && (!loadUids(opt.uidsPath, uids) || uids.empty()))
+    {
+        fprintf(stderr, "no UIDs in %s\n", opt.uidsPath);
+        return 1;
+    }
+    if (!resolve(opt.host, opt.port, server))
+    {
+        fprintf(stderr, "cannot resolve %s\n", opt.host);
+        return 1;
+    }
+
+    replyFilter["event"] = true;
+    replyFilter["status"] = true;
+    replyFilter["encoding"] = true;
+
+    srand((unsigned)nowMicros());
+    uint64_t start = nowMicros();
+
+    std::vector<std::unique_ptr<VirtualDevice>> fleet;
+    for (unsigned i = 0; i < opt.devices; i++)
+    {
+        std::unique_ptr<VirtualDevice> dev(new VirtualDevice());
+        const Credentials &c = credentials[i % credentials.size()];
+        if (c.deviceId.empty() || i >= credentials.size())
+        {
+            snprintf(dev->deviceId, sizeof(dev->deviceId), "LOAD-%04u", i);
+        }
+        else
+        {
+            snprintf(dev->deviceId, sizeof(dev->deviceId), "%s", c.deviceId.c_str());
+        }
+        if (!formatDevicePath(dev->path, sizeof(dev->path), c.classroomId, c.token.c_str()))
+        {
+            fprintf(stderr, "token too long for classroom %ld\n", c.classroomId);
+            return 1;
+        }
+        dev->connectAt = start + (opt.rampMs ? (uint64_t)opt.rampMs * 1000 * i / opt.devices : 0);
+        fleet.push_back(std::move(dev));
+    }
+
+    printf("%u devices -> %s:%u, %.2f taps/min each, power every %u ms, heartbeat every %u ms%s\n",
+           opt.devices, opt.host, opt.port, opt.tapsPerMinute, opt.powerMs, opt.heartbeatMs,
+           opt.msgpack ? ", offering msgpack" : "");
+
+    const uint64_t end = start + (uint64_t)opt.durationSec * 1000000;
+    uint64_t nextReport = start + (uint64_t)opt.reportSec * 1000000;
+    uint64_t nextStorm = opt.stormEverySec ? start + (uint64_t)opt.stormEverySec * 1000000 : UINT64_MAX;
+
+    std::vector<pollfd> fds;
+    std::vector<VirtualDevice *> owners;
+
+    for (uint64_t now = start; now < end; now = nowMicros())
+    {
+        for (size_t i = 0; i < fleet.size(); i++)
+        {
+            tick(*fleet[i], now);
+        }
+
+        if (now >= nextStorm)
+        {
+            // Everyone loses the server at once, then backs off and comes back
+            size_t dropped = 0;
+            for (size_t i = 0; i < fleet.size(); i++)
+            {
+                if (fleet[i]->ws.state() == WsClient::WS_OPEN)
+                {
+                    onClosed(*fleet[i], now, true);
+                    dropped++;
+                }
+            }
+            printf("[%6.1f s] storm: dropped %zu connections\n", (now - start) / 1e6, dropped);
+            nextStorm += (uint64_t)opt.stormEverySec * 1000000;
+        }
+
+        if (now >= nextReport)
+        {
+            printProgress((now - start) / 1e6, fleet);
+            nextReport += (uint64_t)opt.reportSec * 1000000;
+        }
+
+        fds.clear();
+        owners.clear();
+        for (size_t i = 0; i < fleet.size(); i++)
+        {
+            VirtualDevice &dev = *fleet[i];
+            if (dev.ws.fd() < 0)
+            {
+                continue;
+            }
+            pollfd p = {dev.ws.fd(), (short)(POLLIN | (dev.ws.wantsWrite() ? POLLOUT : 0)), 0};
+            fds.push_back(p);
+            owners.push_back(&dev);
+        }
+
+        if (fds.empty())
+        {
+            struct timespec nap = {0, LOADGEN_POLL_MS * 1000000L};
+            nanosleep(&nap, NULL);
+            continue;
+        }
+        if (poll(fds.data(), fds.size(), LOADGEN_POLL_MS) <= 0)
+        {
+            continue;
+        }
+
+        now = nowMicros();
+        for (size_t i = 0; i < fds.size(); i++)
+        {
+            VirtualDevice &dev = *owners[i];
+            bool wasOpen = dev.ws.state() == WsClient::WS_OPEN;
+
+            bool alive = true;
+            if (fds[i].revents & (POLLOUT | POLLERR | POLLHUP))
+            {
+                alive = dev.ws.onWritable();
+            }
+            if (alive && (fds[i].revents & (POLLIN | POLLHUP)))
+            {
+                alive = dev.ws.onReadable(onFrame, &dev);
+            }
+
+            if (!alive)
+            {
+                onClosed(dev, now, wasOpen);
+            }
+            else if (!wasOpen && dev.ws.state() == WsClient::WS_OPEN)
+            {
+                onOpen(dev, now);
+            }
+        }
+    }
+
+    printSummary((nowMicros() - start) / 1e6);
+    return 0;
+}
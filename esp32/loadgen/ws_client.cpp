@@ -0,0 +1,275 @@
+#include "ws_client.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const char BASE64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// 16 random bytes, base64 encoded (24 characters)
+static std::string randomKey()
+{
+    uint8_t raw[18];
+    for (size_t i = 0; i < sizeof(raw); i++)
+    {
+        raw[i] = (uint8_t)rand();
+    }
+
+    std::string key;
+    for (size_t i = 0; i < 15; i += 3)
+    {
+        uint32_t v = (raw[i] << 16) | (raw[i + 1] << 8) | raw[i + 2];
+        key += BASE64[(v >> 18) & 63];
+        key += BASE64[(v >> 12) & 63];
+        key += BASE64[(v >> 6) & 63];
+        key += BASE64[v & 63];
+    }
+    key += BASE64[raw[15] >> 2];
+    key += BASE64[(raw[15] & 3) << 4];
+    key += "==";
+    return key;
+}
+
+WsClient::WsClient()
+    : sock(-1), current(WS_CLOSED)
+{
+}
+
+WsClient::~WsClient()
+{
+    close();
+}
+
+bool WsClient::connect(const sockaddr_in &server, const char *host, const char *path)
+{
+    close();
+
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0)
+    {
+        return false;
+    }
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+
+    unsigned port = ntohs(server.sin_port);
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+             "GET %s HTTP/1.1\r\n"
+             "Host: %s:%u\r\n"
+             "Upgrade: websocket\r\n"
+             "Connection: Upgrade\r\n"
+             "Sec-WebSocket-Key: %s\r\n"
+             "Sec-WebSocket-Version: 13\r\n"
+             "Origin: http://%s:%u\r\n"
+             "\r\n",
+             path, host, port, randomKey().c_str(), host, port);
+    request = buf;
+    outbox.clear();
+    inbox.clear();
+
+    current = WS_CONNECTING;
+    if (::connect(sock, (const sockaddr *)&server, sizeof(server)) < 0 && errno != EINPROGRESS)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void WsClient::close()
+{
+    if (sock >= 0)
+    {
+        ::close(sock);
+    }
+    sock = -1;
+    current = WS_CLOSED;
+}
+
+bool WsClient::onWritable()
+{
+    if (current == WS_CONNECTING)
+    {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0)
+        {
+            close();
+            return false;
+        }
+        current = WS_UPGRADING;
+        outbox = request + outbox;
+    }
+    return flush();
+}
+
+bool WsClient::flush()
+{
+    while (!outbox.empty())
+    {
+        ssize_t n = send(sock, outbox.data(), outbox.size(), MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return true;
+            }
+            close();
+            return false;
+        }
+        outbox.erase(0, (size_t)n);
+    }
+    return true;
+}
+
+bool WsClient::sendFrame(int opcode, const uint8_t *data, size_t length)
+{
+    if (current != WS_OPEN && opcode != 0x8 && opcode != 0xA)
+    {
+        return false;
+    }
+
+    // Client frames are always masked
+    std::string frame;
+    frame += (char)(0x80 | opcode);
+    if (length < 126)
+    {
+        frame += (char)(0x80 | length);
+    }
+    else if (length < 65536)
+    {
+        frame += (char)(0x80 | 126);
+        frame += (char)(length >> 8);
+        frame += (char)(length & 0xFF);
+    }
+    else
+    {
+        frame += (char)(0x80 | 127);
+        for (int shift = 56; shift >= 0; shift -= 8)
+        {
+            frame += (char)((uint64_t)length >> shift);
+        }
+    }
+
+    uint8_t mask[4];
+    for (int i = 0; i < 4; i++)
+    {
+        mask[i] = (uint8_t)rand();
+        frame += (char)mask[i];
+    }
+    for (size_t i = 0; i < length; i++)
+    {
+        frame += (char)(data[i] ^ mask[i & 3]);
+    }
+
+    outbox += frame;
+    return flush();
+}
+
+bool WsClient::onReadable(FrameHandler handler, void *context)
+{
+    char buf[4096];
+    for (;;)
+    {
+        ssize_t n = recv(sock, buf, sizeof(buf), 0);
+        if (n > 0)
+        {
+            inbox.append(buf, (size_t)n);
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        close(); // EOF or error
+        return false;
+    }
+
+    if (current == WS_UPGRADING && !parseUpgrade())
+    {
+        return current != WS_CLOSED;
+    }
+    return parseFrames(handler, context);
+}
+
+// true once the 101 response has been consumed
+bool WsClient::parseUpgrade()
+{
+    size_t end = inbox.find("\r\n\r\n");
+    if (end == std::string::npos)
+    {
+        return false;
+    }
+
+    if (inbox.compare(0, 12, "HTTP/1.1 101") != 0)
+    {
+        close(); // Rejected, e.g. a bad token
+        return false;
+    }
+
+    inbox.erase(0, end + 4);
+    current = WS_OPEN;
+    return true;
+}
+
+bool WsClient::parseFrames(FrameHandler handler, void *context)
+{
+    while (current == WS_OPEN && inbox.size() >= 2)
+    {
+        const uint8_t *p = (const uint8_t *)inbox.data();
+        int opcode = p[0] & 0x0F;
+        uint64_t length = p[1] & 0x7F;
+        size_t header = 2;
+
+        if (length == 126)
+        {
+            if (inbox.size() < 4)
+            {
+                break;
+            }
+            length = ((uint64_t)p[2] << 8) | p[3];
+            header = 4;
+        }
+        else if (length == 127)
+        {
+            if (inbox.size() < 10)
+            {
+                break;
+            }
+            length = 0;
+            for (int i = 0; i < 8; i++)
+            {
+                length = (length << 8) | p[2 + i];
+            }
+            header = 10;
+        }
+
+        if (inbox.size() < header + length)
+        {
+            break;
+        }
+
+        const uint8_t *payload = p + header;
+        if (opcode == 0x1 || opcode == 0x2)
+        {
+            handler(context, opcode, payload, (size_t)length);
+        }
+        else if (opcode == 0x9)
+        {
+            sendFrame(0xA, payload, (size_t)length); // Pong echoes the ping
+        }
+        else if (opcode == 0x8)
+        {
+            sendFrame(0x8, payload, length >= 2 ? 2 : 0);
+            close();
+            return false;
+        }
+        inbox.erase(0, header + (size_t)length);
+    }
+    return current != WS_CLOSED;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include <netinet/in.h>
+
+/**
+ * Minimal non-blocking RFC 6455 client for the load generator.
+ *
+ * Just enough of the protocol to stand in for one ESP32: the HTTP
+ * upgrade, masked text/binary frames out, unmasked frames in, ping/pong
+ * and close. One instance per virtual device; the caller polls fd() and
+ * calls onReadable()/onWritable(). No TLS, and the server's
+ * Sec-WebSocket-Accept is not verified.
+ */
+class WsClient
+{
+public:
+    enum State
+    {
+        WS_CLOSED,
+        WS_CONNECTING, // TCP connect in progress
+        WS_UPGRADING,  // Request sent, waiting for 101
+        WS_OPEN
+    };
+
+    // Frame callback: opcode is 1 (text) or 2 (binary)
+    typedef void (*FrameHandler)(void *context, int opcode, const uint8_t *data, size_t length);
+
+    WsClient();
+    ~WsClient();
+
+    // Starts a non-blocking connect; false if the socket couldn't be created
+    bool connect(const sockaddr_in &server, const char *host, const char *path);
+    void close();
+
+    State state() const { return current; }
+    int fd() const { return sock; }
+    bool wantsWrite() const { return current == WS_CONNECTING || !outbox.empty(); }
+
+    // Both return false once the connection is gone (state is then WS_CLOSED)
+    bool onWritable();
+    bool onReadable(FrameHandler handler, void *context);
+
+    bool sendText(const char *data, size_t length) { return sendFrame(0x1, (const uint8_t *)data, length); }
+    bool sendBinary(const uint8_t *data, size_t length) { return sendFrame(0x2, data, length); }
+
+private:
+    bool sendFrame(int opcode, const uint8_t *data, size_t length);
+    bool flush();
+    bool parseUpgrade();
+    bool parseFrames(FrameHandler handler, void *context);
+
+    int sock;
+    State current;
+    std::string request; // Upgrade request, sent once the TCP connect completes
+    std::string outbox;  // Bytes the socket didn't take yet
+    std::string inbox;   // Received bytes not yet parsed
+};
@@ -0,0 +1,34 @@
+#include "backoff.h"
+
+Backoff::Backoff(uint32_t initialMs, uint32_t maxMs, uint32_t firstMs)
+    : initial(initialMs), cap(maxMs), first(firstMs)
+{
+    reset();
+}
+
+uint32_t Backoff::next()
+{
+    if (failed == 0 && first != 0)
+    {
+        failed++;
+        return first;
+    }
+
+    uint32_t delay = current;
+    current = current > cap / 2 ? cap : current * 2;
+    failed++;
+    return delay;
+}
+
+uint32_t Backoff::nextJittered(uint32_t entropy)
+{
+    uint32_t delay = next();
+    uint32_t half = delay / 2;
+    return half + entropy % (delay - half + 1);
+}
+
+void Backoff::reset()
+{
+    current = initial;
+    failed = 0;
+}
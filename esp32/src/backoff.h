@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Exponential retry delay: initial, 2x, 4x, ... up to a cap.
+ *
+ * Call next() after each failed attempt to get the wait before the
+ * following one, and reset() once an attempt succeeds. An optional
+ * first delay replaces the initial one for the very first retry, for
+ * a quick second try after a one-off drop.
+ *
+ * nextJittered() spreads each delay over [d/2, d] using caller-supplied
+ * entropy, so devices that lost the same server at the same moment
+ * don't all come back in lockstep.
+ */
+class Backoff
+{
+public:
+    Backoff(uint32_t initialMs, uint32_t maxMs, uint32_t firstMs = 0);
+
+    uint32_t next();
+    uint32_t nextJittered(uint32_t entropy);
+    void reset();
+
+    uint32_t failures() const { return failed; }
+
+private:
+    uint32_t initial;
+    uint32_t cap;
+    uint32_t first;
+    uint32_t current;
+    uint32_t failed;
+};
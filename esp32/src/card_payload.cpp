@@ -0,0 +1,49 @@
+#include "card_payload.h"
+
+uint16_t crcA(const uint8_t *data, size_t length)
+{
+    // Reflected CCITT polynomial, preset 0x6363 (ISO/IEC 14443-3 Annex B)
+    uint16_t crc = 0x6363;
+    for (size_t i = 0; i < length; i++)
+    {
+        uint8_t b = data[i] ^ (uint8_t)crc;
+        b ^= b << 4;
+        crc = (crc >> 8) ^ ((uint16_t)b << 8) ^ ((uint16_t)b << 3) ^ (b >> 4);
+    }
+    return crc;
+}
+
+bool decodeCardId(const uint8_t *data, size_t length, char *out, size_t size)
+{
+    out[0] = '\0';
+    if (size == 0)
+    {
+        return false;
+    }
+
+    // Text ends at the first NUL or erased byte; trailing spaces are padding too
+    size_t end = 0;
+    while (end < length && data[end] != 0x00 && data[end] != 0xFF)
+    {
+        end++;
+    }
+    while (end > 0 && data[end - 1] == ' ')
+    {
+        end--;
+    }
+    if (end == 0 || end >= size)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < end; i++)
+    {
+        if (data[i] < 0x20 || data[i] > 0x7E)
+        {
+            return false;
+        }
+        out[i] = (char)data[i];
+    }
+    out[end] = '\0';
+    return true;
+}
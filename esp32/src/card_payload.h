@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MIFARE_BLOCK_SIZE 16
+#define CARD_ID_MAX_BLOCKS 2
+#define CARD_ID_LEN (CARD_ID_MAX_BLOCKS * MIFARE_BLOCK_SIZE + 1) // Text of up to two blocks plus NUL
+
+// ISO/IEC 14443-3 type A frame CRC, sent low byte first
+uint16_t crcA(const uint8_t *data, size_t length);
+
+/**
+ * Turns the raw data blocks of the ID sector into a printable ID string.
+ *
+ * The ID is ASCII text from the start of the blocks, padded with NUL,
+ * space or 0xFF (an erased block). Returns false, with out set to "",
+ * if there is no text or it contains anything non-printable.
+ */
+bool decodeCardId(const uint8_t *data, size_t length, char *out, size_t size);
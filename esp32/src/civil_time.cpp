@@ -0,0 +1,71 @@
+#include "civil_time.h"
+
+// Floor division, so times before 1970 still land on the right day
+static int64_t floorDiv(int64_t a, int64_t b)
+{
+    return a / b - ((a % b != 0) && ((a < 0) != (b < 0)));
+}
+
+CivilTime civilFromEpoch(int64_t epochSec, int32_t utcOffsetSec)
+{
+    int64_t local = epochSec + utcOffsetSec;
+    int64_t days = floorDiv(local, 86400);
+    int64_t secs = local - days * 86400;
+
+    // Days since 1970-01-01 to y-m-d (H. Hinnant's civil_from_days)
+    int64_t z = days + 719468;
+    int64_t era = floorDiv(z, 146097);
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+
+    CivilTime t;
+    t.day = (uint8_t)(doy - (153 * mp + 2) / 5 + 1);
+    t.month = (uint8_t)(mp < 10 ? mp + 3 : mp - 9);
+    t.year = (int32_t)(yoe + era * 400 + (t.month <= 2));
+    t.hour = (uint8_t)(secs / 3600);
+    t.minute = (uint8_t)(secs / 60 % 60);
+    t.second = (uint8_t)(secs % 60);
+    return t;
+}
+
+static char *putDigits(char *p, uint32_t value, int width)
+{
+    for (int i = width - 1; i >= 0; i--)
+    {
+        p[i] = (char)('0' + value % 10);
+        value /= 10;
+    }
+    return p + width;
+}
+
+bool formatIsoTimestamp(char *buf, size_t size, int64_t epochSec, int32_t utcOffsetSec)
+{
+    if (size < ISO_TIMESTAMP_LEN)
+    {
+        return false;
+    }
+
+    CivilTime t = civilFromEpoch(epochSec, utcOffsetSec);
+    uint32_t offset = (uint32_t)(utcOffsetSec < 0 ? -utcOffsetSec : utcOffsetSec) / 60;
+
+    char *p = buf;
+    p = putDigits(p, (uint32_t)t.year, 4);
+    *p++ = '-';
+    p = putDigits(p, t.month, 2);
+    *p++ = '-';
+    p = putDigits(p, t.day, 2);
+    *p++ = 'T';
+    p = putDigits(p, t.hour, 2);
+    *p++ = ':';
+    p = putDigits(p, t.minute, 2);
+    *p++ = ':';
+    p = putDigits(p, t.second, 2);
+    *p++ = utcOffsetSec < 0 ? '-' : '+';
+    p = putDigits(p, offset / 60, 2);
+    *p++ = ':';
+    p = putDigits(p, offset % 60, 2);
+    *p = '\0';
+    return true;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// "2026-01-11T01:30:00+08:00" + terminator
+#define ISO_TIMESTAMP_LEN 26
+
+// Local calendar time, split from epoch seconds with integer arithmetic only
+struct CivilTime
+{
+    int32_t year;
+    uint8_t month; // 1-12
+    uint8_t day;   // 1-31
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t second;
+};
+
+CivilTime civilFromEpoch(int64_t epochSec, int32_t utcOffsetSec);
+
+// ISO 8601 local time with its UTC offset; false (buf untouched) if size < ISO_TIMESTAMP_LEN
+bool formatIsoTimestamp(char *buf, size_t size, int64_t epochSec, int32_t utcOffsetSec);
@@ -0,0 +1,271 @@
+#pragma once
+
+/**
+ * Build-time configuration.
+ *
+ * Every value here is a default that a platformio.ini env can replace
+ * for one room or one build, e.g.
+ *
+ *   build_flags = ${esp32.build_flags} -DCFG_CLASSROOM_ID=3 '-DCFG_DEVICE_ID="ESP32-ROOM-03"'
+ *
+ * The identity and network settings (CFG_*) can additionally be
+ * overridden at runtime from NVS, see device_config.h.
+ */
+
+// ============== IDENTITY & NETWORK ==============
+#ifndef CFG_WIFI_SSID
+#define CFG_WIFI_SSID "YOUR_WIFI_SSID"
+#endif
+#ifndef CFG_WIFI_PASSWORD
+#define CFG_WIFI_PASSWORD "YOUR_WIFI_PASSWORD"
+#endif
+
+// WebSocket Server Configuration
+#ifndef CFG_WS_HOST
+#define CFG_WS_HOST "192.168.1.18" // Your Django server IP
+#endif
+#ifndef CFG_WS_PORT
+#define CFG_WS_PORT 8000
+#endif
+#ifndef CFG_DEVICE_TOKEN
+#define CFG_DEVICE_TOKEN "YOUR_DEVICE_TOKEN" // From Django admin
+#endif
+#ifndef CFG_CLASSROOM_ID
+#define CFG_CLASSROOM_ID 1 // Your classroom ID
+#endif
+#ifndef CFG_DEVICE_ID
+#define CFG_DEVICE_ID "ESP32-ROOM-01"
+#endif
+
+// NTP Configuration for Philippines Time (UTC+8)
+#ifndef CFG_NTP_SERVER
+#define CFG_NTP_SERVER "pool.ntp.org"
+#endif
+#ifndef CFG_GMT_OFFSET_SEC
+#define CFG_GMT_OFFSET_SEC (8 * 3600) // UTC+8 for Philippines
+#endif
+#ifndef CFG_DAYLIGHT_OFFSET_SEC
+#define CFG_DAYLIGHT_OFFSET_SEC 0 // No daylight saving in Philippines
+#endif
+#ifndef NTP_SYNC_INTERVAL
+#define NTP_SYNC_INTERVAL 3600000 // Re-poll the NTP server hourly (SNTP's minimum is 15 s)
+#endif
+
+// ============== TIMING CONFIGURATION ==============
+#ifndef POWER_SAMPLE_INTERVAL
+#define POWER_SAMPLE_INTERVAL 200  // Sample power at 5 Hz into powerBatch
+#endif
+#ifndef POWER_FLUSH_INTERVAL
+#define POWER_FLUSH_INTERVAL 10000 // Consider sending a batched power frame every 10 seconds
+#endif
+#ifndef RFID_READ_INTERVAL
+#define RFID_READ_INTERVAL 100     // Check each reader every 100ms (polling mode)
+#endif
+#ifndef RFID_USE_IRQ
+#define RFID_USE_IRQ 1             // Detect cards from the RC522 IRQ pin instead of polling (single reader)
+#endif
+#ifndef RFID_IRQ_REARM_INTERVAL
+#define RFID_IRQ_REARM_INTERVAL 25 // IRQ mode: resend REQA this often while the field is empty
+#endif
+#ifndef RFID_PAYLOAD_SECTOR
+#define RFID_PAYLOAD_SECTOR -1     // MIFARE Classic sector holding a student/employee ID; -1 = UID only
+#endif
+#ifndef RFID_PAYLOAD_BLOCKS
+#define RFID_PAYLOAD_BLOCKS 1      // ID blocks from the start of that sector (16 ASCII bytes each, max 2)
+#endif
+#ifndef RFID_PAYLOAD_KEYS
+#define RFID_PAYLOAD_KEYS {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF} // Key A candidates, 6 bytes each
+#endif
+#ifndef LCD_UPDATE_INTERVAL
+#define LCD_UPDATE_INTERVAL 1000   // Update LCD every 1 second
+#endif
+#ifndef HEARTBEAT_INTERVAL
+#define HEARTBEAT_INTERVAL 30000   // Send heartbeat every 30 seconds
+#endif
+#ifndef METRICS_INTERVAL
+#define METRICS_INTERVAL 60000     // Send a metrics report this often
+#endif
+#ifndef UPLINK_COALESCE_WINDOW
+#define UPLINK_COALESCE_WINDOW 2000 // Power, heartbeat, metrics and occupancy wait this long to share one frame
+#endif
+#ifndef RFID_DEBOUNCE_TIME
+#define RFID_DEBOUNCE_TIME 2000    // Ignore repeat taps of the same card for 2 seconds
+#endif
+#ifndef MESSAGE_HOLD_TIME
+#define MESSAGE_HOLD_TIME 2000     // Keep event messages on the LCD for 2 seconds
+#endif
+
+// ============== POWER SENSOR ==============
+#define POWER_SENSOR_ULTRASONIC 0 // HC-SR04 distance mapped to watts (bench simulation)
+#define POWER_SENSOR_PZEM 1       // PZEM-004T v3.0 meter over UART
+#define POWER_SENSOR_CT 2         // CT clamp on the ADC, sampled by I2S/DMA
+#ifndef POWER_SENSOR
+#define POWER_SENSOR POWER_SENSOR_ULTRASONIC
+#endif
+
+#ifndef MAINS_VOLTAGE
+#define MAINS_VOLTAGE 220.0      // Nominal; the CT clamp has no voltage channel
+#endif
+#ifndef MAINS_FREQUENCY
+#define MAINS_FREQUENCY 60       // Hz; RMS windows cover whole cycles
+#endif
+#ifndef CT_AMPS_PER_COUNT
+#define CT_AMPS_PER_COUNT 0.0242 // SCT-013-030 (30 A per volt), 3.3 V over 4095 counts
+#endif
+#ifndef ENERGY_MAX_GAP
+#define ENERGY_MAX_GAP 2000      // Don't integrate across sampling gaps longer than this (ms)
+#endif
+#ifndef ENERGY_SAVE_INTERVAL
+#define ENERGY_SAVE_INTERVAL 300000 // Write the watt-hour counter to NVS this often (at most 5 min lost)
+#endif
+
+// Report by exception: a frame goes out only when the mean moved this much...
+#ifndef POWER_REPORT_DEADBAND
+#define POWER_REPORT_DEADBAND 10.0
+#endif
+// ...or this long after the last one (energy_wh keeps kWh exact either way)
+#ifndef POWER_REPORT_MAX_INTERVAL
+#define POWER_REPORT_MAX_INTERVAL 300000
+#endif
+
+// ============== OCCUPANCY ==============
+#define OCCUPANCY_NONE 0       // No presence sensing; sessions close on the server's timeouts only
+#define OCCUPANCY_ULTRASONIC 1 // HC-SR04 aimed across the room (needs POWER_SENSOR other than ultrasonic)
+#define OCCUPANCY_MOTION 2     // PIR or mmWave presence output on PIR_PIN
+#ifndef OCCUPANCY_SENSOR
+#define OCCUPANCY_SENSOR OCCUPANCY_NONE
+#endif
+#if OCCUPANCY_SENSOR == OCCUPANCY_ULTRASONIC && POWER_SENSOR == POWER_SENSOR_ULTRASONIC
+#error "The HC-SR04 is already the simulated power sensor; pick another POWER_SENSOR"
+#endif
+
+#ifndef OCCUPANCY_SAMPLE_INTERVAL
+#define OCCUPANCY_SAMPLE_INTERVAL 200  // ms between raw readings
+#endif
+#ifndef OCCUPANCY_RANGE_CM
+#define OCCUPANCY_RANGE_CM 250.0       // Ultrasonic: an echo nearer than this is someone
+#endif
+#ifndef OCCUPANCY_MOTION_ACTIVE_HIGH
+#define OCCUPANCY_MOTION_ACTIVE_HIGH 1 // PIR/LD2410 OUT drives high on presence
+#endif
+#ifndef OCCUPANCY_EMA_ALPHA
+#define OCCUPANCY_EMA_ALPHA 0.1        // Smoothing of the median-filtered present/absent samples
+#endif
+#ifndef OCCUPANCY_ENTER_LEVEL
+#define OCCUPANCY_ENTER_LEVEL 0.6      // Smoothed level above this (for ENTER_HOLD) = occupied
+#endif
+#ifndef OCCUPANCY_EXIT_LEVEL
+#define OCCUPANCY_EXIT_LEVEL 0.2       // ... below this (for EXIT_HOLD) = vacant
+#endif
+#ifndef OCCUPANCY_ENTER_HOLD
+#define OCCUPANCY_ENTER_HOLD 3000      // Someone walking past the door doesn't count
+#endif
+#ifndef OCCUPANCY_EXIT_HOLD
+#define OCCUPANCY_EXIT_HOLD 600000     // A still room (exam, film) isn't an empty one; vacant after 10 min
+#endif
+
+// ============== POWER SAVING ==============
+#ifndef POWER_SAVE
+#define POWER_SAVE 1                // Idle mode: RC522 duty cycling, backlight off, deeper modem sleep
+#endif
+#ifndef IDLE_TIMEOUT
+#define IDLE_TIMEOUT 30000          // No taps or LCD messages for this long = idle
+#endif
+#ifndef RFID_IDLE_POLL_INTERVAL
+#define RFID_IDLE_POLL_INTERVAL 250 // Idle: RC522 sits in soft power-down between looks for a card
+#endif
+#ifndef NET_IDLE_POLL_INTERVAL
+#define NET_IDLE_POLL_INTERVAL 50   // Idle: longer netTask wait so the CPU can light-sleep
+#endif
+#ifndef CPU_MAX_FREQ_MHZ
+#define CPU_MAX_FREQ_MHZ 240
+#endif
+#ifndef CPU_MIN_FREQ_MHZ
+#define CPU_MIN_FREQ_MHZ 80         // Lowest frequency when no task needs the CPU
+#endif
+
+// ============== RECONNECT CONFIGURATION ==============
+// Every delay is jittered over [d/2, d] so a fleet doesn't reconnect in lockstep
+#ifndef WS_RECONNECT_FAST
+#define WS_RECONNECT_FAST 1000   // First retry after a drop
+#endif
+#ifndef WS_BACKOFF_MIN
+#define WS_BACKOFF_MIN 2000      // Then 2 s, 4 s, 8 s, ...
+#endif
+#ifndef WS_BACKOFF_MAX
+#define WS_BACKOFF_MAX 60000     // ... up to a minute
+#endif
+#ifndef WS_ATTEMPT_WINDOW
+#define WS_ATTEMPT_WINDOW 8000   // Connect + handshake must finish within this
+#endif
+
+// ============== TRANSPORT SECURITY ==============
+#ifndef WS_TLS
+#define WS_TLS 0                         // 1 = wss:// and HTTPS downloads, verified against SERVER_CA_CERT
+#endif
+#ifndef WS_TLS_HANDSHAKE_BUDGET
+#define WS_TLS_HANDSHAKE_BUDGET 12       // Connection attempts (full TLS handshakes) allowed per window...
+#endif
+#ifndef WS_TLS_BUDGET_WINDOW
+#define WS_TLS_BUDGET_WINDOW 3600000     // ... of this long; further reconnects wait for the oldest to age out
+#endif
+#ifndef WS_TLS_MIN_BLOCK
+#define WS_TLS_MIN_BLOCK 45000           // Largest free block needed to start one (mbedTLS takes ~40 KB)
+#endif
+
+// ============== OFFLINE OUTBOX ==============
+#ifndef OUTBOX_FLASH_SLOTS
+#define OUTBOX_FLASH_SLOTS 512     // Taps kept on flash once the RAM ring is full
+#endif
+#ifndef OUTBOX_DRAIN_BATCH
+#define OUTBOX_DRAIN_BATCH 5       // Queued taps sent per drain pass
+#endif
+#ifndef OUTBOX_DRAIN_INTERVAL
+#define OUTBOX_DRAIN_INTERVAL 1000 // Pause between drain passes so reconnects don't flood the server
+#endif
+
+// ============== TAP DELIVERY ==============
+// Every tap carries a seq; it stays pending until a reply echoes that seq
+#ifndef TAP_ACK_TIMEOUT
+#define TAP_ACK_TIMEOUT 5000       // Resend a tap whose verdict or ack hasn't arrived by then
+#endif
+#ifndef TAP_MAX_ATTEMPTS
+#define TAP_MAX_ATTEMPTS 3         // Sends before the tap goes back to the outbox; error replies before it is dropped
+#endif
+
+// ============== FIRMWARE UPDATES ==============
+#ifndef FIRMWARE_VERSION
+#define FIRMWARE_VERSION "1.0.0"   // Reported in hello; the server targets rollouts by it
+#endif
+#ifndef OTA_TRIAL_BOOTS
+#define OTA_TRIAL_BOOTS 3          // Boots a new image gets to reach the server before it's rolled back
+#endif
+#ifndef OTA_HEALTH_TIMEOUT
+#define OTA_HEALTH_TIMEOUT 300000  // Per trial boot: no server hello within this = restart
+#endif
+
+// ============== HEALTH SUPERVISOR ==============
+#ifndef HEALTH_WDT_TIMEOUT
+#define HEALTH_WDT_TIMEOUT 30            // Task watchdog: a supervised task silent this long (s) = panic reboot
+#endif
+#ifndef HEALTH_CHECK_INTERVAL
+#define HEALTH_CHECK_INTERVAL 10000      // RC522, heap and socket checks this often
+#endif
+#ifndef HEALTH_MAX_RECOVERIES
+#define HEALTH_MAX_RECOVERIES 3          // Soft resets in a row per subsystem before a reboot
+#endif
+#ifndef HEALTH_STABLE_TIME
+#define HEALTH_STABLE_TIME 600000        // Healthy this long after a soft reset = start counting again
+#endif
+#ifndef HEALTH_MIN_FREE_HEAP
+#define HEALTH_MIN_FREE_HEAP 24000       // Below this free heap a check fails
+#endif
+#ifndef HEALTH_MIN_LARGEST_BLOCK
+#define HEALTH_MIN_LARGEST_BLOCK 8192    // ... or with no contiguous block this big (TLS, frame buffers)
+#endif
+#ifndef HEALTH_SILENT_HEARTBEATS
+#define HEALTH_SILENT_HEARTBEATS 3       // Connected but nothing from the server for this many heartbeats = hung
+#endif
+#ifndef HEALTH_REBOOT_GRACE
+#define HEALTH_REBOOT_GRACE 15000        // A health reboot waits at most this long for in-flight taps
+#endif
@@ -0,0 +1,72 @@
+#include "ct_sensor.h"
+
+#include <Arduino.h>
+#include <driver/i2s.h>
+
+#include "log.h"
+
+#define CT_I2S_PORT I2S_NUM_0
+#define CT_DMA_BUFFERS 4
+
+CtClampSensor::CtClampSensor(adc1_channel_t channel, uint16_t mainsHz, float ampsPerCount, float mainsVolts)
+    : channel(channel), samplesPerCycle(CT_SAMPLE_RATE / mainsHz), ampsPerCount(ampsPerCount),
+      mainsVolts(mainsVolts), window(CT_SAMPLE_RATE / mainsHz * CT_WINDOW_CYCLES)
+{
+}
+
+bool CtClampSensor::begin()
+{
+    // One mains cycle per DMA buffer
+    i2s_config_t config = {};
+    config.mode = I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN;
+    config.sample_rate = CT_SAMPLE_RATE;
+    config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+    config.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+    config.communication_format = I2S_COMM_FORMAT_STAND_I2S;
+    config.dma_buf_count = CT_DMA_BUFFERS;
+    config.dma_buf_len = samplesPerCycle;
+
+    adc1_config_width(ADC_WIDTH_BIT_12);
+    adc1_config_channel_atten(channel, ADC_ATTEN_DB_11); // Full 0-3.3 V swing
+
+    if (i2s_driver_install(CT_I2S_PORT, &config, 0, NULL) != ESP_OK ||
+        i2s_set_adc_mode(ADC_UNIT_1, channel) != ESP_OK ||
+        i2s_adc_enable(CT_I2S_PORT) != ESP_OK)
+    {
+        LOG_ERROR("CT clamp: I2S ADC setup failed\n");
+        return false;
+    }
+    return true;
+}
+
+bool CtClampSensor::read(float &watts)
+{
+    uint16_t buffer[256];
+    size_t bytes = 0;
+
+    // Throw away what queued up since the last reading so the window is contiguous
+    do
+    {
+        i2s_read(CT_I2S_PORT, buffer, sizeof(buffer), &bytes, 0);
+    } while (bytes == sizeof(buffer));
+
+    window.reset();
+    for (;;)
+    {
+        // Blocks on the DMA until the next buffer arrives (one cycle, ~17 ms)
+        if (i2s_read(CT_I2S_PORT, buffer, sizeof(buffer), &bytes, pdMS_TO_TICKS(100)) != ESP_OK || bytes == 0)
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < bytes / sizeof(uint16_t); i++)
+        {
+            // Top four bits carry the channel number
+            if (window.add(buffer[i] & 0x0FFF))
+            {
+                watts = window.rms() * ampsPerCount * mainsVolts;
+                return true;
+            }
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <driver/adc.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "power_sensor.h"
+#include "rms_window.h"
+
+// I2S ADC sample rate; 200 samples per cycle at 60 Hz, 240 at 50 Hz
+#define CT_SAMPLE_RATE 12000
+
+// RMS is taken over this many whole mains cycles per reading (~167 ms at 60 Hz)
+#define CT_WINDOW_CYCLES 10
+
+/**
+ * Current-transformer clamp (e.g. SCT-013) on an ADC1 pin, sampled
+ * continuously by the I2S peripheral into DMA buffers.
+ *
+ * The CPU only wakes to fold a finished DMA buffer into the RMS window,
+ * so sampling never busy-waits and stays evenly spaced regardless of
+ * what the other tasks are doing. There is no voltage channel, so the
+ * reading is apparent power at the nominal mains voltage.
+ */
+class CtClampSensor : public PowerSensor
+{
+public:
+    CtClampSensor(adc1_channel_t channel, uint16_t mainsHz, float ampsPerCount, float mainsVolts);
+
+    bool begin() override;
+    bool read(float &watts) override;
+    const char *name() const override { return "CT clamp (I2S ADC)"; }
+
+private:
+    adc1_channel_t channel;
+    size_t samplesPerCycle;
+    float ampsPerCount;
+    float mainsVolts;
+    RmsWindow window;
+};
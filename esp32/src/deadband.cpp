@@ -0,0 +1,28 @@
+#include "deadband.h"
+
+#include <math.h>
+
+DeadbandReporter::DeadbandReporter(float deadband, uint32_t maxIntervalMs)
+    : deadband(deadband), maxInterval(maxIntervalMs), hasReported(false), lastValue(0), lastAt(0)
+{
+}
+
+bool DeadbandReporter::due(float value, unsigned long now) const
+{
+    return !hasReported ||
+           fabsf(value - lastValue) >= deadband ||
+           now - lastAt >= maxInterval;
+}
+
+void DeadbandReporter::reported(float value, unsigned long now)
+{
+    hasReported = true;
+    lastValue = value;
+    lastAt = now;
+}
+
+void DeadbandReporter::configure(float newDeadband, uint32_t newMaxIntervalMs)
+{
+    deadband = newDeadband;
+    maxInterval = newMaxIntervalMs;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Report-by-exception for a slowly changing value.
+ *
+ * due() is true when the value has moved at least deadband away from
+ * the last reported one, when maxIntervalMs has passed since that
+ * report (so the server still sees the device is alive and metering),
+ * or when nothing has been reported yet.
+ */
+class DeadbandReporter
+{
+public:
+    DeadbandReporter(float deadband, uint32_t maxIntervalMs);
+
+    bool due(float value, unsigned long now) const;
+    void reported(float value, unsigned long now);
+
+    // Next due() is true regardless of the value, e.g. after a reconnect
+    void force() { hasReported = false; }
+
+    // Change the thresholds; the last report still counts
+    void configure(float newDeadband, uint32_t newMaxIntervalMs);
+
+private:
+    float deadband;
+    uint32_t maxInterval;
+    bool hasReported;
+    float lastValue;
+    unsigned long lastAt;
+};
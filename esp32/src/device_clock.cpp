@@ -0,0 +1,66 @@
+#include "device_clock.h"
+
+DeviceClock::DeviceClock()
+    : isSynced(false), anchorMono(0), anchorEpoch(0), drift(0), slew(0),
+      sampleMono(0), sampleEpoch(0), lastError(0), syncCount(0), stepCount(0)
+{
+}
+
+int64_t DeviceClock::epochUs(int64_t monoUs) const
+{
+    int64_t elapsed = monoUs - anchorMono;
+    int64_t value = anchorEpoch + elapsed + elapsed * drift / 1000000000;
+
+    // The slew is worked in gradually after the anchor; stamps before it don't get any
+    if (elapsed > 0 && slew != 0)
+    {
+        int64_t limit = elapsed * DEVICE_CLOCK_SLEW_PPM / 1000000;
+        value += slew > 0 ? (slew < limit ? slew : limit) : (-slew < limit ? slew : -limit);
+    }
+    return value;
+}
+
+void DeviceClock::sync(int64_t epochUs, int64_t monoUs)
+{
+    syncCount++;
+    if (!isSynced)
+    {
+        isSynced = true;
+        anchorMono = monoUs;
+        anchorEpoch = epochUs;
+        sampleMono = monoUs;
+        sampleEpoch = epochUs;
+        stepCount++;
+        return;
+    }
+
+    int64_t predicted = this->epochUs(monoUs);
+    lastError = epochUs - predicted;
+
+    // Drift: how much faster the server's clock ran than esp_timer since the last sample
+    int64_t span = monoUs - sampleMono;
+    if (span >= DEVICE_CLOCK_DRIFT_SPAN_US)
+    {
+        int64_t measured = ((epochUs - sampleEpoch) - span) * 1000000000 / span;
+        if (measured > -DEVICE_CLOCK_MAX_DRIFT_PPB && measured < DEVICE_CLOCK_MAX_DRIFT_PPB)
+        {
+            // Smoothed, so one delayed SNTP reply barely moves it
+            drift = syncCount <= 2 ? (int32_t)measured : (int32_t)(drift + (measured - drift) / 4);
+        }
+        sampleMono = monoUs;
+        sampleEpoch = epochUs;
+    }
+
+    anchorMono = monoUs;
+    if (lastError > DEVICE_CLOCK_STEP_US || lastError < -DEVICE_CLOCK_STEP_US)
+    {
+        anchorEpoch = epochUs;
+        slew = 0;
+        stepCount++;
+    }
+    else
+    {
+        anchorEpoch = predicted;
+        slew = lastError;
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+
+// Sync errors beyond this are stepped; smaller ones are slewed out
+#define DEVICE_CLOCK_STEP_US 2000000
+// Slew rate for small errors (the same 500 ppm adjtime() uses)
+#define DEVICE_CLOCK_SLEW_PPM 500
+// Drift is only estimated over at least this much monotonic time
+#define DEVICE_CLOCK_DRIFT_SPAN_US (10LL * 60 * 1000000)
+// Estimates beyond this are a bad sample, not a crystal
+#define DEVICE_CLOCK_MAX_DRIFT_PPB 500000
+
+/**
+ * Wall-clock time disciplined from the monotonic microsecond timer.
+ *
+ * Each sync() is one SNTP result: the server's epoch time observed at a
+ * monotonic stamp. The clock keeps its own model, epoch = anchor +
+ * elapsed + drift, and never reads the system clock, so converting a
+ * stamp is an add and a multiply and a stamp taken before the latest
+ * sync still converts consistently.
+ *
+ * Between syncs the crystal's drift against the server is measured and
+ * corrected. A small error found at a sync is slewed out at
+ * DEVICE_CLOCK_SLEW_PPM, so readings stay continuous and monotonic.
+ * Only an error beyond DEVICE_CLOCK_STEP_US (first sync, server change,
+ * long outage) is stepped.
+ */
+class DeviceClock
+{
+public:
+    DeviceClock();
+
+    // epochUs: server time delivered at monotonic time monoUs (esp_timer_get_time())
+    void sync(int64_t epochUs, int64_t monoUs);
+
+    bool synced() const { return isSynced; }
+
+    int64_t epochUs(int64_t monoUs) const;
+
+    // Epoch milliseconds at monoUs, or 0 before the first sync
+    int64_t epochMs(int64_t monoUs) const { return isSynced ? epochUs(monoUs) / 1000 : 0; }
+
+    int32_t driftPpb() const { return drift; }       // Positive: esp_timer runs slow
+    int64_t lastErrorUs() const { return lastError; } // Server minus model at the latest sync
+    int64_t lastSyncUs() const { return anchorMono; } // Monotonic time of the latest sync
+    uint32_t syncs() const { return syncCount; }
+    uint32_t steps() const { return stepCount; }
+
+private:
+    bool isSynced;
+    int64_t anchorMono;  // Monotonic time of the latest sync
+    int64_t anchorEpoch; // Model's epoch at anchorMono (continuous unless stepped)
+    int32_t drift;       // Parts per billion added to elapsed monotonic time
+    int64_t slew;        // Error still being worked in since anchorMono
+    int64_t sampleMono;  // Raw sync sample the drift is measured from
+    int64_t sampleEpoch;
+    int64_t lastError;
+    uint32_t syncCount;
+    uint32_t stepCount;
+};
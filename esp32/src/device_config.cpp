@@ -0,0 +1,156 @@
+#include "device_config.h"
+
+#include <Preferences.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+
+#define CONFIG_NAMESPACE "config"
+
+// String settings by NVS key (keys are limited to 15 characters)
+struct StringField
+{
+    const char *key;
+    size_t offset;
+    size_t size;
+};
+
+#define STRING_FIELD(key, member) {key, offsetof(DeviceConfig, member), sizeof(DeviceConfig::member)}
+
+static const StringField STRING_FIELDS[] = {
+    STRING_FIELD("ssid", wifiSsid),
+    STRING_FIELD("password", wifiPassword),
+    STRING_FIELD("host", wsHost),
+    STRING_FIELD("token", deviceToken),
+    STRING_FIELD("device_id", deviceId),
+};
+
+static const StringField *findStringField(const char *key)
+{
+    for (const StringField &field : STRING_FIELDS)
+    {
+        if (strcmp(field.key, key) == 0)
+        {
+            return &field;
+        }
+    }
+    return nullptr;
+}
+
+static bool parseNumber(const char *text, long lo, long hi, long &value)
+{
+    char *end;
+    value = strtol(text, &end, 10);
+    return *text != '\0' && *end == '\0' && value >= lo && value <= hi;
+}
+
+int loadDeviceConfig(DeviceConfig &config)
+{
+    snprintf(config.wifiSsid, sizeof(config.wifiSsid), "%s", CFG_WIFI_SSID);
+    snprintf(config.wifiPassword, sizeof(config.wifiPassword), "%s", CFG_WIFI_PASSWORD);
+    snprintf(config.wsHost, sizeof(config.wsHost), "%s", CFG_WS_HOST);
+    config.wsPort = CFG_WS_PORT;
+    snprintf(config.deviceToken, sizeof(config.deviceToken), "%s", CFG_DEVICE_TOKEN);
+    config.classroomId = CFG_CLASSROOM_ID;
+    snprintf(config.deviceId, sizeof(config.deviceId), "%s", CFG_DEVICE_ID);
+
+    Preferences prefs;
+    if (!prefs.begin(CONFIG_NAMESPACE, true))
+    {
+        return 0; // Nothing provisioned yet
+    }
+
+    int overrides = 0;
+    for (const StringField &field : STRING_FIELDS)
+    {
+        char *value = reinterpret_cast<char *>(&config) + field.offset;
+        if (prefs.isKey(field.key) && prefs.getString(field.key, value, field.size) > 0)
+        {
+            overrides++;
+        }
+    }
+    if (prefs.isKey("port"))
+    {
+        config.wsPort = prefs.getUShort("port", config.wsPort);
+        overrides++;
+    }
+    if (prefs.isKey("classroom"))
+    {
+        config.classroomId = prefs.getInt("classroom", config.classroomId);
+        overrides++;
+    }
+
+    prefs.end();
+    return overrides;
+}
+
+bool setDeviceConfigValue(const char *key, const char *value)
+{
+    const StringField *field = findStringField(key);
+    bool isString = field != nullptr;
+    long number = 0;
+
+    if (isString)
+    {
+        if (strlen(value) >= field->size)
+        {
+            return false;
+        }
+    }
+    else if (strcmp(key, "port") == 0)
+    {
+        if (!parseNumber(value, 1, 65535, number))
+        {
+            return false;
+        }
+    }
+    else if (strcmp(key, "classroom") == 0)
+    {
+        if (!parseNumber(value, 1, 0x7fffffffL, number))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    Preferences prefs;
+    if (!prefs.begin(CONFIG_NAMESPACE, false))
+    {
+        return false;
+    }
+
+    bool saved;
+    if (isString)
+    {
+        saved = prefs.putString(key, value) == strlen(value);
+    }
+    else if (strcmp(key, "port") == 0)
+    {
+        saved = prefs.putUShort(key, (uint16_t)number) == sizeof(uint16_t);
+    }
+    else
+    {
+        saved = prefs.putInt(key, (int32_t)number) == sizeof(int32_t);
+    }
+    prefs.end();
+    return saved;
+}
+
+bool clearDeviceConfig()
+{
+    Preferences prefs;
+    if (!prefs.begin(CONFIG_NAMESPACE, false))
+    {
+        return false;
+    }
+
+    bool cleared = prefs.clear();
+    prefs.end();
+    return cleared;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Identity and network settings in use on this device.
+ *
+ * Defaults are compiled in from config.h (so each platformio.ini env
+ * can bake in its own room); anything provisioned into NVS namespace
+ * "config" replaces the default at boot. Provisioning is done once
+ * over the serial console and survives reflashing the app, so one
+ * firmware image can serve every room.
+ */
+struct DeviceConfig
+{
+    char wifiSsid[33];     // 802.11 limit is 32 bytes
+    char wifiPassword[65]; // WPA2 passphrase is at most 64
+    char wsHost[64];
+    uint16_t wsPort;
+    char deviceToken[48];
+    int32_t classroomId;
+    char deviceId[32];
+};
+
+// Fill config with the build defaults, then apply any NVS overrides.
+// Returns the number of values that came from NVS.
+int loadDeviceConfig(DeviceConfig &config);
+
+// Store one override; key is one of ssid, password, host, port, token,
+// classroom, device_id. Returns false for unknown keys, values that
+// don't fit or NVS write failures. Takes effect on the next boot.
+bool setDeviceConfigValue(const char *key, const char *value);
+
+// Drop every override so the build defaults apply again
+bool clearDeviceConfig();
@@ -0,0 +1,19 @@
+#include "energy_meter.h"
+
+EnergyMeter::EnergyMeter(uint32_t maxGapMs)
+    : maxGap(maxGapMs), hasLast(false), lastWatts(0), lastAt(0), total(0)
+{
+}
+
+void EnergyMeter::add(float watts, unsigned long now)
+{
+    unsigned long elapsed = now - lastAt;
+    if (hasLast && elapsed <= maxGap)
+    {
+        total += (lastWatts + watts) / 2.0 * elapsed / 3600000.0;
+    }
+
+    hasLast = true;
+    lastWatts = watts;
+    lastAt = now;
+}
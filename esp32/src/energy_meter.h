@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Watt-hours integrated from successive power samples (trapezoid rule).
+ *
+ * A gap longer than maxGapMs between samples (sensor offline, task
+ * stalled) is not bridged: the integration restarts at the next sample
+ * instead of assuming the load stayed constant across the gap.
+ */
+class EnergyMeter
+{
+public:
+    explicit EnergyMeter(uint32_t maxGapMs);
+
+    void add(float watts, unsigned long now);
+
+    double wattHours() const { return total; }
+
+    // Continue from a total saved before a reboot
+    void restore(double wattHours) { total = wattHours; }
+
+private:
+    uint32_t maxGap;
+    bool hasLast;
+    float lastWatts;
+    unsigned long lastAt;
+    double total;
+};
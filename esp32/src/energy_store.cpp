@@ -0,0 +1,36 @@
+#include "energy_store.h"
+
+#include <Preferences.h>
+
+#define ENERGY_NAMESPACE "energy"
+#define ENERGY_KEY "wh"
+
+bool loadEnergyWh(double &wattHours)
+{
+    Preferences prefs;
+    if (!prefs.begin(ENERGY_NAMESPACE, true))
+    {
+        return false;
+    }
+
+    bool found = prefs.isKey(ENERGY_KEY);
+    if (found)
+    {
+        wattHours = prefs.getDouble(ENERGY_KEY, 0);
+    }
+    prefs.end();
+    return found;
+}
+
+bool saveEnergyWh(double wattHours)
+{
+    Preferences prefs;
+    if (!prefs.begin(ENERGY_NAMESPACE, false))
+    {
+        return false;
+    }
+
+    bool saved = prefs.putDouble(ENERGY_KEY, wattHours) == sizeof(double);
+    prefs.end();
+    return saved;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// Keep the device's lifetime watt-hour counter in NVS across reboots
+bool loadEnergyWh(double &wattHours);
+bool saveEnergyWh(double wattHours);
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 32-bit FNV-1a. The backend implements the same function, so hashes can
+// be compared across the wire.
+#define FNV1A32_OFFSET 2166136261u
+#define FNV1A32_PRIME 16777619u
+
+constexpr uint32_t fnv1a32(const char *s, uint32_t h = FNV1A32_OFFSET)
+{
+    return *s ? fnv1a32(s + 1, (h ^ (uint8_t)*s) * FNV1A32_PRIME) : h;
+}
@@ -0,0 +1,34 @@
+#include "handshake_budget.h"
+
+HandshakeBudget::HandshakeBudget(uint8_t limit, uint32_t windowMs)
+    : limit(limit > HANDSHAKE_BUDGET_MAX ? HANDSHAKE_BUDGET_MAX : (limit == 0 ? 1 : limit)),
+      used(0), next(0), window(windowMs), total(0)
+{
+}
+
+bool HandshakeBudget::allowed(uint32_t nowMs) const
+{
+    return waitMs(nowMs) == 0;
+}
+
+void HandshakeBudget::spend(uint32_t nowMs)
+{
+    started[next] = nowMs;
+    next = (next + 1) % limit;
+    if (used < limit)
+    {
+        used++;
+    }
+    total++;
+}
+
+uint32_t HandshakeBudget::waitMs(uint32_t nowMs) const
+{
+    if (used < limit)
+    {
+        return 0;
+    }
+    // Full ring: next is the oldest start
+    uint32_t age = nowMs - started[next];
+    return age >= window ? 0 : window - age;
+}
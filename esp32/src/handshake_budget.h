@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+#define HANDSHAKE_BUDGET_MAX 16
+
+/**
+ * Caps how many full connection handshakes may start per time window.
+ *
+ * A TLS handshake costs the ESP32 seconds of CPU and a large block of
+ * heap, and a flapping link or a restarting server can make a device
+ * pay that every few seconds. The budget remembers when the last
+ * `limit` handshakes started: a new one is allowed only once the oldest
+ * of them has left the window. Times are millis(); the caller supplies
+ * them, as with the reconnect scheduler.
+ */
+class HandshakeBudget
+{
+public:
+    HandshakeBudget(uint8_t limit, uint32_t windowMs);
+
+    bool allowed(uint32_t nowMs) const;
+    void spend(uint32_t nowMs);
+
+    // ms until allowed() turns true, 0 if it already is
+    uint32_t waitMs(uint32_t nowMs) const;
+
+    uint32_t spent() const { return total; }
+
+private:
+    uint32_t started[HANDSHAKE_BUDGET_MAX]; // Ring of start times, oldest at next
+    uint8_t limit;
+    uint8_t used;
+    uint8_t next;
+    uint32_t window;
+    uint32_t total;
+};
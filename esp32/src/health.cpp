@@ -0,0 +1,36 @@
+#include "health.h"
+
+HealthLadder::HealthLadder(uint8_t maxRecoveries, uint32_t stableMs)
+    : limit(maxRecoveries), stable(stableMs), rung(0), lastRecovery(0), lifetime(0)
+{
+}
+
+HealthAction HealthLadder::report(bool healthy, uint32_t nowMs)
+{
+    if (healthy)
+    {
+        if (rung > 0 && nowMs - lastRecovery >= stable)
+        {
+            rung = 0;
+        }
+        return HEALTH_OK;
+    }
+
+    if (rung >= limit)
+    {
+        return HEALTH_REBOOT;
+    }
+    rung++;
+    lifetime++;
+    lastRecovery = nowMs;
+    return HEALTH_RECOVER;
+}
+
+uint8_t heapFragmentation(uint32_t freeBytes, uint32_t largestBlock)
+{
+    if (freeBytes == 0 || largestBlock >= freeBytes)
+    {
+        return 0;
+    }
+    return (uint8_t)(100 - (uint64_t)largestBlock * 100 / freeBytes);
+}
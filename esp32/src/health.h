@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+enum HealthAction
+{
+    HEALTH_OK,      // Check passed, or still inside a recovery's grace
+    HEALTH_RECOVER, // Soft-reset the subsystem (re-init, reconnect)
+    HEALTH_REBOOT   // Soft resets haven't helped; restart the device
+};
+
+/**
+ * Escalation for one supervised subsystem.
+ *
+ * Each failed check asks for a soft recovery, up to maxRecoveries in a
+ * row; the failure after that asks for a reboot. Checks that keep
+ * passing for stableMs after the last recovery reset the ladder, so a
+ * reader that glitches once a week is re-inited every time rather
+ * than eventually rebooting the device.
+ */
+class HealthLadder
+{
+public:
+    HealthLadder(uint8_t maxRecoveries, uint32_t stableMs);
+
+    HealthAction report(bool healthy, uint32_t nowMs);
+
+    uint8_t attempts() const { return rung; }        // Recoveries since the ladder last reset
+    uint32_t recoveries() const { return lifetime; } // Since boot
+
+private:
+    uint8_t limit;
+    uint32_t stable;
+    uint8_t rung;
+    uint32_t lastRecovery;
+    uint32_t lifetime;
+};
+
+// Share of the free heap that is not in its largest block, 0-100
+uint8_t heapFragmentation(uint32_t freeBytes, uint32_t largestBlock);
@@ -0,0 +1,123 @@
+#include "inbound.h"
+
+#include <string.h>
+
+InboundDispatcher::InboundDispatcher(const InboundRoute *routes, size_t count, ArduinoJson::Allocator *allocator,
+                                     InboundHandler reply)
+    : routes(routes), count(count), allocator(allocator), reply(reply)
+{
+    event[0] = '\0';
+}
+
+bool InboundDispatcher::begin()
+{
+    if (count > INBOUND_MAX_ROUTES)
+    {
+        return false;
+    }
+
+    eventFilter["event"] = true;
+    if (reply)
+    {
+        eventFilter["status"] = true;
+        eventFilter["seq"] = true;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        if (deserializeJson(filters[i], routes[i].filter))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+const InboundRoute *InboundDispatcher::find(uint32_t hash, const char *name) const
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        // The name check only runs on a hash match, so it is one strcmp per frame
+        if (routes[i].hash == hash && strcmp(routes[i].event, name) == 0)
+        {
+            return &routes[i];
+        }
+    }
+    return nullptr;
+}
+
+InboundResult InboundDispatcher::dispatch(WireEncoding encoding, const uint8_t *payload, size_t length)
+{
+    const InboundRoute *route;
+    event[0] = '\0';
+    {
+        JsonDocument head(allocator);
+        if (decodeMessage(head, encoding, payload, length, eventFilter))
+        {
+            return INBOUND_BAD_FRAME;
+        }
+
+        const char *name = head["event"];
+        if (!name)
+        {
+            if (reply)
+            {
+                reply(head);
+            }
+            return INBOUND_NO_EVENT;
+        }
+
+        strncpy(event, name, sizeof(event) - 1);
+        event[sizeof(event) - 1] = '\0';
+        route = find(eventHash(event), event);
+    }
+
+    if (!route)
+    {
+        return INBOUND_UNKNOWN;
+    }
+
+    const JsonDocument &filter = filters[route - routes];
+    JsonDocument doc(allocator);
+    if (filter.size() > 0 && decodeMessage(doc, encoding, payload, length, filter))
+    {
+        return INBOUND_BAD_FRAME;
+    }
+
+    route->handle(doc);
+    return INBOUND_DISPATCHED;
+}
+
+InboundQueue::InboundQueue()
+    : head(0), count(0)
+{
+}
+
+bool InboundQueue::push(WireEncoding encoding, const uint8_t *payload, size_t length)
+{
+    if (count == INBOUND_QUEUE_SLOTS || length > INBOUND_FRAME_MAX)
+    {
+        return false;
+    }
+
+    Slot &slot = slots[(head + count) % INBOUND_QUEUE_SLOTS];
+    slot.encoding = encoding;
+    slot.length = length;
+    memcpy(slot.data, payload, length);
+    count++;
+    return true;
+}
+
+void InboundQueue::clear()
+{
+    head = 0;
+    count = 0;
+}
+
+void InboundQueue::pop()
+{
+    if (count > 0)
+    {
+        head = (head + 1) % INBOUND_QUEUE_SLOTS;
+        count--;
+    }
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ArduinoJson.h>
+
+#include "wire_protocol.h"
+
+#define INBOUND_MAX_ROUTES 16
+#define INBOUND_EVENT_MAX 32 // Longest event name a route can match
+
+#define INBOUND_QUEUE_SLOTS 4
+#define INBOUND_FRAME_MAX 1024 // Larger frames are dispatched in place
+
+// 32-bit FNV-1a; constexpr so route keys are computed at compile time
+constexpr uint32_t eventHash(const char *name, uint32_t hash = 2166136261u)
+{
+    return *name ? eventHash(name + 1, (hash ^ (uint8_t)*name) * 16777619u) : hash;
+}
+
+typedef void (*InboundHandler)(JsonDocument &doc);
+
+struct InboundRoute
+{
+    uint32_t hash;      // eventHash(event)
+    const char *event;
+    const char *filter; // JSON filter of the fields handle() reads, "{}" for none
+    InboundHandler handle;
+};
+
+#define INBOUND_ROUTE(event, filter, handler) {eventHash(event), event, filter, handler}
+
+enum InboundResult
+{
+    INBOUND_DISPATCHED,
+    INBOUND_NO_EVENT, // Plain status reply, passed to the reply handler if there is one
+    INBOUND_UNKNOWN,  // Event nobody routes; ignored
+    INBOUND_BAD_FRAME // Didn't parse, or didn't fit the allocator
+};
+
+/**
+ * Routes server frames to handlers by their "event" field.
+ *
+ * A frame is parsed twice with DeserializationOption::Filter: once
+ * keeping only "event", then, once the route is known, keeping only the
+ * fields that route's handler reads. Documents come from the allocator
+ * given at construction (a JsonArena), so parse cost and memory depend
+ * on what handlers use, not on how large or numerous server messages
+ * get. Filters are built once by begin().
+ *
+ * Frames without an event (status acks) go to the optional reply
+ * handler with only "status" and "seq" kept.
+ */
+class InboundDispatcher
+{
+public:
+    InboundDispatcher(const InboundRoute *routes, size_t count, ArduinoJson::Allocator *allocator,
+                      InboundHandler reply = nullptr);
+
+    // Parses every route's filter; false if one is malformed or there are too many routes
+    bool begin();
+
+    InboundResult dispatch(WireEncoding encoding, const uint8_t *payload, size_t length);
+
+    // Event name of the last INBOUND_UNKNOWN or filtered-parse INBOUND_BAD_FRAME result, for logging
+    // (empty when the frame didn't parse far enough to have one)
+    const char *lastEvent() const { return event; }
+
+private:
+    const InboundRoute *find(uint32_t hash, const char *name) const;
+
+    const InboundRoute *routes;
+    size_t count;
+    ArduinoJson::Allocator *allocator;
+    InboundHandler reply;
+    JsonDocument eventFilter;
+    JsonDocument filters[INBOUND_MAX_ROUTES];
+    char event[INBOUND_EVENT_MAX];
+};
+
+/**
+ * Frames copied out of the WebSocket callback so they are handled after
+ * webSocket.loop() returns, where handlers can send freely and their
+ * time is measured on its own. Owned by one task; no locking.
+ */
+class InboundQueue
+{
+public:
+    InboundQueue();
+
+    // False when full or the frame is larger than a slot
+    bool push(WireEncoding encoding, const uint8_t *payload, size_t length);
+
+    bool empty() const { return count == 0; }
+    void clear();
+
+    // Oldest frame; only valid while !empty() and until pop()
+    WireEncoding frontEncoding() const { return slots[head].encoding; }
+    const uint8_t *frontData() const { return slots[head].data; }
+    size_t frontLength() const { return slots[head].length; }
+    void pop();
+
+private:
+    struct Slot
+    {
+        WireEncoding encoding;
+        size_t length;
+        uint8_t data[INBOUND_FRAME_MAX];
+    };
+
+    Slot slots[INBOUND_QUEUE_SLOTS];
+    size_t head;
+    size_t count;
+};
@@ -0,0 +1,95 @@
+#include "json_arena.h"
+
+#include <string.h>
+
+JsonArena::JsonArena(uint8_t *buffer, size_t size)
+    : buffer(buffer), capacity(size), top(0), live(0), peak(0), failed(0)
+{
+}
+
+bool JsonArena::isLast(const Header *h) const
+{
+    return (const uint8_t *)h + sizeof(Header) + align(h->size) == buffer + top;
+}
+
+void *JsonArena::allocate(size_t size)
+{
+    size_t need = sizeof(Header) + align(size);
+    if (top + need > capacity)
+    {
+        failed++;
+        return nullptr; // ArduinoJson reports this as doc.overflowed()
+    }
+
+    Header *h = (Header *)(buffer + top);
+    h->size = size;
+    top += need;
+    live++;
+    if (top > peak)
+    {
+        peak = top;
+    }
+    return h + 1;
+}
+
+void JsonArena::deallocate(void *ptr)
+{
+    if (!ptr)
+    {
+        return;
+    }
+
+    Header *h = (Header *)ptr - 1;
+    if (isLast(h))
+    {
+        top = (uint8_t *)h - buffer;
+    }
+
+    if (--live == 0)
+    {
+        top = 0;
+    }
+}
+
+void *JsonArena::reallocate(void *ptr, size_t newSize)
+{
+    if (!ptr)
+    {
+        return allocate(newSize);
+    }
+
+    Header *h = (Header *)ptr - 1;
+
+    // The block on top of the arena can grow or shrink in place
+    if (isLast(h))
+    {
+        size_t start = (uint8_t *)ptr - buffer;
+        if (start + align(newSize) > capacity)
+        {
+            failed++;
+            return nullptr;
+        }
+        h->size = newSize;
+        top = start + align(newSize);
+        if (top > peak)
+        {
+            peak = top;
+        }
+        return ptr;
+    }
+
+    if (newSize <= h->size)
+    {
+        h->size = newSize; // Shrinking elsewhere just leaves slack
+        return ptr;
+    }
+
+    void *moved = allocate(newSize);
+    if (!moved)
+    {
+        return nullptr;
+    }
+    memcpy(moved, ptr, h->size);
+    deallocate(ptr);
+    return moved;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ArduinoJson.h>
+
+/**
+ * ArduinoJson allocator that carves documents out of a fixed buffer.
+ *
+ * ArduinoJson 7 documents allocate their pools from the heap by default,
+ * which over weeks of uptime fragments it. Documents built with this
+ * allocator never touch the heap: blocks are bumped off the buffer and
+ * the whole arena rewinds once every block has been released, which for
+ * short-lived message documents happens at the end of each message.
+ *
+ * Not thread-safe; give each task that builds documents its own arena.
+ */
+class JsonArena : public ArduinoJson::Allocator
+{
+public:
+    JsonArena(uint8_t *buffer, size_t size);
+
+    void *allocate(size_t size) override;
+    void deallocate(void *ptr) override;
+    void *reallocate(void *ptr, size_t newSize) override;
+
+    size_t used() const { return top; }
+    size_t highWater() const { return peak; }
+    uint32_t failures() const { return failed; }
+
+private:
+    struct Header
+    {
+        size_t size;
+    };
+
+    static size_t align(size_t n) { return (n + sizeof(void *) - 1) & ~(sizeof(void *) - 1); }
+    bool isLast(const Header *h) const;
+
+    uint8_t *buffer;
+    size_t capacity;
+    size_t top;
+    size_t live; // Blocks not yet released; the arena rewinds when this hits 0
+    size_t peak;
+    uint32_t failed;
+};
+
+// Declares a JsonArena named `name` backed by a static buffer of `size` bytes
+#define JSON_ARENA(name, size)                    \
+    alignas(8) static uint8_t name##Buffer[size]; \
+    JsonArena name(name##Buffer, sizeof(name##Buffer))
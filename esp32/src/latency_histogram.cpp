@@ -0,0 +1,93 @@
+#include "latency_histogram.h"
+
+#include <string.h>
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::record(uint32_t micros)
+{
+    size_t bucket = bucketOf(micros);
+    if (counts[bucket] != UINT16_MAX)
+    {
+        counts[bucket]++;
+    }
+
+    if (total == 0 || micros < lowest)
+        lowest = micros;
+    if (micros > highest)
+        highest = micros;
+    total++;
+}
+
+void LatencyHistogram::reset()
+{
+    memset(counts, 0, sizeof(counts));
+    total = 0;
+    lowest = 0;
+    highest = 0;
+}
+
+uint32_t LatencyHistogram::percentile(uint8_t percent) const
+{
+    // Buckets saturate, so walk their own sum rather than total
+    uint32_t sum = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        sum += counts[i];
+    }
+    if (sum == 0)
+    {
+        return 0;
+    }
+
+    uint32_t rank = (sum * percent + 99) / 100; // ceil, so p50 of 1 sample is that sample
+    if (rank == 0)
+        rank = 1;
+
+    uint32_t seen = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        seen += counts[i];
+        if (seen >= rank)
+        {
+            uint32_t upper = bucketUpper(i);
+            if (upper > highest)
+                upper = highest;
+            if (upper < lowest)
+                upper = lowest;
+            return upper;
+        }
+    }
+    return highest;
+}
+
+// 0..7 map to themselves; above that the top three bits pick the bucket
+size_t LatencyHistogram::bucketOf(uint32_t micros)
+{
+    if (micros < LATENCY_LINEAR_LIMIT)
+    {
+        return micros;
+    }
+
+    int msb = 31 - __builtin_clz(micros); // >= 3
+    size_t sub = (micros >> (msb - 2)) & (LATENCY_SUB_BUCKETS - 1);
+    return LATENCY_LINEAR_LIMIT + (msb - 3) * LATENCY_SUB_BUCKETS + sub;
+}
+
+uint32_t LatencyHistogram::bucketUpper(size_t bucket)
+{
+    if (bucket < LATENCY_LINEAR_LIMIT)
+    {
+        return bucket;
+    }
+
+    size_t octave = (bucket - LATENCY_LINEAR_LIMIT) / LATENCY_SUB_BUCKETS;
+    size_t sub = (bucket - LATENCY_LINEAR_LIMIT) % LATENCY_SUB_BUCKETS;
+    int shift = octave + 1; // msb - 2
+    uint64_t lower = (uint64_t)(LATENCY_SUB_BUCKETS + sub) << shift;
+    uint64_t upper = lower + ((uint64_t)1 << shift) - 1;
+    return upper > UINT32_MAX ? UINT32_MAX : (uint32_t)upper;
+}
@@ -0,0 +1,80 @@
+#include "lcd_frame.h"
+
+#include <string.h>
+
+// Unchanged cells worth rewriting to avoid another cursor move
+#define LCD_FRAME_MERGE_GAP 1
+
+LcdFrame::LcdFrame()
+{
+    clear();
+    invalidate();
+}
+
+void LcdFrame::clear()
+{
+    memset(next, ' ', sizeof(next));
+}
+
+void LcdFrame::print(uint8_t col, uint8_t row, const char *text)
+{
+    if (row >= ROWS)
+    {
+        return;
+    }
+    for (; col < COLUMNS && *text; col++, text++)
+    {
+        next[row][col] = *text;
+    }
+}
+
+void LcdFrame::printCentered(uint8_t row, const char *text)
+{
+    size_t len = strnlen(text, COLUMNS);
+    print((COLUMNS - len) / 2, row, text);
+}
+
+void LcdFrame::invalidate()
+{
+    shownValid = false;
+}
+
+size_t LcdFrame::flush(LcdSink &sink)
+{
+    size_t written = 0;
+
+    for (uint8_t row = 0; row < ROWS; row++)
+    {
+        uint8_t col = 0;
+        while (col < COLUMNS)
+        {
+            if (shownValid && next[row][col] == shown[row][col])
+            {
+                col++;
+                continue;
+            }
+
+            // Extend the run while cells differ, bridging short unchanged gaps
+            uint8_t end = col + 1;
+            uint8_t last = col;
+            while (end < COLUMNS && end - last <= LCD_FRAME_MERGE_GAP + 1)
+            {
+                if (!shownValid || next[row][end] != shown[row][end])
+                {
+                    last = end;
+                }
+                end++;
+            }
+
+            size_t length = last - col + 1;
+            sink.setCursor(col, row);
+            sink.write(&next[row][col], length);
+            written += length;
+            col = last + 1;
+        }
+    }
+
+    memcpy(shown, next, sizeof(shown));
+    shownValid = true;
+    return written;
+}
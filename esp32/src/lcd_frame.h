@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Where LcdFrame sends its output: the I2C LCD on the device, or a
+ * recorder in host builds.
+ */
+class LcdSink
+{
+public:
+    virtual ~LcdSink() {}
+
+    virtual void setCursor(uint8_t col, uint8_t row) = 0;
+    virtual void write(const char *text, size_t length) = 0;
+};
+
+/**
+ * Shadow framebuffer for the 16x2 character LCD.
+ *
+ * Callers compose the next screen with clear()/print()/printCentered()
+ * and flush() sends only the cells that differ from what is already on
+ * the glass. Over I2C every command or character costs several bus
+ * transactions, so a clock tick that changes one digit costs one cursor
+ * move and one character instead of lcd.clear() plus 32 characters.
+ */
+class LcdFrame
+{
+public:
+    static const uint8_t COLUMNS = 16;
+    static const uint8_t ROWS = 2;
+
+    LcdFrame();
+
+    // Blank the next frame (does not touch the display until flush)
+    void clear();
+    void print(uint8_t col, uint8_t row, const char *text);
+    void printCentered(uint8_t row, const char *text);
+
+    // Writes the changed cells; returns how many characters were sent
+    size_t flush(LcdSink &sink);
+
+    // Forget what is on screen so the next flush redraws everything
+    void invalidate();
+
+private:
+    char next[ROWS][COLUMNS];
+    char shown[ROWS][COLUMNS];
+    bool shownValid;
+};
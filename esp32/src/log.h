@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * Compile-time log levels.
+ *
+ * Messages above LOG_LEVEL compile to nothing: the format string and
+ * arguments are still type-checked but the call and its string are
+ * dropped by the optimiser, so a release build pays no UART time on
+ * hot paths. Set LOG_LEVEL from build_flags (see env:release).
+ */
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4 // Every frame sent and received, every tap
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#define LOG_DISCARD(...)                 \
+    do                                   \
+    {                                    \
+        if (0)                           \
+        {                                \
+            Serial.printf(__VA_ARGS__);  \
+        }                                \
+    } while (0)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) Serial.printf(__VA_ARGS__)
+#else
+#define LOG_ERROR(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) Serial.printf(__VA_ARGS__)
+#else
+#define LOG_WARN(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) Serial.printf(__VA_ARGS__)
+#else
+#define LOG_INFO(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) Serial.printf(__VA_ARGS__)
+#else
+#define LOG_DEBUG(...) LOG_DISCARD(__VA_ARGS__)
+#endif
@@ -1,4 +1,5 @@
 #include <Wire.h>
+#include <sys/time.h>
 #include <time.h>
 
 /**
@@ -11,12 +12,13 @@
  * - HC-SR04 Ultrasonic Sensor (temporary for power simulation)
  *
  * Wiring:
- * RFID RC522:
- *   - SDA  -> GPIO 5
+ * RFID RC522 (each extra reader shares SCK/MOSI/MISO/RST, own SDA):
+ *   - SDA  -> GPIO 5 (second reader: GPIO 4)
  *   - SCK  -> GPIO 18
  *   - MOSI -> GPIO 23
  *   - MISO -> GPIO 19
  *   - RST  -> GPIO 27
+ *   - IRQ  -> GPIO 26 (only used when RFID_USE_IRQ is 1)
  *   - 3.3V -> 3.3V
  *   - GND  -> GND
  *
@@ -26,11 +28,24 @@
  *   - VCC -> 5V
  *   - GND -> GND
  *
- * Ultrasonic HC-SR04:
+ * Power sensor (one of, see POWER_SENSOR):
+ * Ultrasonic HC-SR04 (simulation):
  *   - TRIG -> GPIO 32
  *   - ECHO -> GPIO 33
  *   - VCC  -> 5V
  *   - GND  -> GND
+ * PZEM-004T v3.0 (UART2):
+ *   - TX   -> GPIO 16
+ *   - RX   -> GPIO 17
+ *   - 5V   -> 5V
+ *   - GND  -> GND
+ * CT clamp (SCT-013, biased to mid-rail):
+ *   - OUT  -> GPIO 34 (ADC1 channel 6)
+ *
+ * Occupancy sensor (optional, see OCCUPANCY_SENSOR):
+ * HC-SR04 across the room: same pins as the power simulation above
+ * PIR / mmWave (e.g. HC-SR501, LD2410 OUT):
+ *   - OUT  -> GPIO 35
  */
 
 #include <Arduino.h>
@@ -40,602 +55,2520 @@
 #include <SPI.h>
 #include <MFRC522.h>
 #include <LiquidCrystal_I2C.h>
+#include <LittleFS.h>
+#include <driver/gpio.h>
+#include <esp_pm.h>
+#include <esp_sntp.h>
+#include <esp_sleep.h>
+#include <esp_system.h>
+#include <esp_task_wdt.h>
+#include <esp_wifi.h>
+
+#include "civil_time.h"
+#include "config.h"
+#include "ct_sensor.h"
+#include "deadband.h"
+#include "device_clock.h"
+#include "device_config.h"
+#include "energy_meter.h"
+#include "energy_store.h"
+#include "handshake_budget.h"
+#include "health.h"
+#include "inbound.h"
+#include "json_arena.h"
+#include "latency_histogram.h"
+#include "lcd_frame.h"
+#include "log.h"
+#include "messages.h"
+#include "mifare_reader.h"
+#include "occupancy.h"
+#include "occupancy_sensor.h"
+#include "ota_update.h"
+#include "outbox.h"
+#include "outbox_store.h"
+#include "pending_taps.h"
+#include "power_batch.h"
+#include "pzem_sensor.h"
+#include "reconnect.h"
+#include "ring_log.h"
+#include "rfid_debounce.h"
+#include "sequence_store.h"
+#include "server_ca.h"
+#include "tuning.h"
+#include "tuning_store.h"
+#include "uid_cache.h"
+#include "ultrasonic_sensor.h"
+#include "uid_cache_store.h"
+#include "uplink.h"
+#include "wifi_link.h"
+#include "wire_protocol.h"
 
 // ============== CONFIGURATION ==============
-// WiFi Configuration
-const char *WIFI_SSID = "2.4GHz-Band";
-const char *WIFI_PASSWORD = "#2.4GHz-Band_21";
-
-// WebSocket Server Configuration
-const char *WS_HOST = "192.168.1.18"; // Your Django server IP
-const uint16_t WS_PORT = 8000;
-const char *DEVICE_TOKEN = "ESP32-H3WV263437R"; // From Django admin
-const int CLASSROOM_ID = 1;                     // Your classroom ID
-
-// Device Configuration
-const char *DEVICE_ID = "ESP32-ROOM-01";
-
-// NTP Configuration for Philippines Time (UTC+8)
-const char *NTP_SERVER = "pool.ntp.org";
-const long GMT_OFFSET_SEC = 8 * 3600; // UTC+8 for Philippines
-const int DAYLIGHT_OFFSET_SEC = 0;    // No daylight saving in Philippines
+// Defaults come from config.h (overridable per platformio.ini env);
+// deviceConfig holds the values in use after NVS overrides are applied
+constexpr const char *NTP_SERVER = CFG_NTP_SERVER;
+constexpr long GMT_OFFSET_SEC = CFG_GMT_OFFSET_SEC;
+constexpr int DAYLIGHT_OFFSET_SEC = CFG_DAYLIGHT_OFFSET_SEC;
 
 // ============== PIN DEFINITIONS ==============
-// RFID RC522 Pins
+// RFID RC522 Pins (per-reader SS pins are in RFID_READERS)
 #define RFID_SS_PIN 5
-#define RFID_RST_PIN 27
+#define RFID_RST_PIN 27 // Shared by all readers
+#define RFID_IRQ_PIN 26
 
 // Ultrasonic Sensor Pins
 #define ULTRASONIC_TRIG 32
 #define ULTRASONIC_ECHO 33
 
+// PZEM-004T UART2 Pins
+#define PZEM_RX_PIN 16
+#define PZEM_TX_PIN 17
+
+// PIR / mmWave presence output (input-only pin)
+#define PIR_PIN 35
+
+// CT clamp ADC input (must be ADC1; ADC2 is unusable while Wi-Fi is on)
+#define CT_ADC_CHANNEL ADC1_CHANNEL_6 // GPIO 34
+
 // I2C LCD Address (usually 0x27 or 0x3F)
 #define LCD_ADDRESS 0x27
 #define LCD_COLUMNS 16
 #define LCD_ROWS 2
 
-// ============== TIMING CONFIGURATION ==============
-#define POWER_READ_INTERVAL 60000 // Send power reading every 60 seconds
-#define RFID_READ_INTERVAL 100    // Check RFID every 100ms
-#define LCD_UPDATE_INTERVAL 1000  // Update LCD every 1 second
-#define RECONNECT_INTERVAL 5000   // Reconnect attempt every 5 seconds
-#define HEARTBEAT_INTERVAL 30000  // Send heartbeat every 30 seconds
+// ============== RFID READERS ==============
+// One row per RC522 on the shared SPI bus; the door name is sent with every tap
+struct RfidReaderConfig
+{
+    uint8_t ssPin;
+    const char *door;
+};
+
+#define RFID_READER_COUNT 1
+const RfidReaderConfig RFID_READERS[RFID_READER_COUNT] = {
+    {RFID_SS_PIN, "main"},
+    // {4, "rear"}, // Second door: raise RFID_READER_COUNT and set RFID_USE_IRQ to 0
+};
+
+// ============== WIRE PROTOCOL ==============
+#define WIRE_OFFER_MSGPACK 1   // Offer binary MessagePack frames in the hello message
+#define WIRE_BUFFER_SIZE 1536  // Largest outbound frame: a full metrics report in JSON (~1.2 KB worst case)
+#define NET_ARENA_SIZE 4096    // JSON document memory for messages built on netTask
+#define UPLINK_BUFFER_SIZE 3072 // Coalesced low-priority messages: a metrics report plus a power batch and more
+#define IN_ARENA_SIZE 2048     // JSON document memory for filtered inbound frames (an allowlist part of 16 entries fits)
+
+// ============== TASK CONFIGURATION ==============
+#define NET_TASK_CORE 0 // Network runs next to the Wi-Fi stack
+#define APP_TASK_CORE 1 // RFID, sensor and LCD work
+#define NET_TASK_PRIORITY 3
+#define RFID_TASK_PRIORITY 3
+#define SENSOR_TASK_PRIORITY 1
+#define LCD_TASK_PRIORITY 1
+#define OCCUPANCY_TASK_PRIORITY 1
+#define NET_TASK_STACK 8192
+#define RFID_TASK_STACK 4096
+#define SENSOR_TASK_STACK 4096
+#define LCD_TASK_STACK 4096
+#define OCCUPANCY_TASK_STACK 3072
+#define RFID_QUEUE_LENGTH 8
+#define DISPLAY_QUEUE_LENGTH 4
+#define NET_POLL_INTERVAL 5 // Max ms the network task waits on the RFID queue per pass
 
 // ============== GLOBAL OBJECTS ==============
+DeviceConfig deviceConfig; // Loaded first thing in setup(); read-only afterwards
+
+// Server-tunable intervals; written only by netTask (config_update), other
+// tasks just read single aligned words
+Tuning tuning;
+
+// Built once at boot from deviceConfig
+char wsPath[128];
+char extraHeaders[160]; // Origin for Channels and the device token, kept out of the URL
+
+WifiLink wifiLink(deviceConfig.wifiSsid, deviceConfig.wifiPassword); // Driven from netTask once tasks are running
 WebSocketsClient webSocket;
-MFRC522 rfid(RFID_SS_PIN, RFID_RST_PIN);
+ReconnectScheduler wsReconnect(WS_ATTEMPT_WINDOW, WS_RECONNECT_FAST, WS_BACKOFF_MIN, WS_BACKOFF_MAX); // netTask only
+static_assert(WS_TLS_HANDSHAKE_BUDGET <= HANDSHAKE_BUDGET_MAX, "WS_TLS_HANDSHAKE_BUDGET is too large");
+HandshakeBudget handshakeBudget(WS_TLS_HANDSHAKE_BUDGET, WS_TLS_BUDGET_WINDOW); // netTask only, spent per attempt
+
+// What the latest connection cost; netTask only
+unsigned long connectStartedAt = 0; // millis() when the current attempt began
+uint32_t connectHeapBefore = 0;     // Free heap at that moment
+uint32_t lastConnectMs = 0;         // Attempt start to WStype_CONNECTED: TCP, TLS and the upgrade
+uint32_t maxConnectMs = 0;
+int32_t connectHeapCost = 0;        // Free heap lost across the connect, i.e. what the session holds
+uint32_t deferredConnects = 0;      // Times an attempt was held back by the budget or the heap
+bool serverCaPresent = true;        // WS_TLS builds with no CA pasted in never try
+MFRC522 rfidReaders[RFID_READER_COUNT]; // Pins assigned from RFID_READERS in setupRFID()
+MFRC522 &rfid = rfidReaders[0];          // The one reader IRQ mode drives
 LiquidCrystal_I2C lcd(LCD_ADDRESS, LCD_COLUMNS, LCD_ROWS);
+#if RFID_PAYLOAD_SECTOR >= 0
+const uint8_t RFID_PAYLOAD_KEY_BYTES[] = RFID_PAYLOAD_KEYS;
+static_assert(sizeof(RFID_PAYLOAD_KEY_BYTES) % MIFARE_KEY_SIZE == 0, "RFID_PAYLOAD_KEYS must be whole 6-byte keys");
+static_assert(RFID_PAYLOAD_SECTOR < 32 && RFID_PAYLOAD_BLOCKS >= 1 && RFID_PAYLOAD_BLOCKS <= CARD_ID_MAX_BLOCKS,
+              "RFID_PAYLOAD_SECTOR must be 0-31 and RFID_PAYLOAD_BLOCKS 1-2");
+MifareSectorReader cardPayload(RFID_PAYLOAD_SECTOR, RFID_PAYLOAD_BLOCKS, RFID_PAYLOAD_KEY_BYTES,
+                               sizeof(RFID_PAYLOAD_KEY_BYTES) / MIFARE_KEY_SIZE); // rfidTask only
+#endif
+
+// Feeds LcdFrame's changed cells to the I2C display
+struct I2cLcdSink : LcdSink
+{
+    void setCursor(uint8_t col, uint8_t row) override { lcd.setCursor(col, row); }
+    void write(const char *text, size_t length) override { lcd.write((const uint8_t *)text, length); }
+};
+
+static_assert(LCD_COLUMNS == LcdFrame::COLUMNS && LCD_ROWS == LcdFrame::ROWS, "LcdFrame size must match the LCD");
+LcdFrame lcdFrame; // Only drawn from lcdTask once tasks are running
+I2cLcdSink lcdSink;
+UidDebouncer rfidDebouncer(RFID_DEBOUNCE_TIME);
+UidCache uidCache;                  // Local allowlist, guarded by uidCacheMutex
+SemaphoreHandle_t uidCacheMutex = NULL;
+bool uidCacheDirty = false;         // netTask: synced changes not yet saved to flash
+#if POWER_SENSOR == POWER_SENSOR_PZEM
+PzemPowerSensor pzemSensor(Serial2, PZEM_RX_PIN, PZEM_TX_PIN);
+PowerSensor &powerSensor = pzemSensor;
+#elif POWER_SENSOR == POWER_SENSOR_CT
+CtClampSensor ctSensor(CT_ADC_CHANNEL, MAINS_FREQUENCY, CT_AMPS_PER_COUNT, MAINS_VOLTAGE);
+PowerSensor &powerSensor = ctSensor;
+#else
+UltrasonicPowerSensor ultrasonicSensor(ULTRASONIC_TRIG, ULTRASONIC_ECHO);
+PowerSensor &powerSensor = ultrasonicSensor;
+#endif
+#if OCCUPANCY_SENSOR == OCCUPANCY_ULTRASONIC
+UltrasonicOccupancySensor ultrasonicPresence(ULTRASONIC_TRIG, ULTRASONIC_ECHO, OCCUPANCY_RANGE_CM);
+OccupancySensor &occupancySensor = ultrasonicPresence;
+#elif OCCUPANCY_SENSOR == OCCUPANCY_MOTION
+MotionOccupancySensor motionPresence(PIR_PIN, OCCUPANCY_MOTION_ACTIVE_HIGH);
+OccupancySensor &occupancySensor = motionPresence;
+#endif
+// v3: entries carry the card ID. A v2 record is the same layout without it
+// (cardId was appended after the 8-byte aligned deviceMs), so v2 files are imported at boot
+#define OUTBOX_V2_RECORD_SIZE offsetof(OutboxEntry, cardId)
+LittleFsOutboxStore outboxStore("/outbox3.dat", "/outbox3.idx", "/outbox3.tmp", OUTBOX_FLASH_SLOTS);
+Outbox outbox(&outboxStore); // Only touched by netTask once tasks are running
+PendingTaps pendingTaps(TAP_ACK_TIMEOUT, TAP_MAX_ATTEMPTS); // Sent, not yet answered; netTask only
+SequenceStore tapSequence; // rfidTask only once tasks are running
+
+// ============== INTER-TASK QUEUES ==============
+struct LcdMessage
+{
+    char line1[LCD_COLUMNS + 1];
+    char line2[LCD_COLUMNS + 1];
+};
+
+// A tap plus when its card was read, for the tap-to-send metric
+struct TapEvent
+{
+    OutboxEntry entry;
+    int64_t detectedAt; // esp_timer_get_time()
+};
+
+QueueHandle_t rfidQueue = NULL;    // rfidTask -> netTask (TapEvent per tap)
+QueueHandle_t displayQueue = NULL; // any task -> lcdTask
+TaskHandle_t lcdTaskHandle = NULL;
+TaskHandle_t rfidTaskHandle = NULL; // Notified by the RC522 IRQ handler
 
 // ============== STATE VARIABLES ==============
-bool wsConnected = false;
-bool timeSync = false; // Track if time is synced with NTP
-unsigned long lastPowerRead = 0;
-unsigned long lastRfidRead = 0;
-unsigned long lastLcdUpdate = 0;
-unsigned long lastReconnect = 0;
-unsigned long lastHeartbeat = 0;
-
-String lastRfidUid = "";
-float currentPower = 0.0;
-String currentTeacher = "";
-String statusMessage = "Ready";
+volatile bool wsConnected = false;
+DeviceClock deviceClock; // Synced from the SNTP callback, read by every task; guarded by stateLock
+unsigned long lcdHoldUntil = 0; // lcdTask leaves event messages alone until then
+unsigned long nextOutboxDrain = 0;
+
+// Negotiated per connection; only used from netTask
+WireEncoding wireEncoding = WIRE_JSON;
+uint8_t wireBuffer[WIRE_BUFFER_SIZE];
+uint8_t uplinkBuffer[UPLINK_BUFFER_SIZE];
+UplinkBundle uplink(uplinkBuffer, sizeof(uplinkBuffer)); // Power, heartbeat, metrics and occupancy waiting to share a frame
+bool uplinkAnswered = false;          // Something in uplink gets a server ack, so it can stand in for the heartbeat
+unsigned long lastAnsweredSend = 0;   // millis() of the last frame the server acks (tap, power, heartbeat, bundle)
+uint32_t uplinkFrames = 0;            // Lifetime frames sent from uplink...
+uint32_t uplinkMessages = 0;          // ...and the messages they carried
+JSON_ARENA(netArena, NET_ARENA_SIZE); // Outbound documents never touch the heap
+JSON_ARENA(inArena, IN_ARENA_SIZE);   // Inbound documents, parsed through per-event filters
+InboundQueue inboundFrames;           // Filled by webSocketEvent, drained by netTask after webSocket.loop()
+
+volatile float currentPower = 0.0;
+char currentTeacher[LCD_COLUMNS + 1] = ""; // Guarded by stateLock
+portMUX_TYPE stateLock = portMUX_INITIALIZER_UNLOCKED;
+PowerBatch powerBatch; // sensorTask -> netTask, guarded by powerLock
+EnergyMeter energyMeter(ENERGY_MAX_GAP); // Written by sensorTask, guarded by powerLock
+uint32_t bootId = 0;      // Random per boot: tells the server the counter was restored, not reset
+double bootEnergyWh = 0;  // Counter as restored from NVS; the server counts this boot's energy from it
+DeadbandReporter powerReporter(POWER_REPORT_DEADBAND, POWER_REPORT_MAX_INTERVAL); // netTask only
+portMUX_TYPE powerLock = portMUX_INITIALIZER_UNLOCKED;
+const char *statusMessage = "Ready";
+
+// occupancyTask -> netTask, guarded by stateLock; netTask sends when the change count moves
+bool roomOccupied = false;
+uint32_t occupancySince = 0; // millis() when the current state's condition started
+uint32_t occupancyChanges = 0;
+volatile unsigned long lastActivity = 0; // millis() of the last tap or LCD message
+
+// ============== METRICS ==============
+// Durations in microseconds from esp_timer_get_time(), reported and reset every tuning.metricsMs
+enum MetricStage
+{
+    STAGE_NET_LOOP,   // One netTask pass, not counting the wait on rfidQueue
+    STAGE_READ_RFID,  // SPI select and UID read of a detected card (payload included)
+    STAGE_SEND_RFID,  // Building, encoding and sending a tap
+    STAGE_WS_LOOP,    // webSocket.loop(), frames are only copied out there
+    STAGE_UPDATE_LCD, // Status screen compose and I2C flush
+    STAGE_READ_POWER, // One ultrasonic power sample
+    STAGE_SERVER_RTT, // Live tap first sent until the verdict echoing its seq arrives (retries included)
+    STAGE_TAP_TO_SEND, // Card read until its frame is handed to the socket (queueing and logging included)
+    STAGE_DISPATCH,   // Parsing one server frame and running its handler
+    STAGE_READ_PAYLOAD, // Authenticating and reading the ID sector (RFID_PAYLOAD_SECTOR builds)
+    STAGE_COUNT
+};
+
+const char *const STAGE_NAMES[STAGE_COUNT] = {
+    "net_loop", "read_rfid", "send_rfid", "ws_loop", "update_lcd", "read_power", "server_rtt", "tap_to_send", "dispatch", "read_payload"};
+
+LatencyHistogram stageTimes[STAGE_COUNT]; // Guarded by metricsLock
+portMUX_TYPE metricsLock = portMUX_INITIALIZER_UNLOCKED;
+
+// ============== EVENT LOG ==============
+// Binary ring of recent events, kept at every LOG_LEVEL; "log" on the serial console prints it
+enum LogEvent : uint16_t
+{
+    EVENT_BOOT,
+    EVENT_WIFI_UP,      // value: fast joins so far
+    EVENT_WIFI_DOWN,
+    EVENT_WS_UP,
+    EVENT_WS_DOWN,
+    EVENT_TAP,          // value: reader index
+    EVENT_TAP_SENT,     // value: tap-to-send in microseconds
+    EVENT_TAP_OFFLINE,  // value: outbox size after the push
+    EVENT_TAP_DROPPED,  // RFID queue or outbox full
+    EVENT_SEND_TOO_BIG, // value: encoded length limit
+    EVENT_TAP_RETRY,    // value: seq of the unanswered tap
+    EVENT_OTA,          // value: new OtaState
+    EVENT_HEALTH,       // value: HealthCause of a soft reset
+    EVENT_TAP_REJECTED, // value: seq of a tap dropped after TAP_MAX_ATTEMPTS error replies
+    EVENT_COUNT
+};
+
+const char *const EVENT_NAMES[EVENT_COUNT] = {
+    "boot", "wifi_up", "wifi_down", "ws_up", "ws_down",
+    "tap", "tap_sent", "tap_offline", "tap_dropped", "send_too_big", "tap_retry", "ota", "health",
+    "tap_rejected"};
+
+RingLog eventLog; // Guarded by eventLogLock
+portMUX_TYPE eventLogLock = portMUX_INITIALIZER_UNLOCKED;
+
+// ============== HEALTH SUPERVISOR ==============
+// What a supervisor check found wrong; soft-reset first, reboot once that stops helping
+enum HealthCause : uint8_t
+{
+    CAUSE_NONE,
+    CAUSE_RFID,   // RC522 not answering or lost its configuration
+    CAUSE_SOCKET, // Connected, but the server went silent
+    CAUSE_HEAP,   // Free heap or largest block under the floor
+    CAUSE_COUNT
+};
+
+const char *const CAUSE_NAMES[CAUSE_COUNT] = {"none", "rfid", "socket", "heap"};
+
+#define HEALTH_MARK_MAGIC 0x484C5400 // 'HLT' + cause in the low byte
+
+RTC_NOINIT_ATTR uint32_t healthRebootMark;      // Survives the restart so the next boot knows why
+HealthCause bootCause = CAUSE_NONE;             // Read from healthRebootMark in setupHealth()
+volatile HealthCause rebootRequest = CAUSE_NONE; // Set by any task, carried out by netTask
+HealthLadder rfidHealth(HEALTH_MAX_RECOVERIES, HEALTH_STABLE_TIME);   // rfidTask only
+HealthLadder socketHealth(HEALTH_MAX_RECOVERIES, HEALTH_STABLE_TIME); // netTask only
+HealthLadder heapHealth(HEALTH_MAX_RECOVERIES, HEALTH_STABLE_TIME);   // netTask only
+uint8_t rfidVersion[RFID_READER_COUNT]; // VersionReg seen at boot; 0 = reader never answered
+unsigned long lastServerFrame = 0;      // netTask: millis() of the last frame, ping or pong from the server
 
 // ============== FUNCTION DECLARATIONS ==============
+void setupConfig();
+void setupTuning();
+void applyConfigUpdate(JsonDocument &doc);
+void sendConfigApplied(int rejected);
+void pollSerialConsole();
+void logEvent(LogEvent event, int32_t value = 0);
+void printEventLog();
 void setupWiFi();
 void setupWebSocket();
+bool connectAffordable(unsigned long now);
+void noteConnectAttempt(unsigned long now);
 void setupRFID();
 void setupLCD();
-void setupUltrasonic();
+void setupPowerSensor();
 void setupNTP();
-bool isTimeSynced();
+void handleWifiEvent(WifiEvent event);
+void setupTasks();
+void setupPowerSave();
+bool isIdle();
+void noteActivity();
+
+void netTask(void *param);
+void rfidTask(void *param);
+void sensorTask(void *param);
+void lcdTask(void *param);
+void occupancyTask(void *param);
+void setupOccupancy();
+void pollOccupancy(bool force);
 
 void webSocketEvent(WStype_t type, uint8_t *payload, size_t length);
-void sendRfidData(String rfidUid);
+void setupInbound();
+void dispatchFrame(WireEncoding encoding, const uint8_t *payload, size_t length);
+void drainInbound();
+bool sendMessage(const JsonDocument &doc, const char *label);
+bool sendFrame(WireEncoding encoding, const uint8_t *frame, size_t length, const char *label);
+bool queueUplink(const JsonDocument &doc, const char *label, bool answered);
+void flushUplink();
+void sendHello();
+void sendAllowlistSync();
+void setupUidCache();
+bool lookupTeacher(const char *uid, char *name, size_t size);
+void applyAllowlistBucket(JsonDocument &doc);
+bool sendRfidData(const OutboxEntry &tap, bool queued = false);
+void drainOutbox();
+void retryPendingTaps(unsigned long now);
+void requeuePendingTaps();
 void sendPowerData(float watts);
+bool sendPowerBatch(const PowerBatch &batch, double energyWh);
 void sendHeartbeat();
-
-String readRFID();
-float readUltrasonicPower();
+void sendMetrics();
+void pollOta(unsigned long now);
+void sendOtaStatus();
+void setupHealth();
+void superviseTask();
+void superviseRfid(unsigned long now);
+void superviseNet(unsigned long now);
+void requestReboot(HealthCause cause);
+void restartDevice(const char *reason);
+void recordStage(MetricStage stage, int64_t startedAt);
+
+bool readRFID(MFRC522 &reader, OutboxEntry &tap);
+bool readCardSerial(MFRC522 &reader, OutboxEntry &tap);
+const char *doorName(uint8_t reader);
+bool waitForCard();
+void rfidArmReceive();
+void IRAM_ATTR rfidIrqHandler();
 void updateLCD();
-void displayMessage(String line1, String line2 = "");
-String formatTime();
+void displayMessage(const char *line1, const char *line2 = "");
+void renderMessage(const char *line1, const char *line2);
+void formatTime(char *buf, size_t size);
+int64_t epochMsAt(int64_t monoUs);
+bool getISOTimestamp(char *buf, size_t size, int64_t epochMs);
 
 // ============== SETUP ==============
 void setup()
 {
     Serial.begin(115200);
-    Serial.println("\n\n=== IoT Attendance & Energy Monitor ===");
-    Serial.println("Initializing...");
+    LOG_INFO("\n\n=== IoT Attendance & Energy Monitor ===\n");
+    LOG_INFO("Initializing...\n");
+
+    logEvent(EVENT_BOOT);
+    otaBootCheck(); // Before anything that could crash a bad image again
+    setupHealth();
+    setupConfig();
+    setupTuning();
 
     // Initialize components
     setupLCD();
     displayMessage("Initializing...", "Please wait");
 
-    setupWiFi();
-    setupNTP(); // Sync time with NTP after WiFi is connected
+    setupWiFi(); // Returns at once; netTask finishes the join in the background
+    setupNTP();  // SNTP keeps retrying on its own until the network is up
     setupRFID();
-    setupUltrasonic();
+    setupPowerSensor();
+    setupOccupancy();
+    setupPowerSave();
+    outboxStore.begin();
+    LittleFS.remove("/outbox.dat"); // Pre-seq layout, unreadable now
+    LittleFS.remove("/outbox.idx");
+    outboxStore.import("/outbox2.dat", "/outbox2.idx", OUTBOX_V2_RECORD_SIZE);
+    tapSequence.begin();
+    setupUidCache();
+    setupInbound();
     setupWebSocket();
 
     displayMessage("System Ready", "Scan RFID Card");
-    Serial.println("Setup complete!");
+    setupTasks();
+    LOG_INFO("Setup complete!\n");
 }
 
 // ============== MAIN LOOP ==============
 void loop()
 {
-    // Handle WebSocket communication
-    webSocket.loop();
+    // All work runs in the tasks started by setupTasks()
+    vTaskDelete(NULL);
+}
 
-    unsigned long currentMillis = millis();
+// ============== TASKS ==============
+void setupTasks()
+{
+    rfidQueue = xQueueCreate(RFID_QUEUE_LENGTH, sizeof(TapEvent));
+    displayQueue = xQueueCreate(DISPLAY_QUEUE_LENGTH, sizeof(LcdMessage));
+
+    xTaskCreatePinnedToCore(netTask, "net", NET_TASK_STACK, NULL, NET_TASK_PRIORITY, NULL, NET_TASK_CORE);
+    xTaskCreatePinnedToCore(rfidTask, "rfid", RFID_TASK_STACK, NULL, RFID_TASK_PRIORITY, &rfidTaskHandle, APP_TASK_CORE);
+    xTaskCreatePinnedToCore(sensorTask, "sensor", SENSOR_TASK_STACK, NULL, SENSOR_TASK_PRIORITY, NULL, APP_TASK_CORE);
+    xTaskCreatePinnedToCore(lcdTask, "lcd", LCD_TASK_STACK, NULL, LCD_TASK_PRIORITY, &lcdTaskHandle, APP_TASK_CORE);
+#if OCCUPANCY_SENSOR != OCCUPANCY_NONE
+    xTaskCreatePinnedToCore(occupancyTask, "occupancy", OCCUPANCY_TASK_STACK, NULL, OCCUPANCY_TASK_PRIORITY, NULL, APP_TASK_CORE);
+#endif
+}
 
-    // Check RFID
-    if (currentMillis - lastRfidRead >= RFID_READ_INTERVAL)
+// Owns the WebSocket: every webSocket.* call happens on this task
+void netTask(void *param)
+{
+    unsigned long lastMetrics = 0;
+    uint32_t heartbeatConnects = 0; // wsReconnect connects already reported in a heartbeat
+    unsigned long lastPowerFlush = 0;
+    unsigned long lastEnergySave = 0;
+    double savedEnergyWh = energyMeter.wattHours();
+    superviseTask();
+
+    for (;;)
     {
-        lastRfidRead = currentMillis;
-        String rfidUid = readRFID();
+        esp_task_wdt_reset();
 
-        if (rfidUid.length() > 0 && rfidUid != lastRfidUid)
+        // Wait briefly for a tap so it is sent as soon as it is queued
+        bool tapSent = false;
+        TapEvent event;
+        TickType_t pollWait = pdMS_TO_TICKS(isIdle() ? NET_IDLE_POLL_INTERVAL : NET_POLL_INTERVAL);
+        while (xQueueReceive(rfidQueue, &event, pollWait) == pdTRUE)
         {
-            lastRfidUid = rfidUid;
-            Serial.println("RFID Detected: " + rfidUid);
-
-            displayMessage("Card Detected!", rfidUid);
+            const OutboxEntry &tap = event.entry;
+            char name[UID_CACHE_NAME_LEN];
+            bool known = lookupTeacher(tap.rfidUid, name, sizeof(name));
+
+            // Only send what can be tracked until answered; the rest waits in the outbox
+            int64_t sendStart = esp_timer_get_time();
+            bool sent = wsConnected && !pendingTaps.full() && sendRfidData(tap);
+            if (sent)
+            {
+                recordStage(STAGE_SEND_RFID, sendStart);
+                recordStage(STAGE_TAP_TO_SEND, event.detectedAt);
+                logEvent(EVENT_TAP_SENT, (int32_t)(esp_timer_get_time() - event.detectedAt));
+                pendingTaps.track(tap, true, millis(), sendStart);
+                tapSent = true;
+
+                // Known cards already got "Welcome!" from rfidTask; the server reply confirms it
+                if (!known)
+                {
+                    displayMessage("Card Sent!", tap.rfidUid);
+                }
+                continue;
+            }
 
-            if (wsConnected)
+            // Keep the tap for later instead of losing it
+            if (outbox.push(tap))
             {
-                sendRfidData(rfidUid);
+                logEvent(EVENT_TAP_OFFLINE, (int32_t)outbox.size());
+                displayMessage(wsConnected ? "Tap Queued" : "Saved Offline", known ? name : tap.rfidUid);
             }
             else
             {
-                displayMessage("No Connection!", "Card: " + rfidUid);
+                logEvent(EVENT_TAP_DROPPED);
+                displayMessage("Outbox Full!", tap.rfidUid);
             }
-
-            delay(2000);      // Prevent multiple reads
-            lastRfidUid = ""; // Reset for next card
         }
-    }
 
-    // Send power reading periodically
-    if (currentMillis - lastPowerRead >= POWER_READ_INTERVAL)
-    {
-        lastPowerRead = currentMillis;
-        currentPower = readUltrasonicPower();
+        int64_t passStart = esp_timer_get_time();
+        pollSerialConsole();
+        handleWifiEvent(wifiLink.poll(millis()));
 
-        Serial.print("Power Reading: ");
-        Serial.print(currentPower);
-        Serial.println(" W");
+#if POWER_SAVE
+        // Idle: wake for every third DTIM beacon instead of every one
+        static bool wifiIdle = false;
+        if (isIdle() != wifiIdle)
+        {
+            wifiIdle = !wifiIdle;
+            esp_wifi_set_ps(wifiIdle ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM);
+        }
+#endif
 
-        if (wsConnected)
+        // The scheduler is the only thing that lets the client (re)connect
+        unsigned long pollNow = millis();
+        uint32_t attempts = wsReconnect.counters().attempts;
+        bool canAttempt = wifiLink.connected() && (wsReconnect.isConnected() || connectAffordable(pollNow));
+        switch (wsReconnect.poll(pollNow, canAttempt, esp_random()))
         {
-            sendPowerData(currentPower);
+        case RECONNECT_POLL:
+            if (wsReconnect.counters().attempts != attempts)
+            {
+                noteConnectAttempt(pollNow);
+            }
+            webSocket.loop();
+            recordStage(STAGE_WS_LOOP, passStart);
+            drainInbound();
+            break;
+
+        case RECONNECT_ABORT:
+            LOG_WARN("WebSocket attempt timed out, next in %u ms\n", (unsigned)wsReconnect.counters().lastDelay);
+            webSocket.disconnect();
+            break;
+
+        case RECONNECT_IDLE:
+            break;
         }
-    }
 
-    // Update LCD display
-    if (currentMillis - lastLcdUpdate >= LCD_UPDATE_INTERVAL)
-    {
-        lastLcdUpdate = currentMillis;
-        updateLCD();
-    }
+        unsigned long currentMillis = millis();
 
-    // Send heartbeat
-    if (wsConnected && currentMillis - lastHeartbeat >= HEARTBEAT_INTERVAL)
-    {
-        lastHeartbeat = currentMillis;
-        sendHeartbeat();
-    }
+        // Report each SNTP result; the callback itself runs on the lwIP task
+        static uint32_t loggedSyncs = 0;
+        portENTER_CRITICAL(&stateLock);
+        uint32_t syncs = deviceClock.syncs();
+        int64_t syncError = deviceClock.lastErrorUs();
+        int32_t drift = deviceClock.driftPpb();
+        portEXIT_CRITICAL(&stateLock);
+        if (syncs != loggedSyncs)
+        {
+            loggedSyncs = syncs;
+            LOG_INFO("NTP sync %u: off by %ld ms, drift %.1f ppm\n", (unsigned)syncs,
+                     (long)(syncError / 1000), drift / 1000.0f);
+        }
 
-    // Attempt reconnection if disconnected
-    if (!wsConnected && currentMillis - lastReconnect >= RECONNECT_INTERVAL)
-    {
-        lastReconnect = currentMillis;
-        Serial.println("Attempting to reconnect WebSocket...");
-        webSocket.disconnect();
-        setupWebSocket();
-    }
-}
+        // Resend taps the server hasn't answered in time
+        if (wsConnected)
+        {
+            retryPendingTaps(currentMillis);
+        }
 
-// ============== WIFI SETUP ==============
-void setupWiFi()
-{
-    Serial.print("Connecting to WiFi: ");
-    Serial.println(WIFI_SSID);
+        // Deliver taps recorded while offline, a few at a time
+        if (wsConnected && !outbox.empty() && (long)(currentMillis - nextOutboxDrain) >= 0)
+        {
+            nextOutboxDrain = currentMillis + OUTBOX_DRAIN_INTERVAL;
+            drainOutbox();
+        }
+
+        // Flush the samples collected by sensorTask as one frame
+        if (wsConnected && currentMillis - lastPowerFlush >= tuning.powerFlushMs)
+        {
+            lastPowerFlush = currentMillis;
+
+            // Copy out under the lock; serialize and send without holding it
+            PowerBatch batch;
+            portENTER_CRITICAL(&powerLock);
+            batch = powerBatch;
+            powerBatch.clear();
+            double energyWh = energyMeter.wattHours();
+            portEXIT_CRITICAL(&powerLock);
+
+            // Windows without a real change are skipped; their energy is still in energy_wh
+            float mean = batch.empty() ? 0 : batch.stats().mean;
+            if (!batch.empty() && powerReporter.due(mean, currentMillis))
+            {
+                if (sendPowerBatch(batch, energyWh))
+                {
+                    powerReporter.reported(mean, currentMillis);
+                }
+                else
+                {
+                    LOG_WARN("Power batch send failed, samples dropped\n");
+                }
+            }
+        }
 
-    displayMessage("Connecting WiFi", WIFI_SSID);
+        // Persist the energy counter, but only touch flash when it moved
+        if (currentMillis - lastEnergySave >= ENERGY_SAVE_INTERVAL)
+        {
+            lastEnergySave = currentMillis;
 
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+            portENTER_CRITICAL(&powerLock);
+            double energyWh = energyMeter.wattHours();
+            portEXIT_CRITICAL(&powerLock);
 
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 30)
-    {
-        delay(500);
-        Serial.print(".");
-        attempts++;
-    }
+            if (energyWh != savedEnergyWh && saveEnergyWh(energyWh))
+            {
+                savedEnergyWh = energyWh;
+            }
+        }
 
-    if (WiFi.status() == WL_CONNECTED)
-    {
-        Serial.println("\nWiFi Connected!");
-        Serial.print("IP Address: ");
-        Serial.println(WiFi.localIP());
-        displayMessage("WiFi Connected", WiFi.localIP().toString());
-        delay(1000);
-    }
-    else
-    {
-        Serial.println("\nWiFi Connection Failed!");
-        displayMessage("WiFi Failed!", "Check settings");
-        delay(2000);
-    }
-}
+        // Any answered frame doubles as the heartbeat, so one only goes out on an otherwise
+        // quiet link, or to report the reconnect counters after a new connection
+        bool quiet = !uplinkAnswered && currentMillis - lastAnsweredSend >= tuning.heartbeatMs;
+        uint32_t connects = wsReconnect.counters().connects;
+        if (wsConnected && (quiet || connects != heartbeatConnects))
+        {
+            heartbeatConnects = connects;
+            sendHeartbeat();
+        }
 
-// ============== WEBSOCKET SETUP ==============
-void setupWebSocket()
-{
-    // Build WebSocket path with token
-    String wsPath = "/ws/iot/classroom/" + String(CLASSROOM_ID) + "/?token=" + String(DEVICE_TOKEN);
+        if (wsConnected && currentMillis - lastMetrics >= tuning.metricsMs)
+        {
+            lastMetrics = currentMillis;
+            sendMetrics();
+        }
 
-    Serial.print("Connecting to WebSocket: ws://");
-    Serial.print(WS_HOST);
-    Serial.print(":");
-    Serial.print(WS_PORT);
-    Serial.println(wsPath);
+        pollOccupancy(false);
 
-    // Important: Set extra headers that Django Channels expects
-    webSocket.setExtraHeaders("Origin: http://192.168.1.18:8000");
+        // Low-priority messages leave together once the oldest has waited the window;
+        // a tap already woke the radio, so they ride along right behind it
+        if (!wsConnected)
+        {
+            uplink.clear();
+            uplinkAnswered = false;
+        }
+        else if (tapSent || uplink.due(currentMillis, tuning.uplinkWindowMs))
+        {
+            flushUplink();
+        }
 
-    webSocket.begin(WS_HOST, WS_PORT, wsPath.c_str());
-    webSocket.onEvent(webSocketEvent);
-    webSocket.setReconnectInterval(RECONNECT_INTERVAL);
+        pollOta(currentMillis);
+        superviseNet(currentMillis);
 
-    // Disable the built-in heartbeat - it can interfere with some servers
-    // webSocket.enableHeartbeat(15000, 3000, 2);
+        recordStage(STAGE_NET_LOOP, passStart);
+    }
 }
 
-// ============== WEBSOCKET EVENT HANDLER ==============
-void webSocketEvent(WStype_t type, uint8_t *payload, size_t length)
+void rfidTask(void *param)
 {
-    switch (type)
+#if RFID_USE_IRQ
+    // Low level, not falling edge: light sleep can only wake on a level-triggered GPIO, and
+    // gpio_wakeup_enable() rewrites the pin's trigger type, so it must come after the attach
+    attachInterrupt(digitalPinToInterrupt(RFID_IRQ_PIN), rfidIrqHandler, ONLOW);
+#if POWER_SAVE
+    gpio_wakeup_enable((gpio_num_t)RFID_IRQ_PIN, GPIO_INTR_LOW_LEVEL);
+#endif
+#else
+    // Round-robin: one reader per slice, so each is visited every tuning.rfidReadMs
+    TickType_t lastWake = xTaskGetTickCount();
+    uint8_t nextReader = 0;
+#endif
+    superviseTask();
+    unsigned long lastHealthCheck = millis();
+
+    for (;;)
     {
-    case WStype_DISCONNECTED:
-        Serial.println("WebSocket Disconnected!");
-        wsConnected = false;
-        statusMessage = "Disconnected";
-        break;
+        esp_task_wdt_reset();
+        TapEvent event;
+        OutboxEntry &tap = event.entry;
 
-    case WStype_CONNECTED:
-        Serial.println("WebSocket Connected!");
-        wsConnected = true;
-        statusMessage = "Connected";
-        displayMessage("WS Connected!", "Ready to scan");
+#if POWER_SAVE
+        if (isIdle())
+        {
+            // Field off between looks; a tap lasts much longer than one interval
+            for (uint8_t i = 0; i < RFID_READER_COUNT; i++)
+            {
+                rfidReaders[i].PCD_SoftPowerDown();
+            }
+            vTaskDelay(pdMS_TO_TICKS(RFID_IDLE_POLL_INTERVAL));
+            for (uint8_t i = 0; i < RFID_READER_COUNT; i++)
+            {
+                rfidReaders[i].PCD_SoftPowerUp();
+            }
+        }
+#endif
 
-        // Send initial power reading
-        currentPower = readUltrasonicPower();
-        sendPowerData(currentPower);
-        break;
+        // Only this task talks to the readers, so the health check runs here, between reads
+        if (millis() - lastHealthCheck >= HEALTH_CHECK_INTERVAL)
+        {
+            lastHealthCheck = millis();
+            superviseRfid(lastHealthCheck);
+        }
 
-    case WStype_TEXT:
-    {
-        Serial.print("Received: ");
-        Serial.println((char *)payload);
+#if RFID_USE_IRQ
+        // Sleeps until the reader reports a response to our REQA
+        bool found = false;
+        tap.reader = 0;
+        if (waitForCard())
+        {
+            int64_t readStart = esp_timer_get_time();
+            found = readCardSerial(rfid, tap);
+            recordStage(STAGE_READ_RFID, readStart);
+        }
+#else
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(tuning.rfidReadMs / RFID_READER_COUNT));
+        tap.reader = nextReader;
+        nextReader = (nextReader + 1) % RFID_READER_COUNT;
 
-        // Parse JSON response
-        StaticJsonDocument<512> doc;
-        DeserializationError error = deserializeJson(doc, payload, length);
+        int64_t readStart = esp_timer_get_time();
+        bool found = readRFID(rfidReaders[tap.reader], tap);
+        recordStage(STAGE_READ_RFID, readStart);
+#endif
 
-        if (!error)
+        if (found && rfidDebouncer.accept(tap.rfidUid, millis()))
         {
-            const char *status = doc["status"];
-            if (status && strcmp(status, "ok") == 0)
+            event.detectedAt = esp_timer_get_time();
+            logEvent(EVENT_TAP, tap.reader);
+            LOG_DEBUG("RFID Detected: %s%s%s (%s)\n", tap.rfidUid, tap.cardId[0] ? " ID " : "", tap.cardId,
+                      doorName(tap.reader));
+            noteActivity();
+
+            // Stamp the tap now so a delayed delivery still has the real scan time
+            tap.deviceMs = epochMsAt(event.detectedAt);
+            getISOTimestamp(tap.timestamp, sizeof(tap.timestamp), tap.deviceMs);
+            tap.power = currentPower;
+            tap.seq = tapSequence.next();
+
+            // Instant local verdict; the server's reply still has the final say
+            char name[UID_CACHE_NAME_LEN];
+            if (lookupTeacher(tap.rfidUid, name, sizeof(name)))
+            {
+                displayMessage("Welcome!", name);
+            }
+            else if (uidCache.size() > 0)
+            {
+                displayMessage("Unknown Card", tap.rfidUid);
+            }
+            else
             {
-                Serial.println("Server acknowledged");
+                displayMessage("Card Detected!", tap.rfidUid); // Nothing synced yet
             }
 
-            // Handle attendance response
-            if (doc.containsKey("event"))
+            if (xQueueSend(rfidQueue, &event, 0) != pdTRUE)
             {
-                const char *event = doc["event"];
-                if (strcmp(event, "attendance_in") == 0)
-                {
-                    const char *teacher = doc["data"]["teacher"];
-                    if (teacher)
-                    {
-                        currentTeacher = String(teacher);
-                        displayMessage("Welcome!", currentTeacher.substring(0, 16));
-                    }
-                }
-                else if (strcmp(event, "attendance_error") == 0)
-                {
-                    const char *message = doc["data"]["message"];
-                    displayMessage("Error!", message ? message : "Unknown");
-                }
+                logEvent(EVENT_TAP_DROPPED);
+                LOG_WARN("RFID queue full, tap dropped\n");
             }
         }
-        break;
     }
+}
 
-    case WStype_BIN:
-        Serial.println("Binary data received (ignored)");
-        break;
+void sensorTask(void *param)
+{
+    TickType_t lastWake = xTaskGetTickCount();
+    superviseTask();
 
-    case WStype_ERROR:
-        Serial.println("WebSocket Error!");
-        wsConnected = false;
-        break;
+    for (;;)
+    {
+        esp_task_wdt_reset();
+        int64_t readStart = esp_timer_get_time();
+        float watts;
+        bool ok = powerSensor.read(watts);
+        recordStage(STAGE_READ_POWER, readStart);
 
-    case WStype_PING:
-        Serial.println("Ping received");
-        break;
+        if (ok)
+        {
+            currentPower = watts;
 
-    case WStype_PONG:
-        Serial.println("Pong received");
-        break;
+            portENTER_CRITICAL(&powerLock);
+            powerBatch.add(watts);
+            energyMeter.add(watts, millis());
+            portEXIT_CRITICAL(&powerLock);
+        }
 
-    default:
-        break;
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(tuning.powerSampleMs));
     }
 }
 
-// ============== SEND RFID DATA ==============
-void sendRfidData(String rfidUid)
+// Samples the presence sensor and filters it; only transitions reach netTask
+void occupancyTask(void *param)
 {
-    StaticJsonDocument<256> doc;
+#if OCCUPANCY_SENSOR != OCCUPANCY_NONE
+    OccupancyFilter filter(occupancySensor.threshold(), OCCUPANCY_EMA_ALPHA, OCCUPANCY_ENTER_LEVEL,
+                           OCCUPANCY_EXIT_LEVEL, OCCUPANCY_ENTER_HOLD, OCCUPANCY_EXIT_HOLD);
+    TickType_t lastWake = xTaskGetTickCount();
+    superviseTask();
+
+    for (;;)
+    {
+        esp_task_wdt_reset();
+        float value;
+        if (occupancySensor.read(value) && filter.add(value, millis()))
+        {
+            portENTER_CRITICAL(&stateLock);
+            roomOccupied = filter.occupied();
+            occupancySince = filter.since();
+            occupancyChanges++;
+            portEXIT_CRITICAL(&stateLock);
+        }
 
-    doc["device_id"] = DEVICE_ID;
-    doc["rfid_uid"] = rfidUid;
-    doc["power"] = currentPower;
-    // No timestamp needed - server uses auto_now_add for time_in
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(OCCUPANCY_SAMPLE_INTERVAL));
+    }
+#else
+    vTaskDelete(NULL);
+#endif
+}
 
-    String jsonString;
-    serializeJson(doc, jsonString);
+void lcdTask(void *param)
+{
+    bool backlightOn = true;
+    superviseTask();
 
-    Serial.print("Sending RFID data: ");
-    Serial.println(jsonString);
+    for (;;)
+    {
+        esp_task_wdt_reset();
+        LcdMessage msg;
+        if (xQueueReceive(displayQueue, &msg, pdMS_TO_TICKS(tuning.lcdUpdateMs)) == pdTRUE)
+        {
+            noteActivity();
+            if (!backlightOn)
+            {
+                lcd.backlight();
+                backlightOn = true;
+            }
 
-    webSocket.sendTXT(jsonString);
+            renderMessage(msg.line1, msg.line2);
+            lcdHoldUntil = millis() + MESSAGE_HOLD_TIME;
+        }
+        else if ((long)(millis() - lcdHoldUntil) >= 0)
+        {
+            // Refresh status only once any event message has been shown long enough
+            int64_t updateStart = esp_timer_get_time();
+            updateLCD();
+            recordStage(STAGE_UPDATE_LCD, updateStart);
+        }
 
-    displayMessage("Card Sent!", rfidUid.substring(0, 16));
+#if POWER_SAVE
+        if (backlightOn && isIdle())
+        {
+            lcd.noBacklight();
+            backlightOn = false;
+        }
+#endif
+    }
 }
 
-// ============== SEND POWER DATA ==============
-void sendPowerData(float watts)
+// ============== POWER MANAGEMENT ==============
+// Automatic light sleep: the CPU sleeps whenever every task is blocked and
+// wakes for the next tick, Wi-Fi beacon or RC522 interrupt. Needs a core
+// built with CONFIG_PM_ENABLE and tickless idle; otherwise only frequency
+// scaling is lost and everything else still works.
+void setupPowerSave()
 {
-    StaticJsonDocument<256> doc;
-
-    doc["device_id"] = DEVICE_ID;
-    doc["power"] = watts;
-    // No timestamp needed - server uses auto_now_add
-
-    String jsonString;
-    serializeJson(doc, jsonString);
+#if POWER_SAVE
+    esp_pm_config_esp32_t pm;
+    pm.max_freq_mhz = CPU_MAX_FREQ_MHZ;
+    pm.min_freq_mhz = CPU_MIN_FREQ_MHZ;
+    pm.light_sleep_enable = true;
+
+    esp_err_t err = esp_pm_configure(&pm);
+    if (err != ESP_OK)
+    {
+        LOG_WARN("Light sleep unavailable: %s\n", esp_err_to_name(err));
+    }
 
-    Serial.print("Sending power data: ");
-    Serial.println(jsonString);
+#if RFID_USE_IRQ
+    // A card answering our REQA must wake the CPU, not wait for the next tick;
+    // rfidTask enables the pin itself once its interrupt is attached
+    esp_sleep_enable_gpio_wakeup();
+#endif
+#endif
+}
 
-    webSocket.sendTXT(jsonString);
+bool isIdle()
+{
+#if POWER_SAVE
+    return millis() - lastActivity >= IDLE_TIMEOUT;
+#else
+    return false;
+#endif
 }
 
-// ============== SEND HEARTBEAT ==============
-void sendHeartbeat()
+void noteActivity()
 {
-    StaticJsonDocument<128> doc;
+    lastActivity = millis();
+}
 
-    doc["device_id"] = DEVICE_ID;
-    doc["type"] = "heartbeat";
-    // No timestamp needed
+// ============== DEVICE CONFIGURATION ==============
+void setupConfig()
+{
+    int overrides = loadDeviceConfig(deviceConfig);
 
-    String jsonString;
-    serializeJson(doc, jsonString);
+    formatDevicePath(wsPath, sizeof(wsPath), deviceConfig.classroomId, NULL);
+    snprintf(extraHeaders, sizeof(extraHeaders), "Origin: %s://%s:%u\r\nX-Device-Token: %s",
+             WS_TLS ? "https" : "http", deviceConfig.wsHost, deviceConfig.wsPort, deviceConfig.deviceToken);
 
-    webSocket.sendTXT(jsonString);
+    LOG_INFO("Device %s, classroom %ld (%d values from NVS)\n",
+                  deviceConfig.deviceId, (long)deviceConfig.classroomId, overrides);
 }
 
-// ============== GET ISO TIMESTAMP ==============
-String getISOTimestamp()
+// Serial console provisioning:
+//   config show | config set <key> <value> | config clear
+// Changes are stored in NVS and apply after a reboot
+void handleConfigCommand()
 {
-    struct tm timeinfo;
-    if (!getLocalTime(&timeinfo))
+    char *action = strtok(nullptr, " ");
+    if (action != nullptr && strcmp(action, "set") == 0)
+    {
+        char *key = strtok(nullptr, " ");
+        char *value = strtok(nullptr, "");
+        if (key == nullptr || value == nullptr)
+        {
+            Serial.println("usage: config set <key> <value>");
+        }
+        else if (setDeviceConfigValue(key, value))
+        {
+            Serial.printf("config: %s saved, reboot to apply\n", key);
+        }
+        else
+        {
+            Serial.printf("config: can't set %s\n", key);
+        }
+    }
+    else if (action != nullptr && strcmp(action, "clear") == 0)
     {
-        Serial.println("Failed to obtain time, using fallback");
-        // Return empty string to let server use its own time
-        return "";
+        Serial.println(clearDeviceConfig() ? "config: cleared, reboot to apply" : "config: clear failed");
+    }
+    else
+    {
+        Serial.printf("ssid=%s host=%s port=%u classroom=%ld device_id=%s\n",
+                      deviceConfig.wifiSsid, deviceConfig.wsHost, deviceConfig.wsPort,
+                      (long)deviceConfig.classroomId, deviceConfig.deviceId);
     }
-
-    // Format as ISO 8601 with timezone offset for Philippines (UTC+8)
-    char timestamp[30];
-    sprintf(timestamp, "%04d-%02d-%02dT%02d:%02d:%02d+08:00",
-            timeinfo.tm_year + 1900,
-            timeinfo.tm_mon + 1,
-            timeinfo.tm_mday,
-            timeinfo.tm_hour,
-            timeinfo.tm_min,
-            timeinfo.tm_sec);
-    return String(timestamp);
 }
 
-// ============== NTP SETUP ==============
-void setupNTP()
+// Console commands, polled from netTask: config ... (above), log, log clear
+void handleConsoleLine(char *line)
 {
-    Serial.println("Configuring NTP time...");
-    displayMessage("Syncing Time...", "");
-
-    configTime(GMT_OFFSET_SEC, DAYLIGHT_OFFSET_SEC, NTP_SERVER);
-
-    // Wait for time to be set (max 10 seconds)
-    struct tm timeinfo;
-    int attempts = 0;
-    while (!getLocalTime(&timeinfo) && attempts < 10)
+    char *command = strtok(line, " ");
+    if (command == nullptr)
     {
-        Serial.println("Waiting for NTP time sync...");
-        delay(1000);
-        attempts++;
+        return;
     }
 
-    if (getLocalTime(&timeinfo))
+    if (strcmp(command, "config") == 0)
     {
-        timeSync = true;
-        Serial.println("NTP Time synchronized!");
-        Serial.printf("Current time: %04d-%02d-%02d %02d:%02d:%02d\n",
-                      timeinfo.tm_year + 1900,
-                      timeinfo.tm_mon + 1,
-                      timeinfo.tm_mday,
-                      timeinfo.tm_hour,
-                      timeinfo.tm_min,
-                      timeinfo.tm_sec);
-        displayMessage("Time Synced!", "");
+        handleConfigCommand();
     }
-    else
+    else if (strcmp(command, "log") == 0)
     {
-        timeSync = false;
-        Serial.println("WARNING: Could not sync time with NTP");
-        displayMessage("Time Sync Fail", "Using server time");
+        char *action = strtok(nullptr, " ");
+        if (action != nullptr && strcmp(action, "clear") == 0)
+        {
+            portENTER_CRITICAL(&eventLogLock);
+            eventLog.clear();
+            portEXIT_CRITICAL(&eventLogLock);
+        }
+        else
+        {
+            printEventLog();
+        }
     }
-    delay(500);
 }
 
-bool isTimeSynced()
+void pollSerialConsole()
 {
-    return timeSync;
+    static char line[160];
+    static size_t length = 0;
+
+    while (Serial.available() > 0)
+    {
+        char c = (char)Serial.read();
+        if (c == '\r' || c == '\n')
+        {
+            if (length > 0)
+            {
+                line[length] = '\0';
+                handleConsoleLine(line);
+                length = 0;
+            }
+        }
+        else if (length < sizeof(line) - 1)
+        {
+            line[length++] = c;
+        }
+    }
 }
 
-// ============== RFID SETUP & READ ==============
-void setupRFID()
+// ============== RUNTIME TUNING ==============
+void setupTuning()
 {
-    SPI.begin();
-    rfid.PCD_Init();
-
-    Serial.print("RFID Reader: ");
-    rfid.PCD_DumpVersionToSerial();
-
-    displayMessage("RFID Ready", "");
+    defaultTuning(tuning);
+    if (loadTuning(tuning))
+    {
+        LOG_INFO("Tuning: server-pushed values restored from NVS\n");
+    }
+    powerReporter.configure(tuning.powerDeadband, tuning.powerMaxIntervalMs);
 }
 
-String readRFID()
+// {"event": "config_update", "values": {"heartbeat_ms": 10000, ...}} changes the named settings;
+// {"event": "config_update", "reset": true} goes back to the compiled-in defaults.
+// All-or-nothing: if any value is rejected or the result is inconsistent, nothing changes.
+void applyConfigUpdate(JsonDocument &doc)
 {
-    // Check for new card
-    if (!rfid.PICC_IsNewCardPresent())
+    Tuning next = tuning;
+    int rejected = 0;
+
+    if (doc["reset"] | false)
     {
-        return "";
+        defaultTuning(next);
     }
 
-    // Read card serial
-    if (!rfid.PICC_ReadCardSerial())
+    JsonObject values = doc["values"];
+    for (JsonPair kv : values)
+    {
+        if (!kv.value().is<double>() || !setTuningValue(next, kv.key().c_str(), kv.value().as<double>()))
+        {
+            LOG_WARN("Tuning: rejected %s\n", kv.key().c_str());
+            rejected++;
+        }
+    }
+    if (rejected == 0 && !tuningConsistent(next))
     {
-        return "";
+        LOG_WARN("Tuning: flush window doesn't fit the power batch, update rejected\n");
+        rejected++;
     }
 
-    // Convert UID to string
-    String uidString = "";
-    for (byte i = 0; i < rfid.uid.size; i++)
+    if (rejected == 0 && memcmp(&next, &tuning, sizeof(next)) != 0)
     {
-        if (rfid.uid.uidByte[i] < 0x10)
+        bool resampled = next.powerSampleMs != tuning.powerSampleMs;
+        tuning = next;
+        powerReporter.configure(tuning.powerDeadband, tuning.powerMaxIntervalMs);
+
+        if (resampled)
         {
-            uidString += "0";
+            // The batch's "interval" must describe every sample in it
+            portENTER_CRITICAL(&powerLock);
+            powerBatch.clear();
+            portEXIT_CRITICAL(&powerLock);
         }
-        uidString += String(rfid.uid.uidByte[i], HEX);
-    }
-    uidString.toUpperCase();
 
-    // Halt PICC and stop encryption
-    rfid.PICC_HaltA();
-    rfid.PCD_StopCrypto1();
+        bool saved = (doc["reset"] | false) && values.size() == 0 ? clearTuning() : saveTuning(tuning);
+        LOG_INFO("Tuning: update applied%s\n", saved ? "" : ", NVS save failed");
+    }
 
-    return uidString;
+    sendConfigApplied(rejected);
 }
 
-// ============== LCD SETUP & UPDATE ==============
-void setupLCD()
+static void addTuningValue(const char *name, double value, void *context)
 {
-    lcd.init();
-    lcd.backlight();
-    lcd.clear();
-
-    Serial.println("LCD Initialized");
+    (*static_cast<JsonObject *>(context))[name] = value;
 }
 
-void displayMessage(String line1, String line2)
+// {"type": "config_applied", "rejected": 0, "values": {...every setting now in use...}}
+void sendConfigApplied(int rejected)
 {
-    lcd.clear();
+    JsonDocument doc(&netArena);
 
-    // Center line 1
-    int pad1 = (LCD_COLUMNS - line1.length()) / 2;
-    if (pad1 < 0)
-        pad1 = 0;
-    lcd.setCursor(pad1, 0);
-    lcd.print(line1.substring(0, LCD_COLUMNS));
+    doc["device_id"] = deviceConfig.deviceId;
+    doc["type"] = "config_applied";
+    doc["rejected"] = rejected;
 
-    // Center line 2
-    int pad2 = (LCD_COLUMNS - line2.length()) / 2;
-    if (pad2 < 0)
-        pad2 = 0;
-    lcd.setCursor(pad2, 1);
-    lcd.print(line2.substring(0, LCD_COLUMNS));
+    JsonObject values = doc["values"].to<JsonObject>();
+    forEachTuningValue(tuning, addTuningValue, &values);
+
+    sendMessage(doc, "config_applied");
 }
 
-void updateLCD()
+// ============== EVENT LOG ==============
+void logEvent(LogEvent event, int32_t value)
 {
-    lcd.clear();
-
-    // Line 1: Time, Status and Power
-    String line1 = formatTime();
-    line1 += wsConnected ? " ON " : " OFF";
-    line1 += String(currentPower, 0) + "W";
-    lcd.setCursor(0, 0);
-    lcd.print(line1.substring(0, LCD_COLUMNS));
+    uint32_t now = millis();
+    portENTER_CRITICAL(&eventLogLock);
+    eventLog.record(now, event, value);
+    portEXIT_CRITICAL(&eventLogLock);
+}
 
-    // Line 2: Current teacher or ready message
-    lcd.setCursor(0, 1);
-    if (currentTeacher.length() > 0)
-    {
-        lcd.print(currentTeacher.substring(0, LCD_COLUMNS));
-    }
-    else
+void printEventLog()
+{
+    // Copy out first: printing at 115200 baud must not hold the lock
+    static RingLog snapshot;
+    portENTER_CRITICAL(&eventLogLock);
+    snapshot = eventLog;
+    portEXIT_CRITICAL(&eventLogLock);
+
+    Serial.printf("Event log: %u of %u events\n", (unsigned)snapshot.size(), (unsigned)snapshot.total());
+    for (size_t i = 0; i < snapshot.size(); i++)
     {
-        lcd.print("Scan RFID Card");
+        const RingLogEntry &entry = snapshot.at(i);
+        const char *name = entry.event < EVENT_COUNT ? EVENT_NAMES[entry.event] : "?";
+        Serial.printf("%10lu  %-12s %ld\n", (unsigned long)entry.timeMs, name, (long)entry.value);
     }
 }
 
-// ============== ULTRASONIC SENSOR (POWER SIMULATION) ==============
-void setupUltrasonic()
+// ============== WIFI SETUP ==============
+void setupWiFi()
 {
-    pinMode(ULTRASONIC_TRIG, OUTPUT);
-    pinMode(ULTRASONIC_ECHO, INPUT);
+    LOG_INFO("Connecting to WiFi: %s\n", deviceConfig.wifiSsid);
+
+    displayMessage("Connecting WiFi", deviceConfig.wifiSsid);
 
-    Serial.println("Ultrasonic sensor initialized");
+    // Non-blocking: RFID scanning starts while the join is still in progress
+    wifiLink.begin(millis());
 }
 
-float readUltrasonicPower()
+// Runs on netTask for the transitions reported by wifiLink.poll()
+void handleWifiEvent(WifiEvent event)
 {
-    // Send ultrasonic pulse
-    digitalWrite(ULTRASONIC_TRIG, LOW);
-    delayMicroseconds(2);
-    digitalWrite(ULTRASONIC_TRIG, HIGH);
-    delayMicroseconds(10);
-    digitalWrite(ULTRASONIC_TRIG, LOW);
-
-    // Read echo duration
-    long duration = pulseIn(ULTRASONIC_ECHO, HIGH, 30000); // 30ms timeout
-
-    // Convert to distance (cm)
-    float distance = duration * 0.034 / 2;
-
-    // Simulate power based on distance (0-400cm -> 0-1000W)
-    // This is just for testing - replace with actual power meter later
-    float simulatedPower = 0;
-    if (distance > 0 && distance < 400)
+    if (event == WIFI_EVENT_UP)
     {
-        // myMap distance to power: closer = higher power
-        simulatedPower = myMap(distance, 0, 400, 1000, 0);
-        // Add some random variation
-        simulatedPower += random(-20, 20);
-        if (simulatedPower < 0)
-            simulatedPower = 0;
+        IPAddress ip = WiFi.localIP();
+        char address[16];
+        snprintf(address, sizeof(address), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+
+        logEvent(EVENT_WIFI_UP, (int32_t)wifiLink.fastJoins());
+        LOG_INFO("WiFi Connected! IP Address: %s (%u fast joins)\n", address, (unsigned)wifiLink.fastJoins());
+        displayMessage("WiFi Connected", address);
     }
-    else
+    else if (event == WIFI_EVENT_DOWN)
     {
-        // If no reading, return a base load value
-        simulatedPower = 50 + random(0, 30);
+        logEvent(EVENT_WIFI_DOWN);
+        LOG_WARN("WiFi lost, reconnecting in the background\n");
+        displayMessage("WiFi Lost", "Reconnecting...");
     }
-
-    return simulatedPower;
 }
 
-// ============== UTILITY FUNCTIONS ==============
-long myMap(long x, long in_min, long in_max, long out_min, long out_max)
+// ============== WEBSOCKET SETUP ==============
+void setupWebSocket()
 {
-    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
-}
+    LOG_INFO("Connecting to WebSocket: %s://%s:%u%s\n", WS_TLS ? "wss" : "ws", deviceConfig.wsHost,
+             deviceConfig.wsPort, wsPath);
 
-String formatTime()
+    // Important: Set extra headers that Django Channels expects
+    webSocket.setExtraHeaders(extraHeaders);
+
+#if WS_TLS
+    // Only a chain ending in the pinned CA is accepted
+    serverCaPresent = strstr(SERVER_CA_CERT, "BEGIN CERTIFICATE") != NULL;
+    if (!serverCaPresent)
+    {
+        LOG_ERROR("WS_TLS build without a CA in server_ca.cpp, not connecting\n");
+        displayMessage("No server CA", "See server_ca");
+    }
+    webSocket.beginSslWithCA(deviceConfig.wsHost, deviceConfig.wsPort, wsPath, SERVER_CA_CERT);
+#else
+    webSocket.begin(deviceConfig.wsHost, deviceConfig.wsPort, wsPath);
+#endif
+    webSocket.onEvent(webSocketEvent);
+    // wsReconnect decides when to retry by only calling loop() during an attempt;
+    // this just stops the library from retrying twice inside one attempt window
+    webSocket.setReconnectInterval(WS_ATTEMPT_WINDOW);
+
+    // Disable the built-in heartbeat - it can interfere with some servers
+    // webSocket.enableHeartbeat(15000, 3000, 2);
+}
+
+// Whether a new attempt may start now. Each attempt is a full TLS handshake (the client
+// libraries keep no session to resume), so attempts are rationed and need a free block
+// the handshake can use; plain ws:// is always allowed
+bool connectAffordable(unsigned long now)
+{
+#if WS_TLS
+    static bool deferred = false; // One log line per stretch of waiting
+    uint32_t wait = handshakeBudget.waitMs(now);
+    uint32_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    if (serverCaPresent && wait == 0 && largest >= WS_TLS_MIN_BLOCK)
+    {
+        deferred = false;
+        return true;
+    }
+    if (!deferred && serverCaPresent)
+    {
+        deferred = true;
+        deferredConnects++;
+        if (wait)
+        {
+            LOG_WARN("TLS handshake budget spent, next attempt in %lu s\n", (unsigned long)(wait / 1000));
+        }
+        else
+        {
+            LOG_WARN("Largest free block %u too small for TLS, waiting\n", (unsigned)largest);
+        }
+    }
+    return false;
+#else
+    (void)now;
+    return true;
+#endif
+}
+
+void noteConnectAttempt(unsigned long now)
+{
+    handshakeBudget.spend(now); // Counted on ws:// too, only enforced for TLS
+    connectStartedAt = now;
+    connectHeapBefore = ESP.getFreeHeap();
+}
+
+// ============== WEBSOCKET EVENT HANDLER ==============
+void webSocketEvent(WStype_t type, uint8_t *payload, size_t length)
+{
+    switch (type)
+    {
+    case WStype_DISCONNECTED:
+        logEvent(EVENT_WS_DOWN);
+        LOG_WARN("WebSocket Disconnected!\n");
+        wsConnected = false;
+        wsReconnect.disconnected(millis(), esp_random());
+        requeuePendingTaps(); // Their replies are never coming; resent with the same seq later
+        inboundFrames.clear(); // Replies meant for the old connection
+        wireEncoding = WIRE_JSON; // Renegotiated on the next connection
+        statusMessage = "Disconnected";
+        break;
+
+    case WStype_CONNECTED:
+        logEvent(EVENT_WS_UP);
+        lastConnectMs = millis() - connectStartedAt;
+        maxConnectMs = lastConnectMs > maxConnectMs ? lastConnectMs : maxConnectMs;
+        connectHeapCost = (int32_t)connectHeapBefore - (int32_t)ESP.getFreeHeap();
+        LOG_INFO("WebSocket Connected! (%lu ms, %ld B of heap)\n", (unsigned long)lastConnectMs, (long)connectHeapCost);
+        wsConnected = true;
+        lastServerFrame = millis();
+        lastAnsweredSend = millis();
+        wsReconnect.connected();
+        statusMessage = "Connected";
+        displayMessage("WS Connected!", "Ready to scan");
+
+        // Offer binary framing; we keep sending JSON until the server agrees
+        sendHello();
+
+        // Fetch whatever changed in the allowlist while we were away
+        sendAllowlistSync();
+
+        // Start delivering any taps queued while we were offline
+        nextOutboxDrain = millis();
+        if (!outbox.empty())
+        {
+            LOG_INFO("Outbox: %u taps waiting to be sent\n", (unsigned)outbox.size());
+        }
+
+        // Send the latest power reading from sensorTask; the next batch goes out regardless of deadband
+        sendPowerData(currentPower);
+        powerReporter.force();
+
+        // The server may have missed transitions while we were away
+        pollOccupancy(true);
+        break;
+
+    case WStype_TEXT:
+    case WStype_BIN:
+    {
+        lastServerFrame = millis();
+        WireEncoding encoding = type == WStype_BIN ? WIRE_MSGPACK : WIRE_JSON;
+        if (encoding == WIRE_JSON)
+        {
+            LOG_DEBUG("Received: %.*s\n", (int)length, (const char *)payload);
+        }
+        else
+        {
+            LOG_DEBUG("Received: %u bytes msgpack\n", (unsigned)length);
+        }
+
+        // Handled once loop() returns; a burst that overflows the queue is handled here instead
+        if (!inboundFrames.push(encoding, payload, length))
+        {
+            dispatchFrame(encoding, payload, length);
+        }
+        break;
+    }
+
+    case WStype_ERROR:
+        LOG_ERROR("WebSocket Error!\n");
+        wsConnected = false;
+        wsReconnect.disconnected(millis(), esp_random());
+        break;
+
+    case WStype_PING:
+        lastServerFrame = millis();
+        LOG_DEBUG("Ping received\n");
+        break;
+
+    case WStype_PONG:
+        lastServerFrame = millis();
+        LOG_DEBUG("Pong received\n");
+        break;
+
+    default:
+        break;
+    }
+}
+
+// ============== SERVER MESSAGE HANDLER ==============
+// Same document layout whether it arrived as JSON text or MessagePack; handlers
+// only see the fields their route's filter keeps
+
+// A verdict answers the live tap whose seq it echoes
+static void noteVerdict(JsonDocument &doc)
+{
+    int64_t sentAt;
+    bool live;
+    uint32_t seq = doc["seq"] | 0u;
+    if (seq != 0 && pendingTaps.resolve(seq, sentAt, live))
+    {
+        recordStage(STAGE_SERVER_RTT, sentAt);
+    }
+    if (seq != 0)
+    {
+        outbox.settle(seq); // A late verdict for a tap that already went back to the outbox
+    }
+}
+
+// Status acks carry the seq of the tap they answer; replayed outbox taps only get this
+static void onReply(JsonDocument &doc)
+{
+    int64_t sentAt;
+    bool live;
+    uint32_t seq = doc["seq"] | 0u;
+    const char *status = doc["status"];
+    if (seq == 0 || !status)
+    {
+        return;
+    }
+
+    // An error reply leaves the tap pending, so it is retried after the timeout, up to a point
+    if (strcmp(status, "ok") == 0)
+    {
+        pendingTaps.resolve(seq, sentAt, live);
+        if (outbox.settle(seq) && outbox.empty())
+        {
+            LOG_INFO("Outbox: all offline taps delivered\n");
+        }
+    }
+    else
+    {
+        LOG_WARN("Server rejected tap %u: %s\n", (unsigned)seq, status);
+
+        // One the server keeps refusing would otherwise cycle through the outbox forever
+        if (pendingTaps.reject(seq) >= TAP_MAX_ATTEMPTS)
+        {
+            pendingTaps.resolve(seq, sentAt, live);
+            outbox.settle(seq);
+            logEvent(EVENT_TAP_REJECTED, (int32_t)seq);
+            LOG_WARN("Tap %u dropped after %u rejections\n", (unsigned)seq, TAP_MAX_ATTEMPTS);
+        }
+    }
+}
+
+static void onHello(JsonDocument &doc)
+{
+    // Server picks the encoding for the rest of this connection
+    WireEncoding chosen;
+    if (wireEncodingFromName(doc["encoding"], chosen))
+    {
+        wireEncoding = chosen;
+        LOG_INFO("Wire encoding: %s\n", wireEncodingName(wireEncoding));
+    }
+
+    // The server answered, so an image on trial made it all the way
+    otaMarkHealthy();
+}
+
+static void onAttendanceIn(JsonDocument &doc)
+{
+    noteVerdict(doc);
+    const char *teacher = doc["data"]["teacher"];
+    if (teacher)
+    {
+        portENTER_CRITICAL(&stateLock);
+        strncpy(currentTeacher, teacher, LCD_COLUMNS);
+        currentTeacher[LCD_COLUMNS] = '\0';
+        portEXIT_CRITICAL(&stateLock);
+        displayMessage("Welcome!", teacher);
+    }
+}
+
+static void onAttendanceDuplicate(JsonDocument &doc)
+{
+    noteVerdict(doc);
+    const char *teacher = doc["data"]["teacher"];
+    displayMessage("Already In", teacher ? teacher : "");
+}
+
+static void onAttendanceInvalid(JsonDocument &doc)
+{
+    noteVerdict(doc);
+    displayMessage("No Schedule Now", "Tap recorded");
+}
+
+static void onAttendanceError(JsonDocument &doc)
+{
+    noteVerdict(doc);
+    const char *message = doc["data"]["message"];
+    displayMessage("Error!", message ? message : "Unknown");
+}
+
+static void onAllowlistDone(JsonDocument &doc)
+{
+    if (uidCacheDirty)
+    {
+        xSemaphoreTake(uidCacheMutex, portMAX_DELAY);
+        bool saved = saveUidCache(uidCache, "/uidcache.dat");
+        size_t size = uidCache.size();
+        xSemaphoreGive(uidCacheMutex);
+
+        uidCacheDirty = !saved;
+        LOG_INFO("UID cache: %u entries%s\n", (unsigned)size, saved ? " saved" : ", save failed");
+    }
+}
+
+// Server staged a new image for us: fetch it from the same host as the WebSocket
+static void onOtaUpdate(JsonDocument &doc)
+{
+    const char *version = doc["version"];
+    const char *path = doc["path"];
+    const char *md5 = doc["md5"];
+    if (!version || !path || !md5 || strcmp(version, FIRMWARE_VERSION) == 0)
+    {
+        return;
+    }
+
+    OtaRequest request;
+    snprintf(request.version, sizeof(request.version), "%s", version);
+    snprintf(request.host, sizeof(request.host), "%s", deviceConfig.wsHost);
+    request.port = deviceConfig.wsPort;
+    snprintf(request.path, sizeof(request.path), "%s", path);
+    snprintf(request.token, sizeof(request.token), "%s", deviceConfig.deviceToken);
+    snprintf(request.md5, sizeof(request.md5), "%s", md5);
+    request.size = doc["size"] | 0u;
+    request.imageSize = doc["image_size"] | request.size;
+    request.zlib = doc["zlib"] | false;
+
+    if (request.size == 0 || strlen(path) >= sizeof(request.path) || !otaStart(request))
+    {
+        LOG_WARN("OTA %s not started (%s)\n", version, otaState() == OTA_DOWNLOADING ? "one in progress" : "bad request");
+        return;
+    }
+    displayMessage("Updating...", version);
+}
+
+static void onAllowlistChanged(JsonDocument &doc)
+{
+    // Someone edited a teacher or card on the server
+    sendAllowlistSync();
+}
+
+// Server events by name. Each filter lists exactly the fields the handler reads,
+// so a new server-side field costs nothing until a handler asks for it.
+const InboundRoute INBOUND_ROUTES[] = {
+    INBOUND_ROUTE("hello", "{\"encoding\":true}", onHello),
+    INBOUND_ROUTE("attendance_in", "{\"seq\":true,\"data\":{\"teacher\":true}}", onAttendanceIn),
+    INBOUND_ROUTE("attendance_duplicate", "{\"seq\":true,\"data\":{\"teacher\":true}}", onAttendanceDuplicate),
+    INBOUND_ROUTE("attendance_invalid", "{\"seq\":true}", onAttendanceInvalid),
+    INBOUND_ROUTE("attendance_error", "{\"seq\":true,\"data\":{\"message\":true}}", onAttendanceError),
+    // Allowlist sync: replacements for buckets whose checksum differed
+    INBOUND_ROUTE("allowlist_bucket", "{\"bucket\":true,\"part\":true,\"entries\":true}", applyAllowlistBucket),
+    INBOUND_ROUTE("allowlist_done", "{}", onAllowlistDone),
+    INBOUND_ROUTE("allowlist_changed", "{}", onAllowlistChanged),
+    // Server retuning intervals/deadbands, e.g. more telemetry during an audit
+    INBOUND_ROUTE("config_update", "{\"values\":true,\"reset\":true}", applyConfigUpdate),
+    INBOUND_ROUTE("ota_update",
+                  "{\"version\":true,\"path\":true,\"md5\":true,\"size\":true,\"image_size\":true,\"zlib\":true}",
+                  onOtaUpdate),
+};
+
+InboundDispatcher inbound(INBOUND_ROUTES, sizeof(INBOUND_ROUTES) / sizeof(INBOUND_ROUTES[0]), &inArena, onReply);
+
+void setupInbound()
+{
+    if (!inbound.begin())
+    {
+        LOG_ERROR("Inbound routes: bad filter or too many routes\n");
+    }
+}
+
+void dispatchFrame(WireEncoding encoding, const uint8_t *payload, size_t length)
+{
+    int64_t start = esp_timer_get_time();
+    switch (inbound.dispatch(encoding, payload, length))
+    {
+    case INBOUND_DISPATCHED:
+        recordStage(STAGE_DISPATCH, start);
+        break;
+
+    case INBOUND_NO_EVENT:
+        LOG_DEBUG("Server acknowledged\n");
+        break;
+
+    case INBOUND_UNKNOWN:
+        LOG_DEBUG("Unhandled event: %s\n", inbound.lastEvent());
+        break;
+
+    case INBOUND_BAD_FRAME:
+        // An event name means it got past routing and overflowed the arena in its own parse
+        LOG_WARN("Bad %s frame (%u bytes, event %s)\n", wireEncodingName(encoding), (unsigned)length,
+                 inbound.lastEvent()[0] ? inbound.lastEvent() : "?");
+        break;
+    }
+}
+
+void drainInbound()
+{
+    while (!inboundFrames.empty())
+    {
+        dispatchFrame(inboundFrames.frontEncoding(), inboundFrames.frontData(), inboundFrames.frontLength());
+        inboundFrames.pop();
+    }
+}
+
+// ============== SEND MESSAGE ==============
+// Encodes doc in the negotiated wire format and sends it; label is for logging (NULL = quiet)
+bool sendMessage(const JsonDocument &doc, const char *label)
+{
+    size_t length = encodeMessage(doc, wireEncoding, wireBuffer, sizeof(wireBuffer));
+    if (length == 0)
+    {
+        logEvent(EVENT_SEND_TOO_BIG, WIRE_BUFFER_SIZE);
+        LOG_ERROR("Message too large for wire buffer, not sent\n");
+        return false;
+    }
+
+    return sendFrame(wireEncoding, wireBuffer, length, label);
+}
+
+bool sendFrame(WireEncoding encoding, const uint8_t *frame, size_t length, const char *label)
+{
+    if (encoding == WIRE_MSGPACK)
+    {
+        if (label)
+        {
+            LOG_DEBUG("Sending %s: %u bytes msgpack\n", label, (unsigned)length);
+        }
+        return webSocket.sendBIN(frame, length);
+    }
+
+    if (label)
+    {
+        LOG_DEBUG("Sending %s: %.*s\n", label, (int)length, (const char *)frame);
+    }
+    return webSocket.sendTXT((const char *)frame, length);
+}
+
+// ============== UPLINK COALESCING ==============
+// Encodes a low-priority message into the uplink bundle instead of sending it; netTask
+// flushes the bundle after tuning.uplinkWindowMs. answered: the server acks this message
+bool queueUplink(const JsonDocument &doc, const char *label, bool answered)
+{
+    size_t length = encodeMessage(doc, wireEncoding, wireBuffer, sizeof(wireBuffer));
+    if (length == 0)
+    {
+        logEvent(EVENT_SEND_TOO_BIG, WIRE_BUFFER_SIZE);
+        LOG_ERROR("Message too large for wire buffer, not sent\n");
+        return false;
+    }
+
+    // Full, or the encoding changed since the first member: send what's there and start over
+    if (!uplink.add(wireBuffer, length, wireEncoding, millis()))
+    {
+        flushUplink();
+        if (!uplink.add(wireBuffer, length, wireEncoding, millis()))
+        {
+            return false;
+        }
+    }
+    uplinkAnswered = uplinkAnswered || answered;
+
+    if (label)
+    {
+        LOG_DEBUG("Queued %s: %u bytes, %u waiting\n", label, (unsigned)length, (unsigned)uplink.count());
+    }
+    return true;
+}
+
+// The server acks every bundle once, and a lone member exactly as if it had been sent directly
+void flushUplink()
+{
+    if (uplink.empty())
+    {
+        return;
+    }
+
+    size_t length;
+    const uint8_t *frame = uplink.finish(length);
+    bool bundled = uplink.count() > 1;
+    if (sendFrame(uplink.encoding(), frame, length, bundled ? "bundle" : "uplink"))
+    {
+        uplinkFrames++;
+        uplinkMessages += uplink.count();
+        if (bundled || uplinkAnswered)
+        {
+            lastAnsweredSend = millis();
+        }
+    }
+    else
+    {
+        LOG_WARN("Uplink send failed, %u messages dropped\n", (unsigned)uplink.count());
+    }
+
+    uplink.clear();
+    uplinkAnswered = false;
+}
+
+// ============== SEND HELLO ==============
+void sendHello()
+{
+    // Factory MAC: sequence numbers restart on a new board even if it keeps the room's device ID
+    char board[13];
+    snprintf(board, sizeof(board), "%012llx", (unsigned long long)ESP.getEfuseMac());
+
+    JsonDocument doc(&netArena);
+    buildHelloMessage(doc, deviceConfig.deviceId, FIRMWARE_VERSION, board, WIRE_OFFER_MSGPACK); // Always sent as JSON
+
+    // The NVS copy of energy_wh can be up to ENERGY_SAVE_INTERVAL old, so after a reboot the
+    // counter runs below what the server last saw; these let it count from the restored value
+    doc["boot"] = bootId;
+    doc["boot_wh"] = bootEnergyWh;
+
+    sendMessage(doc, "hello");
+}
+
+// ============== UID ALLOWLIST CACHE ==============
+void setupUidCache()
+{
+    uidCacheMutex = xSemaphoreCreateMutex();
+
+    if (loadUidCache(uidCache, "/uidcache.dat"))
+    {
+        LOG_INFO("UID cache: %u entries loaded\n", (unsigned)uidCache.size());
+    }
+}
+
+bool lookupTeacher(const char *uid, char *name, size_t size)
+{
+    xSemaphoreTake(uidCacheMutex, portMAX_DELAY);
+    bool found = uidCache.lookup(uid, name, size);
+    xSemaphoreGive(uidCacheMutex);
+    return found;
+}
+
+void sendAllowlistSync()
+{
+    uint32_t checksums[UID_CACHE_BUCKETS];
+    xSemaphoreTake(uidCacheMutex, portMAX_DELAY);
+    uidCache.bucketChecksums(checksums);
+    xSemaphoreGive(uidCacheMutex);
+
+    JsonDocument doc(&netArena);
+
+    doc["device_id"] = deviceConfig.deviceId;
+    doc["type"] = "allowlist_sync";
+
+    // The server answers with the contents of every bucket whose checksum differs
+    JsonArray buckets = doc["buckets"].to<JsonArray>();
+    for (size_t i = 0; i < UID_CACHE_BUCKETS; i++)
+    {
+        buckets.add(checksums[i]);
+    }
+
+    sendMessage(doc, "allowlist sync");
+}
+
+// {"event": "allowlist_bucket", "bucket": 3, "part": 0, "entries": [["A1B2C3D4", "John Doe"], ...]}
+// Large buckets arrive in several parts; part 0 replaces the bucket, later parts add to it
+void applyAllowlistBucket(JsonDocument &doc)
+{
+    int bucket = doc["bucket"] | -1;
+    if (bucket < 0 || bucket >= UID_CACHE_BUCKETS)
+    {
+        return;
+    }
+
+    bool full = false;
+    xSemaphoreTake(uidCacheMutex, portMAX_DELAY);
+    if ((doc["part"] | 0) == 0)
+    {
+        uidCache.clearBucket(bucket);
+    }
+    for (JsonVariant entry : doc["entries"].as<JsonArray>())
+    {
+        const char *uid = entry[0];
+        const char *name = entry[1];
+        if (uid && !uidCache.add(uid, name ? name : ""))
+        {
+            full = true;
+        }
+    }
+    xSemaphoreGive(uidCacheMutex);
+
+    uidCacheDirty = true;
+    if (full)
+    {
+        LOG_WARN("UID cache full, some teachers only validated by the server\n");
+    }
+}
+
+// ============== SEND RFID DATA ==============
+bool sendRfidData(const OutboxEntry &tap, bool queued)
+{
+    JsonDocument doc(&netArena);
+    buildTapMessage(doc, deviceConfig.deviceId, tap, doorName(tap.reader), queued);
+
+    if (!sendMessage(doc, "RFID data"))
+    {
+        return false;
+    }
+    lastAnsweredSend = millis(); // Verdict and ack come back for it
+    return true;
+}
+
+// ============== OFFLINE OUTBOX DRAIN ==============
+void drainOutbox()
+{
+    for (int sent = 0; sent < OUTBOX_DRAIN_BATCH && !pendingTaps.full(); sent++)
+    {
+        // The tap stays in the outbox (and on flash) until its status ack settles it
+        const OutboxEntry *tap = outbox.next();
+        if (!tap)
+        {
+            break;
+        }
+
+        int64_t sendStart = esp_timer_get_time();
+        if (!sendRfidData(*tap, true))
+        {
+            outbox.requeue(tap->seq);
+            break;
+        }
+        pendingTaps.track(*tap, false, millis(), sendStart);
+    }
+}
+
+// ============== PENDING TAPS ==============
+// One overdue tap per netTask pass: resent with its seq, or back to the outbox once out of attempts
+void retryPendingTaps(unsigned long now)
+{
+    OutboxEntry tap;
+    bool live;
+    switch (pendingTaps.poll(now, tap, live))
+    {
+    case PENDING_RETRY:
+        logEvent(EVENT_TAP_RETRY, (int32_t)tap.seq);
+        LOG_WARN("Tap %u unanswered, resending\n", (unsigned)tap.seq);
+        sendRfidData(tap, !live); // A failed send just waits for the next timeout
+        break;
+
+    case PENDING_EXPIRED:
+        LOG_WARN("Tap %u unanswered after %u sends, back to the outbox\n", (unsigned)tap.seq, TAP_MAX_ATTEMPTS);
+        if (!live)
+        {
+            outbox.requeue(tap.seq); // Never left it
+        }
+        else if (!outbox.push(tap))
+        {
+            logEvent(EVENT_TAP_DROPPED);
+        }
+        break;
+
+    case PENDING_NONE:
+        break;
+    }
+}
+
+// Connection gone: everything in flight is delivered again from the outbox
+void requeuePendingTaps()
+{
+    OutboxEntry tap;
+    bool live;
+    while (pendingTaps.takeOldest(tap, live))
+    {
+        if (live && !outbox.push(tap))
+        {
+            logEvent(EVENT_TAP_DROPPED);
+        }
+    }
+    outbox.requeueAll();
+}
+
+// ============== SEND POWER DATA ==============
+void sendPowerData(float watts)
+{
+    JsonDocument doc(&netArena);
+    buildPowerMessage(doc, deviceConfig.deviceId, watts);
+
+    queueUplink(doc, "power data", true);
+}
+
+// ============== SEND POWER BATCH ==============
+bool sendPowerBatch(const PowerBatch &batch, double energyWh)
+{
+    JsonDocument doc(&netArena);
+    buildPowerBatchMessage(doc, deviceConfig.deviceId, batch, tuning.powerSampleMs, energyWh);
+
+    LOG_DEBUG("Power batch: %u samples, mean %.1f W\n", (unsigned)batch.size(), batch.stats().mean);
+
+    return queueUplink(doc, "power batch", true);
+}
+
+// ============== SEND OCCUPANCY ==============
+// Sends the latest transition from occupancyTask, with the power reading at that moment;
+// force re-sends the current state (after a reconnect) even if it hasn't changed
+void pollOccupancy(bool force)
+{
+#if OCCUPANCY_SENSOR != OCCUPANCY_NONE
+    static uint32_t sentChanges = 0;
+
+    portENTER_CRITICAL(&stateLock);
+    uint32_t changes = occupancyChanges;
+    bool occupied = roomOccupied;
+    uint32_t since = occupancySince;
+    portEXIT_CRITICAL(&stateLock);
+
+    // Nothing is known until the first transition; the filter starts out vacant
+    if (!wsConnected || changes == 0 || (!force && changes == sentChanges))
+    {
+        return;
+    }
+
+    portENTER_CRITICAL(&powerLock);
+    double energyWh = energyMeter.wattHours();
+    portEXIT_CRITICAL(&powerLock);
+
+    // Measured now, not at the flip: a resend after a reconnect must still point at the same moment
+    uint32_t sinceMs = millis() - since;
+    JsonDocument doc(&netArena);
+    buildOccupancyMessage(doc, deviceConfig.deviceId, occupied, sinceMs, currentPower, energyWh);
+    if (queueUplink(doc, "occupancy", false))
+    {
+        LOG_INFO("Occupancy: %s for %lu ms\n", occupied ? "occupied" : "vacant", (unsigned long)sinceMs);
+        sentChanges = changes;
+    }
+#else
+    (void)force;
+#endif
+}
+
+// ============== SEND HEARTBEAT ==============
+void sendHeartbeat()
+{
+    JsonDocument doc(&netArena);
+    buildHeartbeatMessage(doc, deviceConfig.deviceId, wsReconnect.counters());
+
+    queueUplink(doc, NULL, true);
+}
+
+// ============== FIRMWARE UPDATE ==============
+static const char *const OTA_STATE_NAMES[] = {"idle", "downloading", "applied", "failed"};
+
+// Reports the download, restarts into a written image once no tap is in flight,
+// and restarts an image on trial that hasn't reached the server
+void pollOta(unsigned long now)
+{
+    if (otaOnTrial() && now >= OTA_HEALTH_TIMEOUT)
+    {
+        // Restarting uses up a trial boot; otaBootCheck() rolls back once they're gone
+        LOG_ERROR("OTA: no server hello within %u s of booting %s\n", (unsigned)(OTA_HEALTH_TIMEOUT / 1000), FIRMWARE_VERSION);
+        ESP.restart();
+    }
+
+    // Logged locally once per change; reported whenever the socket is next up
+    static OtaState loggedState = OTA_IDLE;
+    static OtaState reportedState = OTA_IDLE;
+    static uint8_t reportedProgress = 0;
+    OtaState state = otaState();
+    uint8_t progress = otaProgress();
+    if (state != loggedState)
+    {
+        loggedState = state;
+        logEvent(EVENT_OTA, state);
+        if (state == OTA_FAILED)
+        {
+            displayMessage("Update Failed", otaError());
+        }
+    }
+    if (wsConnected && (state != reportedState || progress / 10 != reportedProgress / 10))
+    {
+        reportedState = state;
+        reportedProgress = progress;
+        sendOtaStatus();
+    }
+
+    // Unanswered taps would be lost with the restart; the outbox survives it but may as well be empty
+    if (state == OTA_APPLIED && pendingTaps.size() == 0 && outbox.empty() && uxQueueMessagesWaiting(rfidQueue) == 0)
+    {
+        restartDevice("new firmware");
+    }
+}
+
+// {"type": "ota_status", "version", "state", "progress", "error"}
+void sendOtaStatus()
+{
+    JsonDocument doc(&netArena);
+
+    doc["device_id"] = deviceConfig.deviceId;
+    doc["type"] = "ota_status";
+    doc["version"] = FIRMWARE_VERSION;
+    doc["state"] = OTA_STATE_NAMES[otaState()];
+    doc["progress"] = otaProgress();
+    if (otaState() == OTA_FAILED)
+    {
+        doc["error"] = otaError();
+    }
+
+    sendMessage(doc, "ota_status");
+}
+
+// ============== HEALTH SUPERVISOR ==============
+static const char *resetReasonName(esp_reset_reason_t reason)
+{
+    static const char *const names[] = {"unknown", "power_on", "external", "software", "panic", "int_wdt",
+                                        "task_wdt", "wdt", "deep_sleep", "brownout", "sdio"};
+    return (size_t)reason < sizeof(names) / sizeof(names[0]) ? names[reason] : "unknown";
+}
+
+void setupHealth()
+{
+    esp_reset_reason_t reason = esp_reset_reason();
+    uint8_t cause = healthRebootMark & 0xFF;
+    if (reason == ESP_RST_SW && (healthRebootMark & 0xFFFFFF00) == HEALTH_MARK_MAGIC && cause < CAUSE_COUNT)
+    {
+        bootCause = (HealthCause)cause;
+    }
+    healthRebootMark = 0;
+    LOG_INFO("Reset reason: %s%s%s\n", resetReasonName(reason), bootCause != CAUSE_NONE ? ", health reboot: " : "",
+             bootCause != CAUSE_NONE ? CAUSE_NAMES[bootCause] : "");
+
+    // Reconfigures the watchdog the core already started: longer timeout, and panic instead of just logging
+    esp_task_wdt_init(HEALTH_WDT_TIMEOUT, true);
+}
+
+// Each long-running task calls this once, then esp_task_wdt_reset() every pass
+void superviseTask()
+{
+    esp_task_wdt_add(NULL);
+}
+
+// VersionReg still reads what it did at boot, the antenna drivers are on and the IRQ routing is intact
+static bool rfidResponding(uint8_t i)
+{
+    MFRC522 &reader = rfidReaders[i];
+    if (reader.PCD_ReadRegister(MFRC522::VersionReg) != rfidVersion[i])
+    {
+        return false;
+    }
+    if ((reader.PCD_ReadRegister(MFRC522::TxControlReg) & 0x03) != 0x03)
+    {
+        return false;
+    }
+#if RFID_USE_IRQ
+    if (reader.PCD_ReadRegister(MFRC522::ComIEnReg) != 0xA0)
+    {
+        return false;
+    }
+#endif
+    return true;
+}
+
+static void resetRfidReader(uint8_t i)
+{
+    rfidReaders[i].PCD_Init(RFID_READERS[i].ssPin, RFID_RST_PIN);
+#if RFID_USE_IRQ
+    rfid.PCD_WriteRegister(MFRC522::ComIEnReg, 0xA0); // PCD_Init cleared it
+#endif
+}
+
+// rfidTask: a latched-up RC522 just stops seeing cards, so ask it directly
+void superviseRfid(unsigned long now)
+{
+    bool healthy = true;
+    bool failed[RFID_READER_COUNT];
+    for (uint8_t i = 0; i < RFID_READER_COUNT; i++)
+    {
+        if (rfidVersion[i] == 0)
+        {
+            // Never answered since boot: keep trying, but a missing reader is no reason to reboot
+            resetRfidReader(i);
+            uint8_t version = rfidReaders[i].PCD_ReadRegister(MFRC522::VersionReg);
+            if (version != 0x00 && version != 0xFF)
+            {
+                rfidVersion[i] = version;
+                LOG_INFO("RFID reader %s found (version 0x%02X)\n", RFID_READERS[i].door, version);
+            }
+            failed[i] = false;
+            continue;
+        }
+        failed[i] = !rfidResponding(i);
+        healthy = healthy && !failed[i];
+    }
+
+    switch (rfidHealth.report(healthy, now))
+    {
+    case HEALTH_RECOVER:
+        for (uint8_t i = 0; i < RFID_READER_COUNT; i++)
+        {
+            if (failed[i])
+            {
+                LOG_WARN("RFID reader %s not responding, re-initializing\n", RFID_READERS[i].door);
+                logEvent(EVENT_HEALTH, CAUSE_RFID);
+                resetRfidReader(i);
+            }
+        }
+        break;
+
+    case HEALTH_REBOOT:
+        requestReboot(CAUSE_RFID);
+        break;
+
+    case HEALTH_OK:
+        break;
+    }
+}
+
+// netTask: socket silence and heap, then any reboot another task asked for
+void superviseNet(unsigned long now)
+{
+    static unsigned long lastCheck = 0;
+    static unsigned long rebootAfter = 0;
+
+    if (rebootRequest != CAUSE_NONE)
+    {
+        // Give in-flight taps a moment to be answered; RAM outbox entries don't survive a restart
+        if (rebootAfter == 0)
+        {
+            rebootAfter = now + HEALTH_REBOOT_GRACE;
+            LOG_ERROR("Health: %s did not recover, rebooting\n", CAUSE_NAMES[rebootRequest]);
+            displayMessage("Self Restart", CAUSE_NAMES[rebootRequest]);
+        }
+        bool settled = pendingTaps.size() == 0 && uxQueueMessagesWaiting(rfidQueue) == 0 && (!wsConnected || outbox.empty());
+        if (settled || (long)(now - rebootAfter) >= 0)
+        {
+            healthRebootMark = HEALTH_MARK_MAGIC | rebootRequest;
+            restartDevice(CAUSE_NAMES[rebootRequest]);
+        }
+        return;
+    }
+
+    if (now - lastCheck < HEALTH_CHECK_INTERVAL)
+    {
+        return;
+    }
+    lastCheck = now;
+
+    // Every heartbeat gets an ack, so a silent server means the TCP connection is dead but not closed
+    bool silent = wsConnected && now - lastServerFrame > HEALTH_SILENT_HEARTBEATS * tuning.heartbeatMs;
+    switch (socketHealth.report(!silent, now))
+    {
+    case HEALTH_RECOVER:
+        LOG_WARN("Server silent for %lu s, reconnecting\n", (now - lastServerFrame) / 1000);
+        logEvent(EVENT_HEALTH, CAUSE_SOCKET);
+        webSocket.disconnect(); // The reconnect scheduler takes it from here
+        break;
+
+    case HEALTH_REBOOT:
+        requestReboot(CAUSE_SOCKET);
+        break;
+
+    case HEALTH_OK:
+        break;
+    }
+
+    // An OTA download holds its buffers on purpose; nothing else here can be freed, so a
+    // low check only counts a strike and the ladder reboots if the heap doesn't come back
+    if (otaState() == OTA_DOWNLOADING)
+    {
+        return;
+    }
+    uint32_t freeHeap = ESP.getFreeHeap();
+    uint32_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    bool heapOk = freeHeap >= HEALTH_MIN_FREE_HEAP && largest >= HEALTH_MIN_LARGEST_BLOCK;
+    switch (heapHealth.report(heapOk, now))
+    {
+    case HEALTH_RECOVER:
+        LOG_WARN("Low heap: %u free, largest block %u (%u%% fragmented)\n", (unsigned)freeHeap, (unsigned)largest,
+                 (unsigned)heapFragmentation(freeHeap, largest));
+        logEvent(EVENT_HEALTH, CAUSE_HEAP);
+        break;
+
+    case HEALTH_REBOOT:
+        requestReboot(CAUSE_HEAP);
+        break;
+
+    case HEALTH_OK:
+        break;
+    }
+}
+
+void requestReboot(HealthCause cause)
+{
+    if (rebootRequest == CAUSE_NONE)
+    {
+        rebootRequest = cause;
+    }
+}
+
+// netTask: save what would be lost, close the socket cleanly and restart
+void restartDevice(const char *reason)
+{
+    portENTER_CRITICAL(&powerLock);
+    double energyWh = energyMeter.wattHours();
+    portEXIT_CRITICAL(&powerLock);
+    saveEnergyWh(energyWh);
+
+    LOG_INFO("Restarting: %s\n", reason);
+    displayMessage("Restarting...", reason);
+    webSocket.disconnect();
+    vTaskDelay(pdMS_TO_TICKS(500)); // Let the close frame and the LCD go out
+    ESP.restart();
+}
+
+// ============== METRICS REPORT ==============
+void recordStage(MetricStage stage, int64_t startedAt)
+{
+    uint32_t elapsed = (uint32_t)(esp_timer_get_time() - startedAt);
+
+    portENTER_CRITICAL(&metricsLock);
+    stageTimes[stage].record(elapsed);
+    portEXIT_CRITICAL(&metricsLock);
+}
+
+// {"type": "metrics", "window": 60000, "stages": {"ws_loop": {"n", "min", "p50", "p99", "max"}, ...},
+//  "taps": {"pending", "retries", "outbox"},
+//  "clock": {"synced", "syncs", "steps", "drift_ppb", "last_error_us", "since_sync"},
+//  "heap": {"free", "min_free", "largest", "frag"},
+//  "health": {"reset_reason", "health_reboot", "rfid_resets", "socket_resets", "heap_strikes"}}
+void sendMetrics()
+{
+    JsonDocument doc(&netArena);
+
+    doc["device_id"] = deviceConfig.deviceId;
+    doc["type"] = "metrics";
+    doc["window"] = tuning.metricsMs;
+
+    // Read one stage at a time so the other tasks are never held up for long
+    JsonObject stages = doc["stages"].to<JsonObject>();
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        portENTER_CRITICAL(&metricsLock);
+        LatencyHistogram h = stageTimes[i];
+        stageTimes[i].reset();
+        portEXIT_CRITICAL(&metricsLock);
+
+        if (h.count() == 0)
+        {
+            continue;
+        }
+
+        JsonObject stage = stages[STAGE_NAMES[i]].to<JsonObject>();
+        stage["n"] = h.count();
+        stage["min"] = h.minimum();
+        stage["p50"] = h.percentile(50);
+        stage["p99"] = h.percentile(99);
+        stage["max"] = h.maximum();
+    }
+
+    JsonObject taps = doc["taps"].to<JsonObject>();
+    taps["pending"] = (uint32_t)pendingTaps.size();
+    taps["retries"] = pendingTaps.retries(); // Lifetime
+    taps["outbox"] = (uint32_t)outbox.size();
+#if RFID_PAYLOAD_SECTOR >= 0
+    taps["auth_failures"] = cardPayload.authFailures(); // Lifetime; one aligned word, read without a lock
+#endif
+
+    portENTER_CRITICAL(&stateLock);
+    DeviceClock clock = deviceClock;
+    portEXIT_CRITICAL(&stateLock);
+    JsonObject time = doc["clock"].to<JsonObject>();
+    time["synced"] = clock.synced();
+    time["syncs"] = clock.syncs();
+    time["steps"] = clock.steps();
+    time["drift_ppb"] = clock.driftPpb();
+    time["last_error_us"] = clock.lastErrorUs();
+    if (clock.synced())
+    {
+        time["since_sync"] = (uint32_t)((esp_timer_get_time() - clock.lastSyncUs()) / 1000000); // seconds
+    }
+
+    uint32_t freeHeap = ESP.getFreeHeap();
+    uint32_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    JsonObject heap = doc["heap"].to<JsonObject>();
+    heap["free"] = freeHeap;
+    heap["min_free"] = (uint32_t)ESP.getMinFreeHeap();
+    heap["largest"] = largest;
+    heap["frag"] = heapFragmentation(freeHeap, largest);
+
+    // Lifetime soft resets; rfidHealth belongs to rfidTask but its counter is one aligned word
+    JsonObject health = doc["health"].to<JsonObject>();
+    health["reset_reason"] = resetReasonName(esp_reset_reason());
+    health["health_reboot"] = CAUSE_NAMES[bootCause];
+    health["rfid_resets"] = rfidHealth.recoveries();
+    health["socket_resets"] = socketHealth.recoveries();
+    health["heap_strikes"] = heapHealth.recoveries();
+
+    // Lifetime uplink frames and the messages coalesced into them
+    JsonObject link = doc["uplink"].to<JsonObject>();
+    link["frames"] = uplinkFrames;
+    link["msgs"] = uplinkMessages;
+
+    // What reconnecting costs: handshake time and the heap a live connection holds
+    JsonObject connect = doc["connect"].to<JsonObject>();
+    connect["tls"] = WS_TLS ? true : false;
+    connect["last_ms"] = lastConnectMs;
+    connect["max_ms"] = maxConnectMs;
+    connect["heap_cost"] = connectHeapCost;
+    connect["handshakes"] = handshakeBudget.spent();
+    connect["deferred"] = deferredConnects;
+
+    queueUplink(doc, "metrics", false);
+}
+
+// ============== DEVICE TIME ==============
+// Epoch ms at an esp_timer stamp, 0 until the first SNTP sync
+int64_t epochMsAt(int64_t monoUs)
+{
+    portENTER_CRITICAL(&stateLock);
+    int64_t ms = deviceClock.epochMs(monoUs);
+    portEXIT_CRITICAL(&stateLock);
+    return ms;
+}
+
+// Writes epochMs as local ISO 8601; leaves buf empty (server uses its own time) if it is 0
+bool getISOTimestamp(char *buf, size_t size, int64_t epochMs)
+{
+    buf[0] = '\0';
+    if (epochMs == 0)
+    {
+        return false;
+    }
+    return formatIsoTimestamp(buf, size, epochMs / 1000, GMT_OFFSET_SEC + DAYLIGHT_OFFSET_SEC);
+}
+
+// ============== NTP SETUP ==============
+// Runs on the lwIP task after every SNTP poll, first one included
+static void onTimeSync(struct timeval *tv)
+{
+    int64_t epochUs = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+    int64_t monoUs = esp_timer_get_time();
+
+    portENTER_CRITICAL(&stateLock);
+    deviceClock.sync(epochUs, monoUs);
+    portEXIT_CRITICAL(&stateLock);
+}
+
+void setupNTP()
+{
+    LOG_INFO("Configuring NTP time...\n");
+
+    // DeviceClock slews small errors itself, so the system clock may just step. SNTP
+    // keeps polling in the background, retrying until the network is up, then every
+    // NTP_SYNC_INTERVAL so drift is tracked over the whole semester.
+    sntp_set_sync_mode(SNTP_SYNC_MODE_IMMED);
+    sntp_set_sync_interval(NTP_SYNC_INTERVAL);
+    sntp_set_time_sync_notification_cb(onTimeSync);
+
+    // Taps made before the first sync carry no timestamp and get server time
+    configTime(GMT_OFFSET_SEC, DAYLIGHT_OFFSET_SEC, NTP_SERVER);
+}
+
+
+// ============== RFID SETUP & READ ==============
+void setupRFID()
+{
+    SPI.begin();
+
+    // Deselect every reader first: a floating SS on a chip not yet initialised
+    // would answer on MISO while an earlier one is being set up
+    for (uint8_t i = 0; i < RFID_READER_COUNT; i++)
+    {
+        pinMode(RFID_READERS[i].ssPin, OUTPUT);
+        digitalWrite(RFID_READERS[i].ssPin, HIGH);
+    }
+
+    // RST is shared: the first PCD_Init() releases it, later ones only soft-reset their own chip
+    for (uint8_t i = 0; i < RFID_READER_COUNT; i++)
+    {
+        rfidReaders[i].PCD_Init(RFID_READERS[i].ssPin, RFID_RST_PIN);
+        uint8_t version = rfidReaders[i].PCD_ReadRegister(MFRC522::VersionReg);
+        rfidVersion[i] = version == 0xFF ? 0 : version; // What "healthy" reads back from now on
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+        Serial.printf("RFID Reader %s: ", RFID_READERS[i].door);
+        rfidReaders[i].PCD_DumpVersionToSerial();
+#endif
+    }
+
+#if RFID_USE_IRQ
+    // Route receive interrupts to the IRQ pin (active low); rfidTask attaches the handler
+    pinMode(RFID_IRQ_PIN, INPUT_PULLUP);
+    rfid.PCD_WriteRegister(MFRC522::ComIEnReg, 0xA0); // IRqInv | RxIEn
+#endif
+
+    displayMessage("RFID Ready", "");
+}
+
+bool readRFID(MFRC522 &reader, OutboxEntry &tap)
+{
+    // Check for new card
+    if (!reader.PICC_IsNewCardPresent())
+    {
+        return false;
+    }
+
+    return readCardSerial(reader, tap);
+}
+
+// Selects the card that answered the last REQA, formats its UID and reads its ID sector if configured
+bool readCardSerial(MFRC522 &reader, OutboxEntry &tap)
+{
+    // Read card serial
+    if (!reader.PICC_ReadCardSerial())
+    {
+        return false;
+    }
+
+    // Convert UID to upper-case hex, two digits per byte
+    static const char hexDigits[] = "0123456789ABCDEF";
+    char *uid = tap.rfidUid;
+    size_t len = 0;
+    for (byte i = 0; i < reader.uid.size && len + 2 < sizeof(tap.rfidUid); i++)
+    {
+        uid[len++] = hexDigits[reader.uid.uidByte[i] >> 4];
+        uid[len++] = hexDigits[reader.uid.uidByte[i] & 0x0F];
+    }
+    uid[len] = '\0';
+
+    // While the card is still selected; an unreadable sector still leaves a UID-only tap
+    tap.cardId[0] = '\0';
+#if RFID_PAYLOAD_SECTOR >= 0
+    int64_t payloadStart = esp_timer_get_time();
+    if (len > 0 && !cardPayload.read(reader, tap.cardId, sizeof(tap.cardId)))
+    {
+        LOG_DEBUG("No card ID in sector %d of %s\n", RFID_PAYLOAD_SECTOR, uid);
+    }
+    recordStage(STAGE_READ_PAYLOAD, payloadStart);
+#endif
+
+    // Halt PICC and stop encryption
+    reader.PICC_HaltA();
+    reader.PCD_StopCrypto1();
+
+    return len > 0;
+}
+
+// Taps restored from an older outbox file may carry any reader index
+const char *doorName(uint8_t reader)
+{
+    return RFID_READERS[reader < RFID_READER_COUNT ? reader : 0].door;
+}
+
+// ============== RFID IRQ MODE ==============
+#if RFID_USE_IRQ && RFID_READER_COUNT > 1
+#error "RFID IRQ mode drives a single reader; set RFID_USE_IRQ to 0 for multiple readers"
+#endif
+
+// The RC522 cannot detect a card by itself: it has to transmit REQA and
+// raise RxIRq when a card answers. Arming that is three register writes,
+// versus PICC_IsNewCardPresent() which busy-polls the reader over SPI
+// until its timeout when the field is empty.
+// Level-triggered: masks itself until waitForCard() has cleared the RC522's flags
+void IRAM_ATTR rfidIrqHandler()
+{
+    gpio_intr_disable((gpio_num_t)RFID_IRQ_PIN);
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(rfidTaskHandle, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+// Same preamble as PCD_CommunicateWithPICC(), so a half-finished exchange can't leak into the REQA
+void rfidArmReceive()
+{
+    rfid.PCD_WriteRegister(MFRC522::CommandReg, MFRC522::PCD_Idle);  // Stop any active command
+    rfid.PCD_WriteRegister(MFRC522::ComIrqReg, 0x7F);                // Clear pending flags so the pin can fall again
+    rfid.PCD_WriteRegister(MFRC522::FIFOLevelReg, 0x80);             // FlushBuffer
+    rfid.PCD_ClearRegisterBitMask(MFRC522::CollReg, 0x80);           // ValuesAfterColl: bits after a collision read as 0
+    rfid.PCD_WriteRegister(MFRC522::FIFODataReg, MFRC522::PICC_CMD_REQA);
+    rfid.PCD_WriteRegister(MFRC522::CommandReg, MFRC522::PCD_Transceive);
+    rfid.PCD_WriteRegister(MFRC522::BitFramingReg, 0x87); // StartSend, 7-bit short frame
+}
+
+// Returns true once a card has answered; re-arms every RFID_IRQ_REARM_INTERVAL otherwise
+bool waitForCard()
+{
+    // Drop notifications left over from our own select/halt traffic
+    ulTaskNotifyTake(pdTRUE, 0);
+    rfidArmReceive();
+    gpio_intr_enable((gpio_num_t)RFID_IRQ_PIN); // The pin is high again, so this doesn't fire at once
+
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RFID_IRQ_REARM_INTERVAL)) == 0)
+    {
+        return false;
+    }
+
+    rfid.PCD_WriteRegister(MFRC522::ComIrqReg, 0x7F);
+    return true;
+}
+
+// ============== LCD SETUP & UPDATE ==============
+void setupLCD()
+{
+    lcd.init();
+    lcd.backlight();
+    lcd.clear();
+    lcdFrame.invalidate(); // Display is blank now, whatever the frame thought was shown
+
+    LOG_INFO("LCD Initialized\n");
+}
+
+void displayMessage(const char *line1, const char *line2)
+{
+    // Before setupTasks() there is no lcdTask yet, so draw directly
+    if (lcdTaskHandle == NULL)
+    {
+        renderMessage(line1, line2);
+        return;
+    }
+
+    LcdMessage msg;
+    strncpy(msg.line1, line1, LCD_COLUMNS);
+    msg.line1[LCD_COLUMNS] = '\0';
+    strncpy(msg.line2, line2, LCD_COLUMNS);
+    msg.line2[LCD_COLUMNS] = '\0';
+
+    // Drop the message rather than block the caller if the LCD is behind
+    xQueueSend(displayQueue, &msg, 0);
+}
+
+// Both screens are composed in lcdFrame; flush() only sends the cells that changed
+void renderMessage(const char *line1, const char *line2)
+{
+    lcdFrame.clear();
+    lcdFrame.printCentered(0, line1);
+    lcdFrame.printCentered(1, line2);
+    lcdFrame.flush(lcdSink);
+}
+
+void updateLCD()
+{
+    lcdFrame.clear();
+
+    // Line 1: Time, Status and Power
+    char time[6];
+    formatTime(time, sizeof(time));
+
+    char line1[LCD_COLUMNS + 1];
+    snprintf(line1, sizeof(line1), "%s%s%.0fW", time, wsConnected ? " ON " : " OFF", (float)currentPower);
+    lcdFrame.print(0, 0, line1);
+
+    // Line 2: Current teacher or ready message
+    char teacher[LCD_COLUMNS + 1];
+    portENTER_CRITICAL(&stateLock);
+    memcpy(teacher, currentTeacher, sizeof(teacher));
+    portEXIT_CRITICAL(&stateLock);
+
+    lcdFrame.print(0, 1, teacher[0] != '\0' ? teacher : "Scan RFID Card");
+    lcdFrame.flush(lcdSink);
+}
+
+// ============== POWER SENSOR ==============
+void setupPowerSensor()
+{
+    // Carry the lifetime counter over from before the reboot
+    double energyWh;
+    if (loadEnergyWh(energyWh))
+    {
+        energyMeter.restore(energyWh);
+        bootEnergyWh = energyWh;
+        LOG_INFO("Energy counter: %.1f Wh\n", energyWh);
+    }
+    bootId = esp_random();
+
+    if (powerSensor.begin())
+    {
+        LOG_INFO("Power sensor: %s\n", powerSensor.name());
+    }
+    else
+    {
+        LOG_ERROR("Power sensor %s failed to start\n", powerSensor.name());
+    }
+}
+
+void setupOccupancy()
+{
+#if OCCUPANCY_SENSOR != OCCUPANCY_NONE
+    if (occupancySensor.begin())
+    {
+        LOG_INFO("Occupancy sensor: %s\n", occupancySensor.name());
+    }
+    else
+    {
+        LOG_ERROR("Occupancy sensor %s failed to start\n", occupancySensor.name());
+    }
+#endif
+}
+
+// ============== UTILITY FUNCTIONS ==============
+void formatTime(char *buf, size_t size)
 {
-    struct tm timeinfo;
-    if (!getLocalTime(&timeinfo))
+    int64_t ms = epochMsAt(esp_timer_get_time());
+    if (ms == 0)
     {
-        return "--:--";
+        snprintf(buf, size, "--:--");
+        return;
     }
-    char buffer[6];
-    sprintf(buffer, "%02d:%02d", timeinfo.tm_hour, timeinfo.tm_min);
-    return String(buffer);
+    CivilTime t = civilFromEpoch(ms / 1000, GMT_OFFSET_SEC + DAYLIGHT_OFFSET_SEC);
+    snprintf(buf, size, "%02u:%02u", t.hour, t.minute);
 }
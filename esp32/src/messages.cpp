@@ -0,0 +1,118 @@
+#include "messages.h"
+
+#include <stdio.h>
+
+#include "wire_protocol.h"
+
+bool formatDevicePath(char *buf, size_t size, long classroomId, const char *token)
+{
+    int n = token ? snprintf(buf, size, "/ws/iot/classroom/%ld/?token=%s", classroomId, token)
+                  : snprintf(buf, size, "/ws/iot/classroom/%ld/", classroomId);
+    return n > 0 && (size_t)n < size;
+}
+
+void buildHelloMessage(JsonDocument &doc, const char *deviceId, const char *firmware, const char *board,
+                       bool offerMsgpack)
+{
+    doc["device_id"] = deviceId;
+    doc["type"] = "hello";
+    doc["proto"] = WIRE_PROTOCOL_VERSION;
+    doc["fw"] = firmware;
+    doc["board"] = board;
+
+    JsonArray encodings = doc["encodings"].to<JsonArray>();
+    if (offerMsgpack)
+    {
+        encodings.add("msgpack");
+    }
+    encodings.add("json");
+}
+
+void buildTapMessage(JsonDocument &doc, const char *deviceId, const OutboxEntry &tap,
+                     const char *door, bool queued)
+{
+    doc["device_id"] = deviceId;
+    doc["rfid_uid"] = tap.rfidUid;
+    if (tap.cardId[0] != '\0')
+    {
+        doc["card_id"] = tap.cardId;
+    }
+    doc["door"] = door;
+    doc["power"] = tap.power;
+
+    // Lets the server echo replies back to this tap and drop retransmits
+    if (tap.seq != 0)
+    {
+        doc["seq"] = tap.seq;
+    }
+    if (tap.deviceMs != 0)
+    {
+        doc["device_ms"] = tap.deviceMs;
+    }
+
+    // Live taps use server time (auto_now_add); queued taps carry the time they were scanned
+    if (queued)
+    {
+        doc["queued"] = true;
+        if (tap.timestamp[0] != '\0')
+        {
+            doc["timestamp"] = tap.timestamp;
+        }
+    }
+}
+
+void buildPowerMessage(JsonDocument &doc, const char *deviceId, float watts)
+{
+    doc["device_id"] = deviceId;
+    doc["power"] = watts;
+}
+
+void buildOccupancyMessage(JsonDocument &doc, const char *deviceId, bool occupied, uint32_t sinceMs,
+                           float watts, double energyWh)
+{
+    doc["device_id"] = deviceId;
+    doc["type"] = "occupancy";
+    doc["occupied"] = occupied;
+    doc["since_ms"] = sinceMs;
+    doc["power"] = watts;
+    doc["energy_wh"] = energyWh;
+}
+
+void buildHeartbeatMessage(JsonDocument &doc, const char *deviceId, const ReconnectCounters &rc)
+{
+    doc["device_id"] = deviceId;
+    doc["type"] = "heartbeat";
+
+    // Lifetime reconnect counters so the server can see fleet-wide reconnect load
+    JsonObject reconnect = doc["reconnect"].to<JsonObject>();
+    reconnect["attempts"] = rc.attempts;
+    reconnect["failures"] = rc.failures;
+    reconnect["connects"] = rc.connects;
+    reconnect["disconnects"] = rc.disconnects;
+    reconnect["last_delay"] = rc.lastDelay;
+}
+
+void buildPowerBatchMessage(JsonDocument &doc, const char *deviceId, const PowerBatch &batch,
+                            uint32_t intervalMs, double energyWh)
+{
+    PowerStats stats = batch.stats();
+    int32_t deltas[POWER_BATCH_SLOTS];
+    size_t n = batch.deltas(deltas, POWER_BATCH_SLOTS);
+
+    doc["device_id"] = deviceId;
+    doc["type"] = "power_batch";
+    doc["interval"] = intervalMs;      // ms between samples
+    doc["scale"] = POWER_SAMPLE_SCALE; // samples are watts * scale
+    doc["min"] = stats.min;
+    doc["max"] = stats.max;
+    doc["mean"] = stats.mean;
+    doc["last"] = stats.last;
+    doc["energy_wh"] = energyWh; // Lifetime counter, kept across reboots in NVS
+
+    // First value absolute, then differences from the previous sample
+    JsonArray samples = doc["samples"].to<JsonArray>();
+    for (size_t i = 0; i < n; i++)
+    {
+        samples.add(deltas[i]);
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ArduinoJson.h>
+
+#include "outbox.h"
+#include "power_batch.h"
+#include "reconnect.h"
+
+// Layouts of the messages the device sends, shared by the firmware, the
+// host benchmark (bench/) and the load generator (loadgen/) so all three
+// put the same documents on the wire
+
+// "/ws/iot/classroom/<id>/?token=<token>", or without the query for a NULL token
+// (sent as an X-Device-Token header instead); returns false if it doesn't fit
+bool formatDevicePath(char *buf, size_t size, long classroomId, const char *token);
+
+// {"device_id", "type": "hello", "proto", "fw", "board", "encodings": [...]}; preferred encoding first.
+// board identifies the hardware, so a replacement board under the same device ID is told apart
+void buildHelloMessage(JsonDocument &doc, const char *deviceId, const char *firmware, const char *board,
+                       bool offerMsgpack);
+
+// {"device_id", "rfid_uid", "door", "power"[, "seq", "device_ms"][, "queued": true, "timestamp"]}
+void buildTapMessage(JsonDocument &doc, const char *deviceId, const OutboxEntry &tap,
+                     const char *door, bool queued);
+
+// {"device_id", "power"}; no timestamp, the server uses auto_now_add
+void buildPowerMessage(JsonDocument &doc, const char *deviceId, float watts);
+
+// {"device_id", "type": "heartbeat", "reconnect": {lifetime counters}}
+void buildHeartbeatMessage(JsonDocument &doc, const char *deviceId, const ReconnectCounters &rc);
+
+// {"device_id", "type": "occupancy", "occupied", "since_ms", "power", "energy_wh"}; sent on each
+// transition, since_ms is how long ago, as of sending, the room started looking that way
+void buildOccupancyMessage(JsonDocument &doc, const char *deviceId, bool occupied, uint32_t sinceMs,
+                           float watts, double energyWh);
+
+// {"device_id", "type": "power_batch", "interval", "scale", "min", "max", "mean", "last",
+//  "energy_wh", "samples": [first, delta, delta, ...]}; batch must not be empty
+void buildPowerBatchMessage(JsonDocument &doc, const char *deviceId, const PowerBatch &batch,
+                            uint32_t intervalMs, double energyWh);
@@ -0,0 +1,102 @@
+#include "mifare_reader.h"
+
+#include <string.h>
+
+#define MIFARE_CMD_READ 0x30
+#define MIFARE_BLOCKS_PER_SECTOR 4 // Sectors 0-31; the large sectors of a 4K card aren't supported
+
+MifareSectorReader::MifareSectorReader(uint8_t sector, uint8_t blocks, const uint8_t *keys, uint8_t keyCount)
+    : firstBlock(sector * MIFARE_BLOCKS_PER_SECTOR),
+      blockCount(blocks < CARD_ID_MAX_BLOCKS ? blocks : CARD_ID_MAX_BLOCKS),
+      keys(keys),
+      keyCount(keyCount),
+      lastKey(0),
+      failures(0)
+{
+}
+
+bool MifareSectorReader::read(MFRC522 &reader, char *out, size_t size)
+{
+    out[0] = '\0';
+
+    // Phones, DESFire and Ultralight cards keep the UID-only path
+    MFRC522::PICC_Type type = MFRC522::PICC_GetType(reader.uid.sak);
+    if (type != MFRC522::PICC_TYPE_MIFARE_MINI && type != MFRC522::PICC_TYPE_MIFARE_1K &&
+        type != MFRC522::PICC_TYPE_MIFARE_4K)
+    {
+        return false;
+    }
+
+    if (!authenticate(reader))
+    {
+        return false;
+    }
+
+    uint8_t data[CARD_ID_MAX_BLOCKS * MIFARE_BLOCK_SIZE];
+    for (uint8_t i = 0; i < blockCount; i++)
+    {
+        if (!readBlock(reader, firstBlock + i, data + i * MIFARE_BLOCK_SIZE))
+        {
+            return false;
+        }
+    }
+    return decodeCardId(data, blockCount * MIFARE_BLOCK_SIZE, out, size);
+}
+
+bool MifareSectorReader::authenticate(MFRC522 &reader)
+{
+    uint8_t trailer = firstBlock + MIFARE_BLOCKS_PER_SECTOR - 1;
+
+    for (uint8_t n = 0; n < keyCount; n++)
+    {
+        uint8_t index = (lastKey + n) % keyCount;
+
+        // A failed authentication drops the card back to idle; wake and select it again
+        if (n > 0)
+        {
+            byte atqa[2];
+            byte atqaSize = sizeof(atqa);
+            reader.PCD_StopCrypto1();
+            if (reader.PICC_WakeupA(atqa, &atqaSize) != MFRC522::STATUS_OK ||
+                reader.PICC_Select(&reader.uid) != MFRC522::STATUS_OK)
+            {
+                return false;
+            }
+        }
+
+        MFRC522::MIFARE_Key key;
+        memcpy(key.keyByte, keys + index * MIFARE_KEY_SIZE, MIFARE_KEY_SIZE);
+        if (reader.PCD_Authenticate(MFRC522::PICC_CMD_MF_AUTH_KEY_A, trailer, &key, &reader.uid) == MFRC522::STATUS_OK)
+        {
+            lastKey = index;
+            return true;
+        }
+        failures++;
+    }
+    return false;
+}
+
+bool MifareSectorReader::readBlock(MFRC522 &reader, uint8_t block, uint8_t *data)
+{
+    uint8_t command[4] = {MIFARE_CMD_READ, block};
+    uint16_t crc = crcA(command, 2);
+    command[2] = (uint8_t)crc;
+    command[3] = (uint8_t)(crc >> 8);
+
+    // 16 data bytes + CRC_A; checkCRC=false skips the coprocessor, we check it here
+    uint8_t response[MIFARE_BLOCK_SIZE + 2];
+    byte length = sizeof(response);
+    if (reader.PCD_TransceiveData(command, sizeof(command), response, &length, nullptr, 0, false) != MFRC522::STATUS_OK ||
+        length != sizeof(response))
+    {
+        return false;
+    }
+
+    crc = crcA(response, MIFARE_BLOCK_SIZE);
+    if (response[MIFARE_BLOCK_SIZE] != (uint8_t)crc || response[MIFARE_BLOCK_SIZE + 1] != (uint8_t)(crc >> 8))
+    {
+        return false;
+    }
+    memcpy(data, response, MIFARE_BLOCK_SIZE);
+    return true;
+}
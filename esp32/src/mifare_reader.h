@@ -0,0 +1,44 @@
+#pragma once
+
+#include <MFRC522.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "card_payload.h"
+
+#define MIFARE_KEY_SIZE 6
+
+/**
+ * Reads an ID string from one sector of a MIFARE Classic card.
+ *
+ * Called right after PICC_ReadCardSerial(), while the card is still
+ * selected. Authenticates with the key that worked last time first, so
+ * a fleet of cards keyed alike costs one authentication per tap; each
+ * wrong key costs a re-select. Block reads compute CRC_A on the ESP32
+ * instead of round-tripping through the RC522's CRC coprocessor, which
+ * leaves one transceive per 16-byte block.
+ *
+ * Leaves Crypto1 on; the caller halts the card and stops it as usual.
+ */
+class MifareSectorReader
+{
+public:
+    // keys: keyCount Key A candidates, MIFARE_KEY_SIZE bytes each; blocks: data blocks from the sector's first
+    MifareSectorReader(uint8_t sector, uint8_t blocks, const uint8_t *keys, uint8_t keyCount);
+
+    // false (out = "") for non-Classic cards, unknown keys, read errors or an empty sector
+    bool read(MFRC522 &reader, char *out, size_t size);
+
+    uint32_t authFailures() const { return failures; }
+
+private:
+    bool authenticate(MFRC522 &reader);
+    bool readBlock(MFRC522 &reader, uint8_t block, uint8_t *data);
+
+    uint8_t firstBlock;
+    uint8_t blockCount;
+    const uint8_t *keys;
+    uint8_t keyCount;
+    uint8_t lastKey; // Index of the key that authenticated last
+    uint32_t failures;
+};
@@ -0,0 +1,72 @@
+#include "occupancy.h"
+
+OccupancyFilter::OccupancyFilter(float presentBelow, float alpha, float enterLevel, float exitLevel,
+                                 uint32_t enterHoldMs, uint32_t exitHoldMs)
+    : threshold(presentBelow),
+      alpha(alpha),
+      enterAt(enterLevel),
+      exitAt(exitLevel),
+      enterHold(enterHoldMs),
+      exitHold(exitHoldMs),
+      filled(0),
+      next(0),
+      smoothed(0),
+      state(false),
+      pending(false),
+      pendingSince(0),
+      changedAt(0)
+{
+}
+
+float OccupancyFilter::median() const
+{
+    // Insertion sort of at most five values
+    float sorted[OCCUPANCY_MEDIAN_SIZE];
+    for (uint8_t i = 0; i < filled; i++)
+    {
+        float v = window[i];
+        uint8_t j = i;
+        while (j > 0 && sorted[j - 1] > v)
+        {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    return filled == 0 ? 0 : sorted[filled / 2];
+}
+
+bool OccupancyFilter::add(float value, uint32_t nowMs)
+{
+    window[next] = value;
+    next = (next + 1) % OCCUPANCY_MEDIAN_SIZE;
+    if (filled < OCCUPANCY_MEDIAN_SIZE)
+    {
+        filled++;
+    }
+
+    float present = median() < threshold ? 1.0f : 0.0f;
+    smoothed += alpha * (present - smoothed);
+
+    // Past the threshold for the other state; the hold timer starts the first time
+    bool crossing = state ? smoothed <= exitAt : smoothed >= enterAt;
+    if (!crossing)
+    {
+        pending = false;
+        return false;
+    }
+    if (!pending)
+    {
+        pending = true;
+        pendingSince = nowMs;
+    }
+
+    if (nowMs - pendingSince < (state ? exitHold : enterHold))
+    {
+        return false;
+    }
+    changedAt = pendingSince;
+    state = !state;
+    pending = false;
+    return true;
+}
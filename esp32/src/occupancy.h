@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+
+#define OCCUPANCY_MEDIAN_SIZE 5
+
+/**
+ * Turns a noisy presence sensor into clean occupied/vacant transitions.
+ *
+ * Each raw reading goes through three stages:
+ *   1. a 5-sample median, which drops single echo spikes and PIR glitches;
+ *   2. a presence test, value < presentBelow, smoothed by an EMA into a
+ *      0-1 level. For an echo sensor presentBelow sits short of the empty
+ *      room's far wall; motion sensors report 0 (motion) or 1 against 0.5;
+ *   3. hysteresis: the level must rise to enterLevel and stay there for
+ *      enterHoldMs to become occupied, and fall to exitLevel and stay
+ *      there for exitHoldMs to become vacant.
+ *
+ * The exit hold is meant to be long (minutes): people sitting still
+ * don't move a PIR and can slip out of an ultrasonic beam.
+ */
+class OccupancyFilter
+{
+public:
+    OccupancyFilter(float presentBelow, float alpha, float enterLevel, float exitLevel,
+                    uint32_t enterHoldMs, uint32_t exitHoldMs);
+
+    // Returns true when this reading flipped occupied()
+    bool add(float value, uint32_t nowMs);
+
+    bool occupied() const { return state; }
+    float level() const { return smoothed; }
+    float median() const;
+
+    // nowMs at which the condition behind the last flip started, e.g. when the room went quiet
+    uint32_t since() const { return changedAt; }
+
+private:
+    float threshold;
+    float alpha;
+    float enterAt;
+    float exitAt;
+    uint32_t enterHold;
+    uint32_t exitHold;
+
+    float window[OCCUPANCY_MEDIAN_SIZE];
+    uint8_t filled;
+    uint8_t next;
+    float smoothed;
+    bool state;
+    bool pending;          // Level is on the other side of its threshold
+    uint32_t pendingSince;
+    uint32_t changedAt;
+};
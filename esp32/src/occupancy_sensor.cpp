@@ -0,0 +1,44 @@
+#include "occupancy_sensor.h"
+
+#include <Arduino.h>
+
+#include "ultrasonic_sensor.h"
+
+#define NO_ECHO_CM 1000.0f // Nothing in range reads as far away, not as "someone at 0 cm"
+
+UltrasonicOccupancySensor::UltrasonicOccupancySensor(uint8_t trigPin, uint8_t echoPin, float rangeCm)
+    : trigPin(trigPin), echoPin(echoPin), range(rangeCm)
+{
+}
+
+bool UltrasonicOccupancySensor::begin()
+{
+    pinMode(trigPin, OUTPUT);
+    pinMode(echoPin, INPUT);
+    return true;
+}
+
+bool UltrasonicOccupancySensor::read(float &value)
+{
+    float distance = readUltrasonicCm(trigPin, echoPin);
+    value = distance > 0 ? distance : NO_ECHO_CM;
+    return true;
+}
+
+MotionOccupancySensor::MotionOccupancySensor(uint8_t pin, bool activeHigh)
+    : pin(pin), activeHigh(activeHigh)
+{
+}
+
+bool MotionOccupancySensor::begin()
+{
+    pinMode(pin, INPUT); // Both kinds drive their output; GPIO 34-39 have no pulls anyway
+    return true;
+}
+
+bool MotionOccupancySensor::read(float &value)
+{
+    bool motion = digitalRead(pin) == (activeHigh ? HIGH : LOW);
+    value = motion ? 0.0f : 1.0f;
+    return true;
+}
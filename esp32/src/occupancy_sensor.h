@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Raw presence readings for the occupancy task's OccupancyFilter.
+ *
+ * read() returns a value that is below threshold() while someone is
+ * there: a distance for echo sensors, 0/1 for motion sensors. Like
+ * PowerSensor, it is only called from one task and may block briefly.
+ */
+class OccupancySensor
+{
+public:
+    virtual ~OccupancySensor() {}
+
+    virtual bool begin() = 0;
+    virtual bool read(float &value) = 0;
+    virtual float threshold() const = 0;
+    virtual const char *name() const = 0;
+};
+
+// HC-SR04 across the room or doorway: anything nearer than rangeCm is someone
+class UltrasonicOccupancySensor : public OccupancySensor
+{
+public:
+    UltrasonicOccupancySensor(uint8_t trigPin, uint8_t echoPin, float rangeCm);
+
+    bool begin() override;
+    bool read(float &value) override;
+    float threshold() const override { return range; }
+    const char *name() const override { return "ultrasonic"; }
+
+private:
+    uint8_t trigPin;
+    uint8_t echoPin;
+    float range;
+};
+
+// PIR, or a mmWave module's presence output (e.g. the LD2410 OUT pin)
+class MotionOccupancySensor : public OccupancySensor
+{
+public:
+    MotionOccupancySensor(uint8_t pin, bool activeHigh);
+
+    bool begin() override;
+    bool read(float &value) override;
+    float threshold() const override { return 0.5f; }
+    const char *name() const override { return "motion"; }
+
+private:
+    uint8_t pin;
+    bool activeHigh;
+};
@@ -0,0 +1,339 @@
+#include "ota_update.h"
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <Preferences.h>
+#include <Update.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <esp_ota_ops.h>
+#include <rom/miniz.h>
+
+#include "config.h"
+#include "log.h"
+#include "server_ca.h"
+
+#define OTA_NAMESPACE "ota"
+#define OTA_TRIAL_KEY "trial" // Trial boots left for the running image; absent when confirmed
+#define OTA_NO_TRIAL 0xFF
+
+#define OTA_TASK_CORE 0       // Next to the network task; core 1 keeps scanning cards
+#define OTA_TASK_PRIORITY 1   // Below net (3) so acks and pings still go out mid-download
+#define OTA_TASK_STACK 6144
+#define OTA_CHUNK_SIZE 4096   // One flash sector per write
+#define OTA_READ_TIMEOUT 15000
+
+static OtaRequest pending;
+static volatile OtaState state = OTA_IDLE;
+static volatile uint8_t progress = 0;
+static const char *error = "";
+static bool onTrial = false;
+
+// Arduino's startup would otherwise confirm every new image before setup() runs
+bool verifyRollbackLater()
+{
+    return true;
+}
+
+static bool fail(const char *reason)
+{
+    error = reason;
+    state = OTA_FAILED;
+    LOG_ERROR("OTA failed: %s\n", reason);
+    return false;
+}
+
+// Inflates a zlib body chunk by chunk through the ROM's tinfl; output is written as it appears
+class OtaInflater
+{
+public:
+    OtaInflater() : inflator(nullptr), dict(nullptr), offset(0), done(false) {}
+    ~OtaInflater()
+    {
+        free(inflator);
+        free(dict);
+    }
+
+    bool begin()
+    {
+        inflator = (tinfl_decompressor *)malloc(sizeof(tinfl_decompressor));
+        dict = (uint8_t *)malloc(TINFL_LZ_DICT_SIZE);
+        if (!inflator || !dict)
+        {
+            return false;
+        }
+        tinfl_init(inflator);
+        return true;
+    }
+
+    bool write(const uint8_t *in, size_t length, bool last)
+    {
+        for (;;)
+        {
+            size_t inBytes = length;
+            size_t outBytes = TINFL_LZ_DICT_SIZE - offset;
+            uint32_t flags = TINFL_FLAG_PARSE_ZLIB_HEADER | (last ? 0 : TINFL_FLAG_HAS_MORE_INPUT);
+            tinfl_status status = tinfl_decompress(inflator, in, &inBytes, dict, dict + offset, &outBytes, flags);
+            in += inBytes;
+            length -= inBytes;
+
+            if (outBytes > 0)
+            {
+                if (Update.write(dict + offset, outBytes) != outBytes)
+                {
+                    return false;
+                }
+                offset = (offset + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+            }
+
+            if (status < TINFL_STATUS_DONE)
+            {
+                return false;
+            }
+            if (status == TINFL_STATUS_DONE)
+            {
+                done = true;
+                return length == 0;
+            }
+            if (status == TINFL_STATUS_NEEDS_MORE_INPUT)
+            {
+                return true;
+            }
+            // TINFL_STATUS_HAS_MORE_OUTPUT: the window filled up, go round again
+        }
+    }
+
+    bool finished() const { return done; }
+
+private:
+    tinfl_decompressor *inflator; // ~11 KB, too big for the task stack
+    uint8_t *dict;               // 32 KB back-reference window, also the output buffer
+    size_t offset;
+    bool done;
+};
+
+static bool download(const OtaRequest &req)
+{
+#if WS_TLS
+    WiFiClientSecure client;
+    client.setCACert(SERVER_CA_CERT);
+#else
+    WiFiClient client;
+#endif
+    HTTPClient http;
+    http.setTimeout(OTA_READ_TIMEOUT);
+    if (!http.begin(client, req.host, req.port, req.path, WS_TLS))
+    {
+        return fail("bad url");
+    }
+    http.addHeader("X-Device-Token", req.token);
+
+    int code = http.GET();
+    if (code != HTTP_CODE_OK)
+    {
+        http.end();
+        return fail(code < 0 ? "connect failed" : "http error");
+    }
+
+    int length = http.getSize();
+    if (length <= 0 || (uint32_t)length != req.size)
+    {
+        http.end();
+        return fail("size mismatch");
+    }
+
+    if (!Update.begin(req.imageSize, U_FLASH) || !Update.setMD5(req.md5))
+    {
+        http.end();
+        return fail(Update.errorString());
+    }
+
+    OtaInflater inflater;
+    if (req.zlib && !inflater.begin())
+    {
+        Update.abort();
+        http.end();
+        return fail("no memory for inflate");
+    }
+
+    static uint8_t chunk[OTA_CHUNK_SIZE];
+    WiFiClient *stream = http.getStreamPtr();
+    uint32_t received = 0;
+    unsigned long lastData = millis();
+
+    while (received < req.size)
+    {
+        int available = stream->available();
+        if (available <= 0)
+        {
+            if (!http.connected() || millis() - lastData > OTA_READ_TIMEOUT)
+            {
+                Update.abort();
+                http.end();
+                return fail("download stalled");
+            }
+            vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
+        }
+
+        size_t want = (size_t)available < sizeof(chunk) ? (size_t)available : sizeof(chunk);
+        if (want > req.size - received)
+        {
+            want = req.size - received;
+        }
+        size_t n = stream->readBytes(chunk, want);
+        received += n;
+        lastData = millis();
+
+        bool written = req.zlib ? inflater.write(chunk, n, received == req.size)
+                                : Update.write(chunk, n) == n;
+        if (!written)
+        {
+            Update.abort();
+            http.end();
+            return fail(req.zlib ? "inflate failed" : Update.errorString());
+        }
+        progress = (uint8_t)((uint64_t)received * 100 / req.size);
+
+        // Flash writes stall both cores' caches; give the other tasks room between chunks
+        taskYIELD();
+    }
+    http.end();
+
+    if (req.zlib && !inflater.finished())
+    {
+        Update.abort();
+        return fail("truncated image");
+    }
+
+    // Checks the MD5 and the image header, then selects the partition for the next boot
+    if (!Update.end())
+    {
+        return fail(Update.errorString());
+    }
+
+    Preferences prefs;
+    if (prefs.begin(OTA_NAMESPACE, false))
+    {
+        prefs.putUChar(OTA_TRIAL_KEY, OTA_TRIAL_BOOTS);
+        prefs.end();
+    }
+    state = OTA_APPLIED;
+    LOG_INFO("OTA: %s written, restart to boot it\n", req.version);
+    return true;
+}
+
+static void otaTask(void *param)
+{
+    download(pending);
+    vTaskDelete(NULL);
+}
+
+bool otaStart(const OtaRequest &request)
+{
+    if (state == OTA_DOWNLOADING || state == OTA_APPLIED)
+    {
+        return false;
+    }
+
+    pending = request;
+    progress = 0;
+    error = "";
+    state = OTA_DOWNLOADING;
+    LOG_INFO("OTA: fetching %s (%u bytes%s)\n", request.version, (unsigned)request.size,
+             request.zlib ? ", zlib" : "");
+
+    if (xTaskCreatePinnedToCore(otaTask, "ota", OTA_TASK_STACK, NULL, OTA_TASK_PRIORITY, NULL, OTA_TASK_CORE) != pdPASS)
+    {
+        return fail("no task");
+    }
+    return true;
+}
+
+OtaState otaState()
+{
+    return state;
+}
+
+uint8_t otaProgress()
+{
+    return progress;
+}
+
+const char *otaError()
+{
+    return error;
+}
+
+void otaBootCheck()
+{
+    Preferences prefs;
+    if (!prefs.begin(OTA_NAMESPACE, false))
+    {
+        return;
+    }
+
+    uint8_t left = prefs.getUChar(OTA_TRIAL_KEY, OTA_NO_TRIAL);
+    if (left == OTA_NO_TRIAL)
+    {
+        prefs.end();
+        return;
+    }
+    if (left == 0)
+    {
+        prefs.end();
+        LOG_ERROR("OTA: new image never reached the server, rolling back\n");
+        otaRollback();
+        return;
+    }
+
+    prefs.putUChar(OTA_TRIAL_KEY, left - 1);
+    prefs.end();
+    onTrial = true;
+    LOG_WARN("OTA: trial boot of %s, %u left after this one\n", FIRMWARE_VERSION, (unsigned)(left - 1));
+}
+
+bool otaOnTrial()
+{
+    return onTrial;
+}
+
+void otaMarkHealthy()
+{
+    if (!onTrial)
+    {
+        return;
+    }
+
+    Preferences prefs;
+    if (prefs.begin(OTA_NAMESPACE, false))
+    {
+        prefs.remove(OTA_TRIAL_KEY);
+        prefs.end();
+    }
+    esp_ota_mark_app_valid_cancel_rollback(); // No-op unless the bootloader tracks it too
+    onTrial = false;
+    LOG_INFO("OTA: %s confirmed\n", FIRMWARE_VERSION);
+}
+
+void otaRollback()
+{
+    Preferences prefs;
+    if (prefs.begin(OTA_NAMESPACE, false))
+    {
+        prefs.remove(OTA_TRIAL_KEY);
+        prefs.end();
+    }
+
+    // Bootloader rollback when available; otherwise point otadata at the other slot ourselves
+    if (esp_ota_check_rollback_is_possible())
+    {
+        esp_ota_mark_app_invalid_rollback_and_reboot();
+    }
+    const esp_partition_t *previous = esp_ota_get_next_update_partition(NULL);
+    if (previous && esp_ota_set_boot_partition(previous) == ESP_OK)
+    {
+        ESP.restart();
+    }
+    LOG_ERROR("OTA: no previous image to roll back to\n");
+}
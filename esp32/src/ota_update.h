@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define OTA_VERSION_LEN 24
+#define OTA_PATH_LEN 160
+
+enum OtaState
+{
+    OTA_IDLE,
+    OTA_DOWNLOADING,
+    OTA_APPLIED, // Written and verified; boots on the next restart
+    OTA_FAILED
+};
+
+// One server-pushed image, fetched over HTTP (HTTPS with WS_TLS) from the WebSocket host
+struct OtaRequest
+{
+    char version[OTA_VERSION_LEN];
+    char host[64];
+    uint16_t port;
+    char path[OTA_PATH_LEN];
+    char token[48];          // Sent as X-Device-Token
+    char md5[33];            // Of the decompressed image, as Update checks it
+    uint32_t size;           // Bytes on the wire
+    uint32_t imageSize;      // Bytes written to flash (== size unless zlib)
+    bool zlib;               // Body is a zlib stream, inflated on the fly
+};
+
+/**
+ * A/B over-the-air updates with a boot-count health check.
+ *
+ * otaStart() streams the image into the idle app partition from its own
+ * low-priority task, so the RFID and network tasks keep running; the
+ * caller polls otaState()/otaProgress() and restarts once OTA_APPLIED.
+ *
+ * The first OTA_TRIAL_BOOTS boots of a new image are on trial. The
+ * image has to reach the server (otaMarkHealthy()) within
+ * OTA_HEALTH_TIMEOUT of one of them; otaBootCheck() rolls back to the
+ * other partition when the trials run out, so an image that crashes or
+ * can't connect reverts on its own even without bootloader rollback.
+ */
+bool otaStart(const OtaRequest &request);
+
+OtaState otaState();
+uint8_t otaProgress(); // 0-100
+const char *otaError(); // Reason for OTA_FAILED
+
+// Call early in setup(): counts a trial boot and rolls back when none are left
+void otaBootCheck();
+bool otaOnTrial();
+void otaMarkHealthy();
+
+// Reboot into the previous image now
+void otaRollback();
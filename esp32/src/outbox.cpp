@@ -0,0 +1,170 @@
+#include "outbox.h"
+
+Outbox::Outbox(OutboxStore *store)
+    : head(0), count(0), store(store), droppedCount(0)
+{
+}
+
+bool Outbox::push(const OutboxEntry &entry)
+{
+    if (!durable())
+    {
+        if (count == OUTBOX_RAM_SLOTS)
+        {
+            droppedCount++;
+            return false;
+        }
+        size_t slot = (head + count) % OUTBOX_RAM_SLOTS;
+        ring[slot] = entry;
+        state[slot] = SLOT_QUEUED;
+        count++;
+        return true;
+    }
+
+    // The ring mirrors the front of the store; only extend it while it holds all of it
+    bool cached = count == store->count() && count < OUTBOX_RAM_SLOTS;
+    if (!store->append(entry))
+    {
+        droppedCount++;
+        return false;
+    }
+
+    if (cached)
+    {
+        size_t slot = (head + count) % OUTBOX_RAM_SLOTS;
+        ring[slot] = entry;
+        state[slot] = SLOT_QUEUED;
+        count++;
+    }
+    return true;
+}
+
+const OutboxEntry *Outbox::next()
+{
+    for (;;)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t slot = (head + i) % OUTBOX_RAM_SLOTS;
+            if (state[slot] == SLOT_QUEUED)
+            {
+                state[slot] = SLOT_SENT;
+                return &ring[slot];
+            }
+        }
+
+        // Everything cached is in flight; pull more in from the store if there is room
+        size_t before = count;
+        load();
+        if (count == before)
+        {
+            return nullptr;
+        }
+    }
+}
+
+bool Outbox::settle(uint32_t seq)
+{
+    int found = find(seq);
+    if (found < 0)
+    {
+        return false;
+    }
+    state[found] = SLOT_SETTLED;
+
+    // Drop the settled run at the front, from the store as well
+    size_t settled = 0;
+    while (count > 0 && state[head] == SLOT_SETTLED)
+    {
+        head = (head + 1) % OUTBOX_RAM_SLOTS;
+        count--;
+        settled++;
+    }
+    if (count == 0)
+    {
+        head = 0;
+    }
+    if (settled > 0 && durable())
+    {
+        store->drop(settled);
+    }
+    return true;
+}
+
+void Outbox::requeue(uint32_t seq)
+{
+    int found = find(seq);
+    if (found >= 0 && state[found] == SLOT_SENT)
+    {
+        state[found] = SLOT_QUEUED;
+    }
+}
+
+void Outbox::requeueAll()
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t slot = (head + i) % OUTBOX_RAM_SLOTS;
+        if (state[slot] == SLOT_SENT)
+        {
+            state[slot] = SLOT_QUEUED;
+        }
+    }
+}
+
+size_t Outbox::size() const
+{
+    size_t settled = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (state[(head + i) % OUTBOX_RAM_SLOTS] == SLOT_SETTLED)
+        {
+            settled++;
+        }
+    }
+    return (durable() ? store->count() : count) - settled;
+}
+
+int Outbox::find(uint32_t seq) const
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t slot = (head + i) % OUTBOX_RAM_SLOTS;
+        if (ring[slot].seq == seq && state[slot] != SLOT_SETTLED)
+        {
+            return (int)slot;
+        }
+    }
+    return -1;
+}
+
+void Outbox::load()
+{
+    if (!durable())
+    {
+        return;
+    }
+
+    size_t stored = store->count();
+    while (count < OUTBOX_RAM_SLOTS && count < stored)
+    {
+        // Read into the contiguous free run after the tail, wrapping once if needed
+        size_t tail = (head + count) % OUTBOX_RAM_SLOTS;
+        size_t room = OUTBOX_RAM_SLOTS - tail;
+        if (room > OUTBOX_RAM_SLOTS - count)
+        {
+            room = OUTBOX_RAM_SLOTS - count;
+        }
+
+        size_t got = store->read(count, &ring[tail], room);
+        if (got == 0)
+        {
+            return;
+        }
+        for (size_t i = 0; i < got; i++)
+        {
+            state[tail + i] = SLOT_QUEUED;
+        }
+        count += got;
+    }
+}
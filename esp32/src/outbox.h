@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "card_payload.h"
+#include "civil_time.h"
+#include "rfid_debounce.h"
+
+// Front of the outbox cached in RAM; the rest is read back from flash as it drains
+#define OUTBOX_RAM_SLOTS 16
+
+/**
+ * One attendance tap waiting to be delivered to the server.
+ * Kept fixed-size so it can be copied into queues and flash as-is.
+ */
+struct OutboxEntry
+{
+    char rfidUid[RFID_UID_MAX_LEN];
+    char timestamp[ISO_TIMESTAMP_LEN]; // Local NTP time of the tap, "" if unsynced
+    uint8_t reader;                    // Index into the reader table (fills former padding)
+    float power;
+    uint32_t seq;                      // Per-device request number, echoed by the server; 0 = none
+    int64_t deviceMs;                  // Epoch ms of the scan (DeviceClock), 0 if unsynced
+    char cardId[CARD_ID_LEN];          // ID read from the card's payload sector, "" if none
+};
+
+/**
+ * Durable storage behind the outbox. Entries are read in the order they
+ * were appended and stay stored until dropped from the front.
+ */
+class OutboxStore
+{
+public:
+    virtual ~OutboxStore() {}
+
+    // False while the backing storage is unusable; the outbox then runs from RAM
+    virtual bool available() const = 0;
+    virtual bool append(const OutboxEntry &entry) = 0;
+    // Copies up to max entries starting offset entries from the front, without removing them
+    virtual size_t read(size_t offset, OutboxEntry *out, size_t max) = 0;
+    // Forgets the n oldest entries once they are delivered
+    virtual void drop(size_t n) = 0;
+    virtual size_t count() const = 0;
+};
+
+/**
+ * Bounded FIFO of undelivered taps. Every entry is written to the store
+ * when pushed and only leaves it once the server has acknowledged it, so
+ * a reboot loses nothing that was queued. The oldest OUTBOX_RAM_SLOTS
+ * entries are cached in RAM; without a usable store the ring is the
+ * whole queue.
+ *
+ * next() hands out entries to send and marks them in flight; settle()
+ * removes one by seq when acked, requeue() makes it sendable again.
+ * Acks may arrive out of order; the store front only moves past an
+ * entry once everything older is settled as well.
+ */
+class Outbox
+{
+public:
+    explicit Outbox(OutboxStore *store = nullptr);
+
+    // Returns false if the entry had to be dropped (outbox full)
+    bool push(const OutboxEntry &entry);
+
+    // Oldest entry not yet in flight, or nullptr; the entry stays queued until settled
+    const OutboxEntry *next();
+
+    // Delivered: false if no entry has this seq
+    bool settle(uint32_t seq);
+    // Unanswered: send the entry with this seq again
+    void requeue(uint32_t seq);
+    // Connection lost: everything in flight goes out again
+    void requeueAll();
+
+    size_t size() const;
+    bool empty() const { return size() == 0; }
+    uint32_t dropped() const { return droppedCount; }
+
+private:
+    enum SlotState
+    {
+        SLOT_QUEUED,
+        SLOT_SENT,
+        SLOT_SETTLED
+    };
+
+    bool durable() const { return store && store->available(); }
+    int find(uint32_t seq) const;
+    void load();
+
+    OutboxEntry ring[OUTBOX_RAM_SLOTS];
+    uint8_t state[OUTBOX_RAM_SLOTS];
+    size_t head;
+    size_t count;
+    OutboxStore *store;
+    uint32_t droppedCount;
+};
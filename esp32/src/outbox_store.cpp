@@ -0,0 +1,220 @@
+#include "outbox_store.h"
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#include "log.h"
+
+LittleFsOutboxStore::LittleFsOutboxStore(const char *dataPath, const char *cursorPath, const char *compactPath,
+                                         size_t maxEntries)
+    : dataPath(dataPath), cursorPath(cursorPath), compactPath(compactPath), maxEntries(maxEntries),
+      cursor(0), pending(0), mounted(false)
+{
+}
+
+bool LittleFsOutboxStore::begin()
+{
+    mounted = LittleFS.begin(true);
+    if (!mounted)
+    {
+        LOG_WARN("Outbox: LittleFS mount failed, offline taps limited to RAM\n");
+        return false;
+    }
+    LittleFS.remove(compactPath); // Left by a compaction cut short; the data file is still whole
+
+    size_t records = 0;
+    File data = LittleFS.open(dataPath, "r");
+    if (data)
+    {
+        records = data.size() / sizeof(OutboxEntry);
+        data.close();
+    }
+
+    uint32_t saved = 0;
+    File idx = LittleFS.open(cursorPath, "r");
+    if (idx)
+    {
+        idx.read((uint8_t *)&saved, sizeof(saved));
+        idx.close();
+    }
+
+    cursor = saved <= records ? saved : records;
+    pending = records - cursor;
+
+    if (pending > 0)
+    {
+        LOG_INFO("Outbox: %u offline taps restored from flash\n", (unsigned)pending);
+    }
+    return true;
+}
+
+size_t LittleFsOutboxStore::import(const char *oldDataPath, const char *oldCursorPath, size_t recordSize)
+{
+    if (!mounted || recordSize > sizeof(OutboxEntry))
+    {
+        return 0;
+    }
+
+    size_t imported = 0;
+    File data = LittleFS.open(oldDataPath, "r");
+    if (data)
+    {
+        uint32_t delivered = 0;
+        File idx = LittleFS.open(oldCursorPath, "r");
+        if (idx)
+        {
+            idx.read((uint8_t *)&delivered, sizeof(delivered));
+            idx.close();
+        }
+
+        size_t records = data.size() / recordSize;
+        data.seek((delivered <= records ? delivered : records) * recordSize);
+
+        OutboxEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        while (data.read((uint8_t *)&entry, recordSize) == recordSize)
+        {
+            if (!append(entry))
+            {
+                break;
+            }
+            imported++;
+        }
+        data.close();
+    }
+
+    LittleFS.remove(oldDataPath);
+    LittleFS.remove(oldCursorPath);
+    if (imported > 0)
+    {
+        LOG_INFO("Outbox: %u offline taps carried over from %s\n", (unsigned)imported, oldDataPath);
+    }
+    return imported;
+}
+
+bool LittleFsOutboxStore::append(const OutboxEntry &entry)
+{
+    if (!mounted || pending >= maxEntries)
+    {
+        return false;
+    }
+
+    File data = LittleFS.open(dataPath, "a");
+    if (!data)
+    {
+        return false;
+    }
+    size_t written = data.write((const uint8_t *)&entry, sizeof(entry));
+    data.close();
+
+    if (written != sizeof(entry))
+    {
+        return false;
+    }
+    pending++;
+    return true;
+}
+
+size_t LittleFsOutboxStore::read(size_t offset, OutboxEntry *out, size_t max)
+{
+    if (!mounted || offset >= pending)
+    {
+        return 0;
+    }
+
+    File data = LittleFS.open(dataPath, "r");
+    if (!data)
+    {
+        return 0;
+    }
+
+    size_t n = pending - offset < max ? pending - offset : max;
+    data.seek((cursor + offset) * sizeof(OutboxEntry));
+    size_t got = data.read((uint8_t *)out, n * sizeof(OutboxEntry)) / sizeof(OutboxEntry);
+    data.close();
+    return got;
+}
+
+void LittleFsOutboxStore::drop(size_t n)
+{
+    if (!mounted || n == 0)
+    {
+        return;
+    }
+
+    n = n < pending ? n : pending;
+    cursor += n;
+    pending -= n;
+
+    if (pending == 0)
+    {
+        // Everything acknowledged: start the next outage with an empty file
+        LittleFS.remove(dataPath);
+        LittleFS.remove(cursorPath);
+        cursor = 0;
+    }
+    else if (cursor >= maxEntries)
+    {
+        compact();
+    }
+    else
+    {
+        saveCursor();
+    }
+}
+
+void LittleFsOutboxStore::compact()
+{
+    File data = LittleFS.open(dataPath, "r");
+    File fresh = LittleFS.open(compactPath, "w");
+    bool copied = data && fresh && data.seek(cursor * sizeof(OutboxEntry));
+
+    OutboxEntry entry;
+    for (size_t i = 0; copied && i < pending; i++)
+    {
+        copied = data.read((uint8_t *)&entry, sizeof(entry)) == sizeof(entry) &&
+                 fresh.write((const uint8_t *)&entry, sizeof(entry)) == sizeof(entry);
+    }
+    if (data)
+    {
+        data.close();
+    }
+    if (fresh)
+    {
+        fresh.close();
+    }
+
+    if (!copied)
+    {
+        // Keep appending to the old file; the next drop tries again
+        LOG_WARN("Outbox: compaction failed, %u records still acknowledged ahead\n", (unsigned)cursor);
+        LittleFS.remove(compactPath);
+        saveCursor();
+        return;
+    }
+
+    // Cursor first: a reset before the rename replays acknowledged taps, which
+    // the server drops as duplicates, instead of skipping unacknowledged ones
+    size_t acknowledged = cursor;
+    cursor = 0;
+    saveCursor();
+    if (!LittleFS.rename(compactPath, dataPath))
+    {
+        LOG_WARN("Outbox: compaction rename failed\n");
+        LittleFS.remove(compactPath);
+        cursor = acknowledged;
+        saveCursor();
+    }
+}
+
+void LittleFsOutboxStore::saveCursor()
+{
+    File idx = LittleFS.open(cursorPath, "w");
+    if (!idx)
+    {
+        return;
+    }
+    uint32_t value = cursor;
+    idx.write((const uint8_t *)&value, sizeof(value));
+    idx.close();
+}
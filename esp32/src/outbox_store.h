@@ -0,0 +1,41 @@
+#pragma once
+
+#include "outbox.h"
+
+/**
+ * Outbox store backed by a LittleFS file of fixed-size records.
+ * A small cursor file remembers how many records have been acknowledged
+ * so the rest survive a reboot. Once maxEntries records have been
+ * acknowledged the unacknowledged tail is copied into a fresh file, so
+ * partial drains during a long outage can't grow the file without bound.
+ */
+class LittleFsOutboxStore : public OutboxStore
+{
+public:
+    LittleFsOutboxStore(const char *dataPath, const char *cursorPath, const char *compactPath, size_t maxEntries);
+
+    // Mounts LittleFS (formatting on first use) and loads existing entries
+    bool begin();
+
+    // Appends the undelivered records of an older layout whose records are the first
+    // recordSize bytes of an OutboxEntry (the rest zeroed), then removes its files
+    size_t import(const char *oldDataPath, const char *oldCursorPath, size_t recordSize);
+
+    bool available() const override { return mounted; }
+    bool append(const OutboxEntry &entry) override;
+    size_t read(size_t offset, OutboxEntry *out, size_t max) override;
+    void drop(size_t n) override;
+    size_t count() const override { return pending; }
+
+private:
+    void saveCursor();
+    void compact();
+
+    const char *dataPath;
+    const char *cursorPath;
+    const char *compactPath; // Scratch file compact() copies the tail into
+    size_t maxEntries;
+    size_t cursor;  // Records already acknowledged from the start of the file
+    size_t pending; // Records after the cursor
+    bool mounted;
+};
@@ -0,0 +1,115 @@
+#include "pending_taps.h"
+
+PendingTaps::PendingTaps(uint32_t timeoutMs, uint8_t maxAttempts)
+    : count(0), timeout(timeoutMs), maxAttempts(maxAttempts), retryCount(0)
+{
+    for (size_t i = 0; i < PENDING_TAP_SLOTS; i++)
+    {
+        slots[i].used = false;
+    }
+}
+
+bool PendingTaps::track(const OutboxEntry &tap, bool live, unsigned long nowMs, int64_t sentUs)
+{
+    for (size_t i = 0; i < PENDING_TAP_SLOTS; i++)
+    {
+        Slot &slot = slots[i];
+        if (!slot.used)
+        {
+            slot.tap = tap;
+            slot.sentUs = sentUs;
+            slot.deadline = nowMs + timeout;
+            slot.attempts = 1;
+            slot.rejections = 0;
+            slot.live = live;
+            slot.used = true;
+            count++;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PendingTaps::resolve(uint32_t seq, int64_t &sentUs, bool &live)
+{
+    for (size_t i = 0; i < PENDING_TAP_SLOTS; i++)
+    {
+        Slot &slot = slots[i];
+        if (slot.used && slot.tap.seq == seq)
+        {
+            sentUs = slot.sentUs;
+            live = slot.live;
+            release(slot);
+            return true;
+        }
+    }
+    return false;
+}
+
+uint8_t PendingTaps::reject(uint32_t seq)
+{
+    for (size_t i = 0; i < PENDING_TAP_SLOTS; i++)
+    {
+        Slot &slot = slots[i];
+        if (slot.used && slot.tap.seq == seq)
+        {
+            return ++slot.rejections;
+        }
+    }
+    return 0;
+}
+
+PendingAction PendingTaps::poll(unsigned long nowMs, OutboxEntry &out, bool &live)
+{
+    for (size_t i = 0; i < PENDING_TAP_SLOTS; i++)
+    {
+        Slot &slot = slots[i];
+        if (!slot.used || (long)(nowMs - slot.deadline) < 0)
+        {
+            continue;
+        }
+
+        out = slot.tap;
+        live = slot.live;
+        if (slot.attempts >= maxAttempts)
+        {
+            release(slot);
+            return PENDING_EXPIRED;
+        }
+
+        // Same timeout again; the reconnect backoff already spaces out real outages
+        slot.attempts++;
+        slot.deadline = nowMs + timeout;
+        retryCount++;
+        return PENDING_RETRY;
+    }
+    return PENDING_NONE;
+}
+
+bool PendingTaps::takeOldest(OutboxEntry &out, bool &live)
+{
+    Slot *oldest = nullptr;
+    for (size_t i = 0; i < PENDING_TAP_SLOTS; i++)
+    {
+        Slot &slot = slots[i];
+        if (slot.used && (!oldest || (int32_t)(slot.tap.seq - oldest->tap.seq) < 0))
+        {
+            oldest = &slot;
+        }
+    }
+
+    if (!oldest)
+    {
+        return false;
+    }
+    out = oldest->tap;
+    live = oldest->live;
+    release(*oldest);
+    return true;
+}
+
+void PendingTaps::release(Slot &slot)
+{
+    slot.used = false;
+    count--;
+}
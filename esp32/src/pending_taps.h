@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "outbox.h"
+
+// Taps sent but not yet answered by the server
+#define PENDING_TAP_SLOTS 8
+
+enum PendingAction
+{
+    PENDING_NONE,
+    PENDING_RETRY,  // Resend the copied-out tap with the same seq
+    PENDING_EXPIRED // Out of attempts; the tap was removed and belongs back in the outbox
+};
+
+/**
+ * Sent taps waiting for the server to answer their seq.
+ *
+ * A live tap is answered by its attendance verdict, a replayed outbox
+ * tap by its status ack; until then it sits here with a deadline.
+ * poll() hands back one overdue tap per call, to resend with the same
+ * seq (the server replays its first verdict instead of recording it
+ * twice) or, after maxAttempts sends, to put back in the outbox.
+ * Owned by one task; no locking.
+ */
+class PendingTaps
+{
+public:
+    PendingTaps(uint32_t timeoutMs, uint8_t maxAttempts);
+
+    // False when every slot is taken; the caller keeps the tap in the outbox
+    bool track(const OutboxEntry &tap, bool live, unsigned long nowMs, int64_t sentUs);
+
+    // Removes the tap with this seq; sentUs is when it was first sent
+    bool resolve(uint32_t seq, int64_t &sentUs, bool &live);
+
+    // Counts an error reply for this seq; returns the count so far, 0 if it isn't pending
+    uint8_t reject(uint32_t seq);
+
+    PendingAction poll(unsigned long nowMs, OutboxEntry &out, bool &live);
+
+    // Removes the oldest tap (by seq) into out, e.g. to requeue all after a disconnect
+    bool takeOldest(OutboxEntry &out, bool &live);
+
+    size_t size() const { return count; }
+    bool full() const { return count == PENDING_TAP_SLOTS; }
+    uint32_t retries() const { return retryCount; }
+
+private:
+    struct Slot
+    {
+        OutboxEntry tap;
+        int64_t sentUs;
+        unsigned long deadline;
+        uint8_t attempts;
+        uint8_t rejections;
+        bool live;
+        bool used;
+    };
+
+    void release(Slot &slot);
+
+    Slot slots[PENDING_TAP_SLOTS];
+    size_t count;
+    uint32_t timeout;
+    uint8_t maxAttempts;
+    uint32_t retryCount;
+};
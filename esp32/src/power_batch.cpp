@@ -0,0 +1,64 @@
+#include "power_batch.h"
+
+#include <math.h>
+
+PowerBatch::PowerBatch()
+{
+    clear();
+}
+
+void PowerBatch::add(float watts)
+{
+    if (count == POWER_BATCH_SLOTS)
+    {
+        // Overwrite the oldest sample if nobody flushed in time
+        head = (head + 1) % POWER_BATCH_SLOTS;
+        count--;
+    }
+    samples[(head + count) % POWER_BATCH_SLOTS] = watts;
+    count++;
+}
+
+void PowerBatch::clear()
+{
+    head = 0;
+    count = 0;
+}
+
+PowerStats PowerBatch::stats() const
+{
+    PowerStats s = {0, 0, 0, 0, count};
+    if (count == 0)
+    {
+        return s;
+    }
+
+    float sum = 0;
+    s.min = s.max = samples[head];
+    for (size_t i = 0; i < count; i++)
+    {
+        float w = samples[(head + i) % POWER_BATCH_SLOTS];
+        if (w < s.min)
+            s.min = w;
+        if (w > s.max)
+            s.max = w;
+        sum += w;
+    }
+    s.mean = sum / count;
+    s.last = samples[(head + count - 1) % POWER_BATCH_SLOTS];
+    return s;
+}
+
+size_t PowerBatch::deltas(int32_t *out, size_t max) const
+{
+    size_t n = count < max ? count : max;
+    int32_t previous = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        int32_t q = (int32_t)lroundf(samples[(head + i) % POWER_BATCH_SLOTS] * POWER_SAMPLE_SCALE);
+        out[i] = q - previous;
+        previous = q;
+    }
+    return n;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Samples held between flushes (10 s at 5 Hz = 50); the oldest are dropped beyond this
+#define POWER_BATCH_SLOTS 64
+
+// Samples are sent as integers in 1/POWER_SAMPLE_SCALE watt steps (0.1 W)
+#define POWER_SAMPLE_SCALE 10
+
+struct PowerStats
+{
+    float min;
+    float max;
+    float mean;
+    float last;
+    size_t count;
+};
+
+/**
+ * Ring buffer of power samples collected between telemetry frames.
+ *
+ * The frame carries summary statistics plus the samples themselves,
+ * delta-encoded as scaled integers: the first value is absolute and
+ * each following value is the difference from the previous one. With a
+ * slowly changing load most deltas are 0 or a couple of digits.
+ */
+class PowerBatch
+{
+public:
+    PowerBatch();
+
+    void add(float watts);
+    void clear();
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // Only meaningful when !empty()
+    PowerStats stats() const;
+
+    // Writes up to max delta-encoded samples, oldest first; returns how many
+    size_t deltas(int32_t *out, size_t max) const;
+
+private:
+    float samples[POWER_BATCH_SLOTS];
+    size_t head;
+    size_t count;
+};
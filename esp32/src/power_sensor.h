@@ -0,0 +1,21 @@
+#pragma once
+
+/**
+ * Source of instantaneous power readings for sensorTask.
+ *
+ * read() is only ever called from sensorTask, once per
+ * POWER_SAMPLE_INTERVAL, and may block for up to about that long while
+ * the driver waits on its bus or DMA. Nothing else waits on it.
+ */
+class PowerSensor
+{
+public:
+    virtual ~PowerSensor() {}
+
+    virtual bool begin() = 0;
+
+    // false = no valid reading this time (bus timeout, bad frame); the sample is skipped
+    virtual bool read(float &watts) = 0;
+
+    virtual const char *name() const = 0;
+};
@@ -0,0 +1,79 @@
+#include "pzem_sensor.h"
+
+#include <Arduino.h>
+
+#define PZEM_BAUD 9600
+#define PZEM_TIMEOUT 100 // ms; a reply normally takes ~30 ms at 9600 baud
+
+#define PZEM_READ_INPUT 0x04
+#define PZEM_REGISTERS 10 // voltage, current (2), power (2), energy (2), frequency, pf, alarm
+#define PZEM_REPLY_SIZE (3 + PZEM_REGISTERS * 2 + 2)
+
+PzemPowerSensor::PzemPowerSensor(HardwareSerial &port, int8_t rxPin, int8_t txPin, uint8_t address)
+    : port(port), rxPin(rxPin), txPin(txPin), address(address), volts(0), amps(0), pf(0)
+{
+}
+
+bool PzemPowerSensor::begin()
+{
+    port.begin(PZEM_BAUD, SERIAL_8N1, rxPin, txPin);
+    port.setTimeout(PZEM_TIMEOUT);
+    return true;
+}
+
+bool PzemPowerSensor::read(float &watts)
+{
+    uint8_t request[8] = {address, PZEM_READ_INPUT, 0x00, 0x00, 0x00, PZEM_REGISTERS, 0, 0};
+    uint16_t crc = crc16(request, 6);
+    request[6] = crc & 0xFF;
+    request[7] = crc >> 8;
+
+    // Drop any half reply left over from a timed-out request
+    while (port.available())
+    {
+        port.read();
+    }
+    port.write(request, sizeof(request));
+
+    uint8_t reply[PZEM_REPLY_SIZE];
+    if (port.readBytes(reply, sizeof(reply)) != sizeof(reply))
+    {
+        return false;
+    }
+
+    uint16_t replyCrc = reply[PZEM_REPLY_SIZE - 2] | (reply[PZEM_REPLY_SIZE - 1] << 8);
+    if (reply[1] != PZEM_READ_INPUT || reply[2] != PZEM_REGISTERS * 2 ||
+        crc16(reply, PZEM_REPLY_SIZE - 2) != replyCrc)
+    {
+        return false;
+    }
+
+    // Registers are big-endian; 32-bit values are sent low word first
+    const uint8_t *r = reply + 3;
+    uint16_t regs[PZEM_REGISTERS];
+    for (size_t i = 0; i < PZEM_REGISTERS; i++)
+    {
+        regs[i] = (r[i * 2] << 8) | r[i * 2 + 1];
+    }
+
+    volts = regs[0] * 0.1f;
+    amps = (regs[1] | ((uint32_t)regs[2] << 16)) * 0.001f;
+    watts = (regs[3] | ((uint32_t)regs[4] << 16)) * 0.1f;
+    pf = regs[8] * 0.01f;
+    return true;
+}
+
+// Modbus CRC-16 (poly 0xA001, init 0xFFFF)
+uint16_t PzemPowerSensor::crc16(const uint8_t *data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+    }
+    return crc;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "power_sensor.h"
+
+class HardwareSerial;
+
+/**
+ * PZEM-004T v3.0 energy meter over its Modbus-RTU UART (9600 8N1).
+ *
+ * Each read() sends one "read input registers" request and waits up to
+ * PZEM_TIMEOUT for the 25-byte reply. voltage(), current() and
+ * powerFactor() hold the values from the last good reply.
+ */
+class PzemPowerSensor : public PowerSensor
+{
+public:
+    PzemPowerSensor(HardwareSerial &port, int8_t rxPin, int8_t txPin, uint8_t address = 0xF8);
+
+    bool begin() override;
+    bool read(float &watts) override;
+    const char *name() const override { return "PZEM-004T"; }
+
+    float voltage() const { return volts; }
+    float current() const { return amps; }
+    float powerFactor() const { return pf; }
+
+private:
+    static uint16_t crc16(const uint8_t *data, size_t length);
+
+    HardwareSerial &port;
+    int8_t rxPin;
+    int8_t txPin;
+    uint8_t address;
+    float volts;
+    float amps;
+    float pf;
+};
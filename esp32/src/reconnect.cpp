@@ -0,0 +1,66 @@
+#include "reconnect.h"
+
+ReconnectScheduler::ReconnectScheduler(uint32_t attemptWindowMs, uint32_t firstMs, uint32_t initialMs, uint32_t maxMs)
+    : state(SCHED_WAITING), backoff(initialMs, maxMs, firstMs), attemptWindow(attemptWindowMs),
+      nextAttemptAt(0), attemptStartedAt(0)
+{
+    stats.attempts = 0;
+    stats.failures = 0;
+    stats.connects = 0;
+    stats.disconnects = 0;
+    stats.lastDelay = 0;
+}
+
+ReconnectAction ReconnectScheduler::poll(unsigned long now, bool linkUp, uint32_t entropy)
+{
+    switch (state)
+    {
+    case SCHED_CONNECTED:
+        return RECONNECT_POLL;
+
+    case SCHED_ATTEMPTING:
+        if (now - attemptStartedAt < attemptWindow)
+        {
+            return RECONNECT_POLL;
+        }
+        stats.failures++;
+        schedule(now, entropy);
+        return RECONNECT_ABORT;
+
+    case SCHED_WAITING:
+    default:
+        if (!linkUp || (long)(now - nextAttemptAt) < 0)
+        {
+            return RECONNECT_IDLE;
+        }
+        state = SCHED_ATTEMPTING;
+        attemptStartedAt = now;
+        stats.attempts++;
+        return RECONNECT_POLL;
+    }
+}
+
+void ReconnectScheduler::connected()
+{
+    state = SCHED_CONNECTED;
+    backoff.reset();
+    stats.connects++;
+}
+
+void ReconnectScheduler::disconnected(unsigned long now, uint32_t entropy)
+{
+    // Drops reported while we were not connected are the tail of an aborted attempt
+    if (state != SCHED_CONNECTED)
+    {
+        return;
+    }
+    stats.disconnects++;
+    schedule(now, entropy);
+}
+
+void ReconnectScheduler::schedule(unsigned long now, uint32_t entropy)
+{
+    stats.lastDelay = backoff.nextJittered(entropy);
+    nextAttemptAt = now + stats.lastDelay;
+    state = SCHED_WAITING;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "backoff.h"
+
+enum ReconnectAction
+{
+    RECONNECT_IDLE,  // Waiting out the backoff; leave the client alone
+    RECONNECT_POLL,  // Connected or attempting; run the client's loop()
+    RECONNECT_ABORT  // The attempt ran out of time; drop it
+};
+
+struct ReconnectCounters
+{
+    uint32_t attempts;
+    uint32_t failures;
+    uint32_t connects;
+    uint32_t disconnects;
+    uint32_t lastDelay; // ms waited before the latest attempt
+};
+
+/**
+ * Decides when a client that reconnects from inside its own loop()
+ * may try again.
+ *
+ * Between attempts the client's loop() is not called at all, so it
+ * cannot retry behind our back. Once the backoff has elapsed poll()
+ * returns RECONNECT_POLL for up to attemptWindow ms; connected()
+ * during that time ends the attempt successfully, otherwise it is
+ * counted as a failure and the next delay is drawn from the backoff.
+ */
+class ReconnectScheduler
+{
+public:
+    ReconnectScheduler(uint32_t attemptWindowMs, uint32_t firstMs, uint32_t initialMs, uint32_t maxMs);
+
+    // linkUp = the network underneath is usable; no attempts are started without it
+    ReconnectAction poll(unsigned long now, bool linkUp, uint32_t entropy);
+
+    void connected();
+    void disconnected(unsigned long now, uint32_t entropy);
+
+    bool isConnected() const { return state == SCHED_CONNECTED; }
+    uint32_t streak() const { return backoff.failures(); }
+    const ReconnectCounters &counters() const { return stats; }
+
+private:
+    enum State
+    {
+        SCHED_WAITING,
+        SCHED_ATTEMPTING,
+        SCHED_CONNECTED
+    };
+
+    void schedule(unsigned long now, uint32_t entropy);
+
+    State state;
+    Backoff backoff;
+    uint32_t attemptWindow;
+    unsigned long nextAttemptAt;
+    unsigned long attemptStartedAt;
+    ReconnectCounters stats;
+};
@@ -0,0 +1,53 @@
+#include "rfid_debounce.h"
+
+#include <string.h>
+
+UidDebouncer::UidDebouncer(uint32_t holdMs) : holdMs(holdMs)
+{
+    clear();
+}
+
+void UidDebouncer::clear()
+{
+    memset(entries, 0, sizeof(entries));
+}
+
+bool UidDebouncer::accept(const char *uid, uint32_t now)
+{
+    Entry *slot = nullptr;
+
+    for (size_t i = 0; i < SLOTS; i++)
+    {
+        Entry &e = entries[i];
+
+        // Expire stale entries as we go (unsigned math is rollover-safe)
+        if (e.used && now - e.seenAt >= holdMs)
+        {
+            e.used = false;
+        }
+
+        if (e.used && strncmp(e.uid, uid, RFID_UID_MAX_LEN) == 0)
+        {
+            return false; // Same card still inside its hold window
+        }
+
+        // Prefer a free slot, otherwise evict the oldest entry
+        if (!e.used)
+        {
+            if (!slot || slot->used)
+            {
+                slot = &e;
+            }
+        }
+        else if (!slot || (slot->used && now - e.seenAt > now - slot->seenAt))
+        {
+            slot = &e;
+        }
+    }
+
+    strncpy(slot->uid, uid, RFID_UID_MAX_LEN - 1);
+    slot->uid[RFID_UID_MAX_LEN - 1] = '\0';
+    slot->seenAt = now;
+    slot->used = true;
+    return true;
+}
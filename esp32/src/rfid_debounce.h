@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest UID string: 10 UID bytes as hex + terminator
+#define RFID_UID_MAX_LEN 21
+
+/**
+ * Per-UID "recently seen" table for RFID debouncing.
+ *
+ * A card is accepted once and then suppressed until holdMs has elapsed
+ * since that accepted read. Other cards are tracked independently, so a
+ * second teacher tapping right after the first is not delayed.
+ */
+class UidDebouncer
+{
+public:
+    explicit UidDebouncer(uint32_t holdMs);
+
+    // Returns true if uid should be processed, false if it is a repeat
+    bool accept(const char *uid, uint32_t now);
+    void clear();
+
+private:
+    static const size_t SLOTS = 8;
+
+    struct Entry
+    {
+        char uid[RFID_UID_MAX_LEN];
+        uint32_t seenAt;
+        bool used;
+    };
+
+    Entry entries[SLOTS];
+    uint32_t holdMs;
+};
@@ -0,0 +1,34 @@
+#include "ring_log.h"
+
+RingLog::RingLog()
+{
+    clear();
+}
+
+void RingLog::record(uint32_t now, uint16_t event, int32_t value)
+{
+    RingLogEntry &entry = entries[head];
+    entry.timeMs = now;
+    entry.event = event;
+    entry.value = value;
+
+    head = (head + 1) % RING_LOG_CAPACITY;
+    if (count < RING_LOG_CAPACITY)
+    {
+        count++;
+    }
+    recorded++;
+}
+
+void RingLog::clear()
+{
+    head = 0;
+    count = 0;
+    recorded = 0;
+}
+
+const RingLogEntry &RingLog::at(size_t index) const
+{
+    size_t oldest = (head + RING_LOG_CAPACITY - count) % RING_LOG_CAPACITY;
+    return entries[(oldest + index) % RING_LOG_CAPACITY];
+}
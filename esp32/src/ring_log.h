@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RING_LOG_CAPACITY 64
+
+struct RingLogEntry
+{
+    uint32_t timeMs;
+    uint16_t event; // Caller-defined code; names are resolved when dumping
+    int32_t value;
+};
+
+/**
+ * Fixed-size binary event log that keeps the most recent entries.
+ *
+ * Recording is a few stores with no formatting or I/O, cheap enough
+ * for the RFID and network paths even when text logging is compiled
+ * out. Entries are turned into text only when someone asks for them.
+ * Not thread-safe; callers that share one log serialise access.
+ */
+class RingLog
+{
+public:
+    RingLog();
+
+    void record(uint32_t now, uint16_t event, int32_t value);
+    void clear();
+
+    size_t size() const { return count; }
+
+    // index 0 is the oldest entry still held
+    const RingLogEntry &at(size_t index) const;
+
+    // Entries ever recorded, including those since overwritten
+    uint32_t total() const { return recorded; }
+
+private:
+    RingLogEntry entries[RING_LOG_CAPACITY];
+    size_t head; // Next slot to write
+    size_t count;
+    uint32_t recorded;
+};
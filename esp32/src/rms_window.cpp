@@ -0,0 +1,35 @@
+#include "rms_window.h"
+
+#include <math.h>
+
+RmsWindow::RmsWindow(size_t samples)
+    : target(samples), result(0)
+{
+    reset();
+}
+
+bool RmsWindow::add(uint16_t raw)
+{
+    sum += raw;
+    sumSquares += (uint64_t)raw * raw;
+    n++;
+
+    if (n < target)
+    {
+        return false;
+    }
+
+    double mean = (double)sum / n;
+    double variance = (double)sumSquares / n - mean * mean;
+    result = variance > 0 ? (float)sqrt(variance) : 0;
+
+    reset();
+    return true;
+}
+
+void RmsWindow::reset()
+{
+    n = 0;
+    sum = 0;
+    sumSquares = 0;
+}
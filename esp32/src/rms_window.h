@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * True RMS of raw ADC samples over a fixed window, with the DC bias
+ * (the CT burden sits at mid-rail) removed.
+ *
+ * Size the window to a whole number of mains cycles; otherwise the
+ * partial cycle at the end makes the result ripple from window to
+ * window. Sums are kept in 64-bit integers, so the variance
+ * E[x^2] - E[x]^2 stays exact for any window up to millions of 12-bit
+ * samples.
+ */
+class RmsWindow
+{
+public:
+    explicit RmsWindow(size_t samples);
+
+    // Returns true when this sample completed a window; rms() then holds its result
+    bool add(uint16_t raw);
+    void reset();
+
+    // RMS of the last completed window, in ADC counts
+    float rms() const { return result; }
+
+private:
+    size_t target;
+    size_t n;
+    int64_t sum;
+    uint64_t sumSquares;
+    float result;
+};
@@ -0,0 +1,62 @@
+#include "sequence_store.h"
+
+#include <Preferences.h>
+
+#include "log.h"
+
+#define SEQUENCE_NAMESPACE "seq"
+#define SEQUENCE_KEY "next"
+#define SEQUENCE_BLOCK 1024
+
+SequenceStore::SequenceStore()
+    : nextValue(1), reservedUntil(1)
+{
+}
+
+bool SequenceStore::begin()
+{
+    Preferences prefs;
+    if (prefs.begin(SEQUENCE_NAMESPACE, true))
+    {
+        nextValue = prefs.getUInt(SEQUENCE_KEY, 1);
+        prefs.end();
+    }
+    if (nextValue == 0)
+    {
+        nextValue = 1;
+    }
+    reservedUntil = nextValue;
+    return reserve();
+}
+
+uint32_t SequenceStore::next()
+{
+    if (nextValue == reservedUntil)
+    {
+        reserve(); // Keep counting even if the save fails; only a reboot could then repeat a number
+    }
+
+    uint32_t seq = nextValue++;
+    if (nextValue == 0)
+    {
+        nextValue = 1;
+    }
+    return seq;
+}
+
+bool SequenceStore::reserve()
+{
+    Preferences prefs;
+    if (!prefs.begin(SEQUENCE_NAMESPACE, false))
+    {
+        LOG_WARN("Sequence: NVS unavailable, numbers restart on reboot\n");
+        reservedUntil = nextValue + SEQUENCE_BLOCK;
+        return false;
+    }
+
+    uint32_t until = nextValue + SEQUENCE_BLOCK;
+    bool saved = prefs.putUInt(SEQUENCE_KEY, until) == sizeof(until);
+    prefs.end();
+    reservedUntil = until;
+    return saved;
+}
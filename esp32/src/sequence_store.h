@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Tap sequence numbers that keep increasing across reboots.
+ *
+ * Each boot reserves a block of SEQUENCE_BLOCK numbers in NVS up front
+ * and hands them out from RAM, so flash sees one write per block rather
+ * than one per tap. Numbers a boot didn't use are skipped, never reused,
+ * which is what lets the server deduplicate retransmits by seq alone.
+ * 0 is never issued: it means "no seq" on the wire.
+ */
+class SequenceStore
+{
+public:
+    SequenceStore();
+
+    // Reserves the first block; false if NVS is unavailable (numbers then restart each boot)
+    bool begin();
+
+    uint32_t next();
+
+private:
+    bool reserve();
+
+    uint32_t nextValue;
+    uint32_t reservedUntil; // First number not covered by the saved reservation
+};
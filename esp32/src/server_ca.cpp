@@ -0,0 +1,8 @@
+#include "server_ca.h"
+
+// Paste the CA that signed the Django server's certificate: the campus CA,
+// or the public root behind it (e.g. ISRG Root X1 for Let's Encrypt).
+// Pinning the root rather than the leaf survives certificate renewals.
+// WS_TLS builds refuse to start a connection while this is empty.
+const char SERVER_CA_CERT[] = R"PEM(
+)PEM";
@@ -0,0 +1,5 @@
+#pragma once
+
+// PEM of the one CA trusted for wss:// and HTTPS firmware downloads when
+// WS_TLS is 1 (server_ca.cpp); no other root is accepted
+extern const char SERVER_CA_CERT[];
@@ -0,0 +1,104 @@
+#include "tuning.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "config.h"
+#include "power_batch.h"
+
+// One row per setting: wire name, where it lives and what is accepted
+struct TuningField
+{
+    const char *name;
+    size_t offset;
+    bool isFloat;
+    double lo;
+    double hi;
+};
+
+#define TUNING_U32(name, member, lo, hi) {name, offsetof(Tuning, member), false, lo, hi}
+#define TUNING_FLOAT(name, member, lo, hi) {name, offsetof(Tuning, member), true, lo, hi}
+
+static const TuningField TUNING_FIELDS[] = {
+    TUNING_U32("power_sample_ms", powerSampleMs, 50, 10000),
+    TUNING_U32("power_flush_ms", powerFlushMs, 1000, 600000),
+    TUNING_U32("power_max_interval_ms", powerMaxIntervalMs, 1000, 3600000),
+    TUNING_FLOAT("power_deadband", powerDeadband, 0, 10000),
+    TUNING_U32("heartbeat_ms", heartbeatMs, 5000, 600000),
+    TUNING_U32("metrics_ms", metricsMs, 10000, 3600000),
+    TUNING_U32("lcd_update_ms", lcdUpdateMs, 200, 10000),
+    TUNING_U32("rfid_read_ms", rfidReadMs, 20, 1000),
+    TUNING_U32("uplink_window_ms", uplinkWindowMs, 0, 60000),
+};
+
+void defaultTuning(Tuning &tuning)
+{
+    tuning.powerSampleMs = POWER_SAMPLE_INTERVAL;
+    tuning.powerFlushMs = POWER_FLUSH_INTERVAL;
+    tuning.powerMaxIntervalMs = POWER_REPORT_MAX_INTERVAL;
+    tuning.powerDeadband = POWER_REPORT_DEADBAND;
+    tuning.heartbeatMs = HEARTBEAT_INTERVAL;
+    tuning.metricsMs = METRICS_INTERVAL;
+    tuning.lcdUpdateMs = LCD_UPDATE_INTERVAL;
+    tuning.rfidReadMs = RFID_READ_INTERVAL;
+    tuning.uplinkWindowMs = UPLINK_COALESCE_WINDOW;
+}
+
+bool setTuningValue(Tuning &tuning, const char *name, double value)
+{
+    for (const TuningField &field : TUNING_FIELDS)
+    {
+        if (strcmp(field.name, name) != 0)
+        {
+            continue;
+        }
+        if (isnan(value) || value < field.lo || value > field.hi)
+        {
+            return false;
+        }
+
+        char *slot = reinterpret_cast<char *>(&tuning) + field.offset;
+        if (field.isFloat)
+        {
+            float f = (float)value;
+            memcpy(slot, &f, sizeof(f));
+        }
+        else
+        {
+            uint32_t u = (uint32_t)lround(value);
+            memcpy(slot, &u, sizeof(u));
+        }
+        return true;
+    }
+    return false;
+}
+
+bool tuningConsistent(const Tuning &tuning)
+{
+    // Batches are a ring: a window with more samples than slots loses the oldest
+    return tuning.powerSampleMs > 0 &&
+           tuning.powerFlushMs / tuning.powerSampleMs <= POWER_BATCH_SLOTS &&
+           tuning.powerMaxIntervalMs >= tuning.powerFlushMs &&
+           tuning.uplinkWindowMs < tuning.heartbeatMs; // A held heartbeat must still beat
+}
+
+void forEachTuningValue(const Tuning &tuning, TuningVisitor visit, void *context)
+{
+    const char *base = reinterpret_cast<const char *>(&tuning);
+    for (const TuningField &field : TUNING_FIELDS)
+    {
+        if (field.isFloat)
+        {
+            float f;
+            memcpy(&f, base + field.offset, sizeof(f));
+            visit(field.name, f, context);
+        }
+        else
+        {
+            uint32_t u;
+            memcpy(&u, base + field.offset, sizeof(u));
+            visit(field.name, u, context);
+        }
+    }
+}
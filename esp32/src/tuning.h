@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Intervals and deadbands the server can retune at runtime.
+ *
+ * Defaults are the compile-time values from config.h. A config_update
+ * event changes individual settings by name; the result is kept in NVS
+ * (tuning_store.h) so it survives reboots until the server resets it.
+ */
+struct Tuning
+{
+    uint32_t powerSampleMs;      // power_sample_ms: sensorTask sample period
+    uint32_t powerFlushMs;       // power_flush_ms: batch window
+    uint32_t powerMaxIntervalMs; // power_max_interval_ms: longest silence while inside the deadband
+    float powerDeadband;         // power_deadband: watts the mean must move to report early
+    uint32_t heartbeatMs;        // heartbeat_ms
+    uint32_t metricsMs;          // metrics_ms
+    uint32_t lcdUpdateMs;        // lcd_update_ms: status screen refresh
+    uint32_t rfidReadMs;         // rfid_read_ms: polling mode, per full round of readers
+    uint32_t uplinkWindowMs;     // uplink_window_ms: how long low-priority messages wait to be coalesced
+};
+
+void defaultTuning(Tuning &tuning);
+
+// Set one setting by its wire name. Returns false for unknown names and
+// values outside that setting's allowed range (tuning is left unchanged).
+bool setTuningValue(Tuning &tuning, const char *name, double value);
+
+// Cross-field checks, e.g. a flush window must fit in the power batch
+bool tuningConsistent(const Tuning &tuning);
+
+// Visit every setting as (name, value), for reporting back to the server
+typedef void (*TuningVisitor)(const char *name, double value, void *context);
+void forEachTuningValue(const Tuning &tuning, TuningVisitor visit, void *context);
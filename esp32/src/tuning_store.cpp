@@ -0,0 +1,52 @@
+#include "tuning_store.h"
+
+#include <Preferences.h>
+
+#define TUNING_NAMESPACE "tuning"
+#define TUNING_KEY "v2" // Bump when Tuning's layout changes; old blobs are then ignored
+
+bool loadTuning(Tuning &tuning)
+{
+    Preferences prefs;
+    if (!prefs.begin(TUNING_NAMESPACE, true))
+    {
+        return false;
+    }
+
+    Tuning stored;
+    bool found = prefs.getBytesLength(TUNING_KEY) == sizeof(stored) &&
+                 prefs.getBytes(TUNING_KEY, &stored, sizeof(stored)) == sizeof(stored) &&
+                 tuningConsistent(stored);
+    if (found)
+    {
+        tuning = stored;
+    }
+    prefs.end();
+    return found;
+}
+
+bool saveTuning(const Tuning &tuning)
+{
+    Preferences prefs;
+    if (!prefs.begin(TUNING_NAMESPACE, false))
+    {
+        return false;
+    }
+
+    bool saved = prefs.putBytes(TUNING_KEY, &tuning, sizeof(tuning)) == sizeof(tuning);
+    prefs.end();
+    return saved;
+}
+
+bool clearTuning()
+{
+    Preferences prefs;
+    if (!prefs.begin(TUNING_NAMESPACE, false))
+    {
+        return false;
+    }
+
+    bool cleared = prefs.clear();
+    prefs.end();
+    return cleared;
+}
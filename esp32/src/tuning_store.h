@@ -0,0 +1,8 @@
+#pragma once
+
+#include "tuning.h"
+
+// Keep server-pushed tuning in NVS across reboots
+bool loadTuning(Tuning &tuning);
+bool saveTuning(const Tuning &tuning);
+bool clearTuning();
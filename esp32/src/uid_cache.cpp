@@ -0,0 +1,124 @@
+#include "uid_cache.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#include "fnv.h"
+#include "rfid_debounce.h"
+
+UidCache::UidCache() : count(0)
+{
+}
+
+uint32_t UidCache::hashUid(const char *uid)
+{
+    // Server-side UIDs may be typed in lower case; hash them the way readRFID() writes them
+    char upper[RFID_UID_MAX_LEN];
+    size_t i = 0;
+    for (; uid[i] && i < RFID_UID_MAX_LEN - 1; i++)
+    {
+        upper[i] = toupper((unsigned char)uid[i]);
+    }
+    upper[i] = '\0';
+    return fnv1a32(upper);
+}
+
+uint32_t UidCache::digest(const UidCacheEntry &entry)
+{
+    // Continue the UID hash over the name so a rename also changes the bucket
+    return fnv1a32(entry.name, entry.uidHash);
+}
+
+size_t UidCache::lowerBound(uint32_t uidHash) const
+{
+    size_t lo = 0, hi = count;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (table[mid].uidHash < uidHash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+bool UidCache::lookup(const char *uid, char *name, size_t size) const
+{
+    uint32_t h = hashUid(uid);
+    size_t i = lowerBound(h);
+    if (i == count || table[i].uidHash != h)
+    {
+        return false;
+    }
+
+    if (size > 0)
+    {
+        strncpy(name, table[i].name, size - 1);
+        name[size - 1] = '\0';
+    }
+    return true;
+}
+
+void UidCache::clearBucket(uint8_t bucket)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (bucketOf(table[i].uidHash) != bucket)
+        {
+            table[kept++] = table[i];
+        }
+    }
+    count = kept;
+}
+
+bool UidCache::add(const char *uid, const char *name)
+{
+    uint32_t h = hashUid(uid);
+    size_t i = lowerBound(h);
+
+    if (i == count || table[i].uidHash != h)
+    {
+        if (count == UID_CACHE_CAPACITY)
+        {
+            return false;
+        }
+        memmove(&table[i + 1], &table[i], (count - i) * sizeof(UidCacheEntry));
+        count++;
+    }
+
+    table[i].uidHash = h;
+    strncpy(table[i].name, name, UID_CACHE_NAME_LEN - 1);
+    table[i].name[UID_CACHE_NAME_LEN - 1] = '\0';
+    return true;
+}
+
+void UidCache::bucketChecksums(uint32_t out[UID_CACHE_BUCKETS]) const
+{
+    memset(out, 0, UID_CACHE_BUCKETS * sizeof(uint32_t));
+    for (size_t i = 0; i < count; i++)
+    {
+        // Sum, so the result doesn't depend on entry order
+        out[bucketOf(table[i].uidHash)] += digest(table[i]);
+    }
+}
+
+bool UidCache::restore(const UidCacheEntry *entries, size_t n)
+{
+    if (n > UID_CACHE_CAPACITY)
+    {
+        return false;
+    }
+    for (size_t i = 1; i < n; i++)
+    {
+        if (entries[i - 1].uidHash >= entries[i].uidHash)
+        {
+            return false; // Corrupt or from an incompatible build
+        }
+    }
+
+    memcpy(table, entries, n * sizeof(UidCacheEntry));
+    count = n;
+    return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UID_CACHE_CAPACITY 256
+#define UID_CACHE_BUCKETS 16
+#define UID_CACHE_NAME_LEN 17 // One LCD line + terminator
+
+struct UidCacheEntry
+{
+    uint32_t uidHash; // fnv1a32 of the upper-case hex UID
+    char name[UID_CACHE_NAME_LEN];
+};
+
+/**
+ * Local copy of the server's authorized UIDs and display names, used
+ * for instant on-device feedback. The server stays authoritative: every
+ * tap is still sent and its verdict overrides the local one.
+ *
+ * Entries are sorted by UID hash for binary search. For syncing, they
+ * are split into UID_CACHE_BUCKETS buckets by hash, each with an
+ * order-independent checksum. The device sends its checksums, and the
+ * server replies with the full contents of only the buckets that differ.
+ * A change to one teacher therefore resends about 1/16 of the list.
+ */
+class UidCache
+{
+public:
+    UidCache();
+
+    // Copies the display name into name and returns true if uid is known
+    bool lookup(const char *uid, char *name, size_t size) const;
+
+    // Drop every entry in bucket, ready for its replacement contents
+    void clearBucket(uint8_t bucket);
+    // Returns false when the cache is full
+    bool add(const char *uid, const char *name);
+
+    void bucketChecksums(uint32_t out[UID_CACHE_BUCKETS]) const;
+
+    size_t size() const { return count; }
+    const UidCacheEntry *entries() const { return table; }
+    // Replaces the contents from a saved snapshot (must already be sorted)
+    bool restore(const UidCacheEntry *entries, size_t n);
+
+    static uint32_t hashUid(const char *uid);
+    static uint8_t bucketOf(uint32_t uidHash) { return uidHash % UID_CACHE_BUCKETS; }
+    static uint32_t digest(const UidCacheEntry &entry);
+
+private:
+    size_t lowerBound(uint32_t uidHash) const;
+
+    UidCacheEntry table[UID_CACHE_CAPACITY];
+    size_t count;
+};
@@ -0,0 +1,72 @@
+#include "uid_cache_store.h"
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#include "log.h"
+
+#define UID_CACHE_MAGIC 0x43444955u // "UIDC"
+#define UID_CACHE_FORMAT 1
+
+struct UidCacheHeader
+{
+    uint32_t magic;
+    uint16_t format;
+    uint16_t count;
+};
+
+bool loadUidCache(UidCache &cache, const char *path)
+{
+    File file = LittleFS.open(path, "r");
+    if (!file)
+    {
+        return false;
+    }
+
+    UidCacheHeader header;
+    bool ok = file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+              header.magic == UID_CACHE_MAGIC && header.format == UID_CACHE_FORMAT &&
+              header.count <= UID_CACHE_CAPACITY;
+
+    if (ok)
+    {
+        // Read straight into a scratch table rather than the stack: it is several KB
+        static UidCacheEntry entries[UID_CACHE_CAPACITY];
+        size_t bytes = header.count * sizeof(UidCacheEntry);
+        ok = file.read((uint8_t *)entries, bytes) == bytes && cache.restore(entries, header.count);
+    }
+    file.close();
+
+    if (!ok)
+    {
+        LOG_WARN("UID cache: saved file unreadable, waiting for a full sync\n");
+    }
+    return ok;
+}
+
+bool saveUidCache(const UidCache &cache, const char *path)
+{
+    // Write to a temp file first so a reset mid-write keeps the old cache
+    char tmpPath[32];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+    File file = LittleFS.open(tmpPath, "w");
+    if (!file)
+    {
+        return false;
+    }
+
+    UidCacheHeader header = {UID_CACHE_MAGIC, UID_CACHE_FORMAT, (uint16_t)cache.size()};
+    size_t bytes = cache.size() * sizeof(UidCacheEntry);
+    bool ok = file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+              file.write((const uint8_t *)cache.entries(), bytes) == bytes;
+    file.close();
+
+    if (!ok)
+    {
+        LittleFS.remove(tmpPath);
+        return false;
+    }
+    LittleFS.remove(path);
+    return LittleFS.rename(tmpPath, path);
+}
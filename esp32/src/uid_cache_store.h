@@ -0,0 +1,7 @@
+#pragma once
+
+#include "uid_cache.h"
+
+// Load/save the UID cache as a single LittleFS file. LittleFS must already be mounted.
+bool loadUidCache(UidCache &cache, const char *path);
+bool saveUidCache(const UidCache &cache, const char *path);
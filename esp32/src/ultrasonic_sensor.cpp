@@ -0,0 +1,61 @@
+#include "ultrasonic_sensor.h"
+
+#include <Arduino.h>
+
+static long myMap(long x, long in_min, long in_max, long out_min, long out_max)
+{
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+UltrasonicPowerSensor::UltrasonicPowerSensor(uint8_t trigPin, uint8_t echoPin)
+    : trigPin(trigPin), echoPin(echoPin)
+{
+}
+
+bool UltrasonicPowerSensor::begin()
+{
+    pinMode(trigPin, OUTPUT);
+    pinMode(echoPin, INPUT);
+    return true;
+}
+
+float readUltrasonicCm(uint8_t trigPin, uint8_t echoPin)
+{
+    // Send ultrasonic pulse
+    digitalWrite(trigPin, LOW);
+    delayMicroseconds(2);
+    digitalWrite(trigPin, HIGH);
+    delayMicroseconds(10);
+    digitalWrite(trigPin, LOW);
+
+    // Read echo duration
+    long duration = pulseIn(echoPin, HIGH, 30000); // 30ms timeout
+
+    // Convert to distance (cm)
+    return duration * 0.034 / 2;
+}
+
+bool UltrasonicPowerSensor::read(float &watts)
+{
+    float distance = readUltrasonicCm(trigPin, echoPin);
+
+    // Simulate power based on distance (0-400cm -> 0-1000W)
+    float simulatedPower = 0;
+    if (distance > 0 && distance < 400)
+    {
+        // myMap distance to power: closer = higher power
+        simulatedPower = myMap(distance, 0, 400, 1000, 0);
+        // Add some random variation
+        simulatedPower += random(-20, 20);
+        if (simulatedPower < 0)
+            simulatedPower = 0;
+    }
+    else
+    {
+        // If no reading, return a base load value
+        simulatedPower = 50 + random(0, 30);
+    }
+
+    watts = simulatedPower;
+    return true;
+}
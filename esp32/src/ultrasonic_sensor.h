@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "power_sensor.h"
+
+// One HC-SR04 ping; distance in cm, 0 if no echo came back within 30 ms (~5 m)
+float readUltrasonicCm(uint8_t trigPin, uint8_t echoPin);
+
+/**
+ * Bench stand-in for a power meter: HC-SR04 distance mapped to watts
+ * (closer = higher load). Only useful for demos without mains wiring.
+ */
+class UltrasonicPowerSensor : public PowerSensor
+{
+public:
+    UltrasonicPowerSensor(uint8_t trigPin, uint8_t echoPin);
+
+    bool begin() override;
+    bool read(float &watts) override;
+    const char *name() const override { return "ultrasonic (simulated)"; }
+
+private:
+    uint8_t trigPin;
+    uint8_t echoPin;
+};
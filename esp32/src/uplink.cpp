@@ -0,0 +1,111 @@
+#include "uplink.h"
+
+#include <string.h>
+
+static const char JSON_PREFIX[] = "{\"type\":\"bundle\",\"msgs\":[";
+static const char JSON_SUFFIX[] = "]}";
+
+// MessagePack map of two: "type": "bundle", "msgs": array header written in finish()
+static const uint8_t MSGPACK_PREFIX[] = {0x82, 0xa4, 't', 'y', 'p', 'e', 0xa6, 'b', 'u', 'n', 'd', 'l', 'e',
+                                         0xa4, 'm', 's', 'g', 's'};
+
+static_assert(sizeof(JSON_PREFIX) - 1 <= UplinkBundle::PREFIX_ROOM, "JSON bundle prefix must fit");
+static_assert(sizeof(MSGPACK_PREFIX) + 3 <= UplinkBundle::PREFIX_ROOM, "MessagePack bundle prefix must fit");
+
+UplinkBundle::UplinkBundle(uint8_t *buffer, size_t size)
+    : buffer(buffer), capacity(size), end(PREFIX_ROOM), firstLength(0), members(0), wire(WIRE_JSON), firstAt(0)
+{
+}
+
+bool UplinkBundle::add(const uint8_t *frame, size_t length, WireEncoding encoding, uint32_t nowMs)
+{
+    if (members > 0 && encoding != wire)
+    {
+        return false;
+    }
+    if (members >= 0xffff)
+    {
+        return false;
+    }
+
+    // JSON needs a comma before every member after the first and the closing "]}"
+    size_t separator = members > 0 && encoding == WIRE_JSON ? 1 : 0;
+    size_t suffix = encoding == WIRE_JSON ? sizeof(JSON_SUFFIX) - 1 : 0;
+    if (end + separator + length + suffix > capacity)
+    {
+        return false;
+    }
+
+    if (members == 0)
+    {
+        wire = encoding;
+        firstAt = nowMs;
+        firstLength = length;
+    }
+    if (separator)
+    {
+        buffer[end++] = ',';
+    }
+    memcpy(buffer + end, frame, length);
+    end += length;
+    members++;
+    return true;
+}
+
+bool UplinkBundle::due(uint32_t nowMs, uint32_t windowMs) const
+{
+    return members > 0 && nowMs - firstAt >= windowMs;
+}
+
+const uint8_t *UplinkBundle::finish(size_t &length)
+{
+    if (members == 0)
+    {
+        length = 0;
+        return NULL;
+    }
+    if (members == 1)
+    {
+        length = firstLength;
+        return buffer + PREFIX_ROOM;
+    }
+
+    // Write the prefix right-aligned against the members so the frame is contiguous
+    uint8_t header[PREFIX_ROOM];
+    size_t headerLength;
+    size_t suffix = 0;
+    if (wire == WIRE_JSON)
+    {
+        headerLength = sizeof(JSON_PREFIX) - 1;
+        memcpy(header, JSON_PREFIX, headerLength);
+        suffix = sizeof(JSON_SUFFIX) - 1;
+        memcpy(buffer + end, JSON_SUFFIX, suffix); // Room was kept for it in add()
+    }
+    else
+    {
+        headerLength = sizeof(MSGPACK_PREFIX);
+        memcpy(header, MSGPACK_PREFIX, headerLength);
+        if (members < 16)
+        {
+            header[headerLength++] = 0x90 | members; // fixarray
+        }
+        else
+        {
+            header[headerLength++] = 0xdc; // array 16
+            header[headerLength++] = members >> 8;
+            header[headerLength++] = members & 0xff;
+        }
+    }
+
+    size_t start = PREFIX_ROOM - headerLength;
+    memcpy(buffer + start, header, headerLength);
+    length = end + suffix - start;
+    return buffer + start;
+}
+
+void UplinkBundle::clear()
+{
+    end = PREFIX_ROOM;
+    firstLength = 0;
+    members = 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wire_protocol.h"
+
+/**
+ * Coalesces low-priority uplink messages into one WebSocket frame.
+ *
+ * Power batches, heartbeats, metrics and occupancy changes are encoded
+ * as usual and appended here instead of being sent. Once the oldest has
+ * waited the coalescing window (or the buffer fills) everything goes out
+ * as a single {"type": "bundle", "msgs": [...]} frame, so one TCP segment
+ * and one radio wake carry what used to be several. The members are
+ * copied byte for byte, which works because a JSON array or MessagePack
+ * array body is just its elements back to back.
+ *
+ * A lone member is sent as itself, unwrapped. Members must share one
+ * encoding; add() refuses a different one so the caller flushes first.
+ */
+class UplinkBundle
+{
+public:
+    // Largest bundle prefix ({"type":"bundle","msgs":[ in JSON); members start after it
+    static const size_t PREFIX_ROOM = 25;
+
+    UplinkBundle(uint8_t *buffer, size_t size);
+
+    // Copies one encoded message in; false if it doesn't fit or the encoding differs
+    bool add(const uint8_t *frame, size_t length, WireEncoding encoding, uint32_t nowMs);
+
+    bool empty() const { return members == 0; }
+    size_t count() const { return members; }
+    WireEncoding encoding() const { return wire; }
+
+    // The oldest member has waited windowMs
+    bool due(uint32_t nowMs, uint32_t windowMs) const;
+
+    // Wraps the members into one frame inside the buffer; valid until the next add() or clear()
+    const uint8_t *finish(size_t &length);
+
+    void clear();
+
+private:
+    uint8_t *buffer;
+    size_t capacity;
+    size_t end; // Members occupy [PREFIX_ROOM, end)
+    size_t firstLength;
+    size_t members;
+    WireEncoding wire;
+    uint32_t firstAt;
+};
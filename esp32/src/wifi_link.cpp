@@ -0,0 +1,218 @@
+#include "wifi_link.h"
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <WiFi.h>
+
+#include "log.h"
+
+#define WIFI_AP_MAGIC 0x57464C32 // 'WFL2'; 'WFL1' also held a static address
+
+// Survives soft resets and deep sleep; checked before the NVS copy
+RTC_DATA_ATTR static WifiApCache rtcAp;
+static WifiApCache ap;
+
+// Set from the Wi-Fi event task, consumed by poll()
+static volatile bool gotIp = false;
+static volatile bool lostLink = false;
+
+static void onWifiEvent(WiFiEvent_t event, WiFiEventInfo_t info)
+{
+    switch (event)
+    {
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+        gotIp = true;
+        break;
+
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+        // Our own disconnect() or a begin() replacing a pending attempt;
+        // poll() has already moved on, so don't fail the next attempt for it
+        if (info.wifi_sta_disconnected.reason == WIFI_REASON_ASSOC_LEAVE)
+        {
+            break;
+        }
+        lostLink = true;
+        break;
+
+    case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+        lostLink = true;
+        break;
+
+    default:
+        break;
+    }
+}
+
+static bool loadAp()
+{
+    if (rtcAp.magic == WIFI_AP_MAGIC)
+    {
+        ap = rtcAp;
+        return true;
+    }
+
+    Preferences prefs;
+    if (!prefs.begin("wifi", false))
+    {
+        return false;
+    }
+    prefs.remove("lease"); // Older builds reused the address statically
+    size_t n = prefs.getBytes("ap", &ap, sizeof(ap));
+    prefs.end();
+
+    if (n != sizeof(ap) || ap.magic != WIFI_AP_MAGIC)
+    {
+        return false;
+    }
+    rtcAp = ap;
+    return true;
+}
+
+static void forgetAp()
+{
+    ap.magic = 0;
+    rtcAp.magic = 0;
+
+    Preferences prefs;
+    if (prefs.begin("wifi", false))
+    {
+        prefs.remove("ap");
+        prefs.end();
+    }
+}
+
+WifiLink::WifiLink(const char *ssid, const char *password)
+    : ssid(ssid), password(password), state(LINK_WAITING),
+      backoff(WIFI_BACKOFF_MIN, WIFI_BACKOFF_MAX), joinStartedAt(0), retryAt(0),
+      useCache(false), joinUsedCache(false), fastJoinCount(0)
+{
+}
+
+void WifiLink::begin(unsigned long now)
+{
+    WiFi.persistent(false); // Credentials come from the firmware; don't rewrite flash on every begin()
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(false); // poll() owns reconnects and their backoff
+    WiFi.onEvent(onWifiEvent);
+
+    useCache = loadAp();
+    startJoin(now);
+}
+
+WifiEvent WifiLink::poll(unsigned long now)
+{
+    if (gotIp)
+    {
+        gotIp = false;
+        lostLink = false;
+        if (state != LINK_UP)
+        {
+            state = LINK_UP;
+            backoff.reset();
+            if (joinUsedCache)
+            {
+                fastJoinCount++;
+            }
+            saveAp();
+            return WIFI_EVENT_UP;
+        }
+    }
+
+    if (lostLink)
+    {
+        lostLink = false;
+        if (state == LINK_UP)
+        {
+            // First retry comes quickly; the AP usually just bounced
+            state = LINK_WAITING;
+            retryAt = now + backoff.next();
+            return WIFI_EVENT_DOWN;
+        }
+        if (state == LINK_JOINING)
+        {
+            joinFailed(now);
+        }
+    }
+
+    if (state == LINK_JOINING && now - joinStartedAt >= WIFI_JOIN_TIMEOUT)
+    {
+        // A cached join is retried with a scan straight away, and begin()
+        // replaces the pending attempt; only stop it when backing off
+        if (!joinUsedCache)
+        {
+            WiFi.disconnect();
+        }
+        joinFailed(now);
+    }
+
+    if (state == LINK_WAITING && (long)(now - retryAt) >= 0)
+    {
+        startJoin(now);
+    }
+
+    return WIFI_EVENT_NONE;
+}
+
+void WifiLink::startJoin(unsigned long now)
+{
+    joinUsedCache = useCache && ap.magic == WIFI_AP_MAGIC;
+    lostLink = false; // Anything still pending belongs to the attempt being replaced
+
+    if (joinUsedCache)
+    {
+        // Known AP and channel: no scan; DHCP still hands out the address
+        WiFi.begin(ssid, password, ap.channel, ap.bssid);
+    }
+    else
+    {
+        WiFi.begin(ssid, password);
+    }
+
+    state = LINK_JOINING;
+    joinStartedAt = now;
+}
+
+void WifiLink::joinFailed(unsigned long now)
+{
+    state = LINK_WAITING;
+
+    if (joinUsedCache)
+    {
+        // AP moved channel or was replaced: do a full join right away
+        LOG_INFO("WiFi: cached join failed, scanning\n");
+        useCache = false;
+        forgetAp();
+        retryAt = now;
+        return;
+    }
+
+    uint32_t delay = backoff.next();
+    LOG_WARN("WiFi: join failed, retry in %u ms\n", (unsigned)delay);
+    retryAt = now + delay;
+}
+
+void WifiLink::saveAp()
+{
+    WifiApCache fresh;
+    memset(&fresh, 0, sizeof(fresh));
+    fresh.magic = WIFI_AP_MAGIC;
+    memcpy(fresh.bssid, WiFi.BSSID(), sizeof(fresh.bssid));
+    fresh.channel = WiFi.channel();
+
+    useCache = true;
+    rtcAp = fresh;
+
+    // Only touch flash when something actually changed
+    if (ap.magic == WIFI_AP_MAGIC && memcmp(&ap, &fresh, sizeof(fresh)) == 0)
+    {
+        return;
+    }
+    ap = fresh;
+
+    Preferences prefs;
+    if (prefs.begin("wifi", false))
+    {
+        prefs.putBytes("ap", &ap, sizeof(ap));
+        prefs.end();
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "backoff.h"
+
+// Give up on a join attempt (association plus DHCP) after this long
+#define WIFI_JOIN_TIMEOUT 10000
+
+// Retry delays after failed joins or a lost link
+#define WIFI_BACKOFF_MIN 500
+#define WIFI_BACKOFF_MAX 60000
+
+enum WifiEvent
+{
+    WIFI_EVENT_NONE,
+    WIFI_EVENT_UP,  // Associated and has an IP
+    WIFI_EVENT_DOWN // Link lost; reconnecting in the background
+};
+
+// The AP last joined, so the next join can skip the scan
+struct WifiApCache
+{
+    uint32_t magic;
+    uint8_t bssid[6];
+    int32_t channel;
+};
+
+/**
+ * Event-driven station connection that never blocks the caller.
+ *
+ * begin() starts the first join and returns; poll() is called from the
+ * network task and moves the state machine along on WiFi.onEvent
+ * notifications. After a successful join the AP's BSSID and channel
+ * are kept in RTC memory (survives soft resets and deep sleep) and NVS
+ * (survives power loss). The next join goes straight to that AP on that
+ * channel, skipping the scan. The address always comes from DHCP, so
+ * the router's lease times and reservations are respected. If the
+ * cached join fails the cache is dropped and a normal scan follows,
+ * then exponential backoff between attempts.
+ */
+class WifiLink
+{
+public:
+    WifiLink(const char *ssid, const char *password);
+
+    void begin(unsigned long now);
+    WifiEvent poll(unsigned long now);
+
+    bool connected() const { return state == LINK_UP; }
+
+    // Completed joins that used the cached AP, for logging
+    uint32_t fastJoins() const { return fastJoinCount; }
+
+private:
+    enum State
+    {
+        LINK_WAITING, // Backing off until retryAt
+        LINK_JOINING,
+        LINK_UP
+    };
+
+    void startJoin(unsigned long now);
+    void joinFailed(unsigned long now);
+    void saveAp();
+
+    const char *ssid;
+    const char *password;
+    State state;
+    Backoff backoff;
+    unsigned long joinStartedAt;
+    unsigned long retryAt;
+    bool useCache;
+    bool joinUsedCache;
+    uint32_t fastJoinCount;
+};
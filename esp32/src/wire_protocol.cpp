@@ -0,0 +1,67 @@
+#include "wire_protocol.h"
+
+#include <string.h>
+
+const char *wireEncodingName(WireEncoding encoding)
+{
+    return encoding == WIRE_MSGPACK ? "msgpack" : "json";
+}
+
+bool wireEncodingFromName(const char *name, WireEncoding &out)
+{
+    if (!name)
+    {
+        return false;
+    }
+    if (strcmp(name, "msgpack") == 0)
+    {
+        out = WIRE_MSGPACK;
+        return true;
+    }
+    if (strcmp(name, "json") == 0)
+    {
+        out = WIRE_JSON;
+        return true;
+    }
+    return false;
+}
+
+size_t encodeMessage(const JsonDocument &doc, WireEncoding encoding, uint8_t *buf, size_t size)
+{
+    if (encoding == WIRE_MSGPACK)
+    {
+        if (measureMsgPack(doc) > size)
+        {
+            return 0;
+        }
+        return serializeMsgPack(doc, buf, size);
+    }
+
+    // Leave room for the terminator serializeJson always writes
+    if (measureJson(doc) >= size)
+    {
+        return 0;
+    }
+    return serializeJson(doc, (char *)buf, size);
+}
+
+DeserializationError decodeMessage(JsonDocument &doc, WireEncoding encoding,
+                                   const uint8_t *payload, size_t length)
+{
+    if (encoding == WIRE_MSGPACK)
+    {
+        return deserializeMsgPack(doc, payload, length);
+    }
+    return deserializeJson(doc, payload, length);
+}
+
+DeserializationError decodeMessage(JsonDocument &doc, WireEncoding encoding,
+                                   const uint8_t *payload, size_t length,
+                                   const JsonDocument &filter)
+{
+    if (encoding == WIRE_MSGPACK)
+    {
+        return deserializeMsgPack(doc, payload, length, DeserializationOption::Filter(filter));
+    }
+    return deserializeJson(doc, payload, length, DeserializationOption::Filter(filter));
+}
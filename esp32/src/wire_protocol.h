@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ArduinoJson.h>
+
+// Bumped when message fields change incompatibly; sent in the hello message
+#define WIRE_PROTOCOL_VERSION 1
+
+/**
+ * Encodings the device can use on the WebSocket. Every connection starts
+ * in JSON text; the device offers MessagePack in its hello message and
+ * switches only once the server's hello reply selects it. MessagePack
+ * frames go out as WStype_BIN with exactly the same document layout.
+ */
+enum WireEncoding
+{
+    WIRE_JSON,
+    WIRE_MSGPACK
+};
+
+const char *wireEncodingName(WireEncoding encoding);
+bool wireEncodingFromName(const char *name, WireEncoding &out);
+
+// Serializes doc into buf; returns the byte count, or 0 if it does not fit
+size_t encodeMessage(const JsonDocument &doc, WireEncoding encoding, uint8_t *buf, size_t size);
+
+DeserializationError decodeMessage(JsonDocument &doc, WireEncoding encoding,
+                                   const uint8_t *payload, size_t length);
+
+// Same, but only the fields marked true in filter end up in doc
+DeserializationError decodeMessage(JsonDocument &doc, WireEncoding encoding,
+                                   const uint8_t *payload, size_t length,
+                                   const JsonDocument &filter);